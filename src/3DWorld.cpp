@@ -77,7 +77,7 @@ bool no_smoke_over_mesh(0), enable_model3d_tex_comp(0), global_lighting_update(0
 bool texture_alpha_in_red_comp(0), use_model3d_tex_mipmaps(1), mt_cobj_tree_build(0), two_sided_lighting(0), inf_terrain_scenery(1), invert_model_nmap_bscale(0);
 bool gen_tree_roots(1), fast_water_reflect(0), vsync_enabled(0), use_voxel_cobjs(0), disable_sound(0), enable_depth_clamp(0), volume_lighting(0), no_subdiv_model(0);
 bool detail_normal_map(0), init_core_context(0), use_core_context(0), enable_multisample(1), dynamic_smap_bias(0), model3d_wn_normal(0), snow_shadows(0), user_action_key(0);
-bool enable_dlight_shadows(1), tree_indir_lighting(0), ctrl_key_pressed(0), only_pine_palm_trees(0), enable_gamma_correct(0), use_z_prepass(0), reflect_dodgeballs(0);
+bool enable_dlight_shadows(1), tree_indir_lighting(0), compact_building_indir_lmap(0), chunked_lighting_files(0), ctrl_key_pressed(0), only_pine_palm_trees(0), enable_gamma_correct(0), use_z_prepass(0), reflect_dodgeballs(0);
 bool store_cobj_accum_lighting_as_blocked(0), all_model3d_ref_update(0), begin_motion(0), enable_mouse_look(MOUSE_LOOK_DEF), enable_init_shields(1), tt_triplanar_tex(0);
 bool enable_model3d_bump_maps(1), use_obj_file_bump_grayscale(1), invert_bump_maps(0), use_interior_cube_map_refl(0), enable_cube_map_bump_maps(1), no_store_model_textures_in_memory(0);
 bool enable_model3d_custom_mipmaps(1), flatten_tt_mesh_under_models(0), smileys_chase_player(0), disable_fire_delay(0), disable_recoil(0), mesh_size_locked(0);
@@ -103,7 +103,7 @@ int enable_fsource(0), run_forward(0), advanced(0), dynamic_mesh_scroll(0), defa
 int read_snow_file(0), write_snow_file(0), mesh_detail_tex(NOISE_TEX);
 int read_light_files[NUM_LIGHTING_TYPES] = {0}, write_light_files[NUM_LIGHTING_TYPES] = {0};
 unsigned num_snowflakes(0), create_voxel_landscape(0), hmap_filter_width(0), num_dynam_parts(100), snow_coverage_resolution(2), show_map_view_fractal(0);
-unsigned num_birds_per_tile(2), num_fish_per_tile(15), num_bflies_per_tile(4);
+unsigned num_birds_per_tile(2), num_fish_per_tile(15), num_bflies_per_tile(4), cobj_tree_build_quality(0); // cobj_tree_build_quality: 0=legacy 3-way split (default), 1=median, 2=SAH
 unsigned erosion_iters(0), erosion_iters_tt(0), skybox_tid(0), tiled_terrain_gen_heightmap_sz(0), game_mode_disable_mask(0), num_frame_draw_calls(0);
 float NEAR_CLIP(DEF_NEAR_CLIP), FAR_CLIP(DEF_FAR_CLIP), system_max_orbit(1.0), sky_occlude_scale(0.0), tree_slope_thresh(5.0), mouse_sensitivity(1.0), tt_grass_scale_factor(1.0);
 float water_plane_z(0.0), base_gravity(1.0), crater_depth(1.0), crater_radius(1.0), disabled_mesh_z(FAR_CLIP), vegetation(1.0), atmosphere(1.0), biome_x_offset(0.0);
@@ -124,6 +124,7 @@ colorRGBA flower_color(ALPHA0);
 set<unsigned char> keys, keyset;
 unsigned init_item_counts[] = {2, 2, 2, 6, 6}; // HEALTH, SHIELD, POWERUP, WEAPON, AMMO
 vector<cube_t> smoke_bounds;
+cube_t lighting_load_bounds; // all zeros = load everything
 
 // camera variables
 double c_radius(DEF_CRADIUS), c_theta(DEF_CTHETA), c_phi(DEF_CPHI), up_theta(DEF_UPTHETA), camera_y(DEF_CAMY);
@@ -139,8 +140,8 @@ extern bool flashlight_on, player_wait_respawn, camera_in_building;
 extern int camera_flight, DISABLE_WATER, DISABLE_SCENERY, camera_invincible, onscreen_display, mesh_freq_filter, show_waypoints, last_inventory_frame;
 extern int tree_coll_level, GLACIATE, UNLIMITED_WEAPONS, destroy_thresh, MAX_RUN_DIST, mesh_gen_mode, mesh_gen_shape, map_drag_x, map_drag_y, player_in_water;
 extern unsigned NPTS, NRAYS, LOCAL_RAYS, GLOBAL_RAYS, DYNAMIC_RAYS, NUM_THREADS, MAX_RAY_BOUNCES, grass_density, max_unique_trees, shadow_map_sz;
-extern unsigned scene_smap_vbo_invalid, spheres_mode, max_cube_map_tex_sz, DL_GRID_BS;
-extern float fticks, team_damage, self_damage, player_damage, smiley_damage, smiley_speed, tree_deadness, tree_dead_prob, lm_dz_adj, nleaves_scale, flower_density, universe_ambient_scale;
+extern unsigned scene_smap_vbo_invalid, spheres_mode, max_cube_map_tex_sz, DL_GRID_BS, trace_capture_max_events, trace_capture_frames, tile_cache_mem_mb;
+extern float fticks, team_damage, self_damage, player_damage, smiley_damage, smiley_speed, tree_deadness, tree_dead_prob, leaf_wind_time_budget_ms, lm_dz_adj, nleaves_scale, flower_density, universe_ambient_scale;
 extern float mesh_scale, tree_scale, mesh_height_scale, smiley_acc, hmv_scale, last_temp, grass_length, grass_width, branch_radius_scale, tree_height_scale, planet_update_rate;
 extern float MESH_START_MAG, MESH_START_FREQ, MESH_MAG_MULT, MESH_FREQ_MULT, def_tex_aniso;
 extern double map_x, map_y;
@@ -148,7 +149,7 @@ extern point hmv_pos, camera_last_pos;
 extern colorRGBA sunlight_color;
 extern int coll_id[];
 extern float tree_lod_scales[4];
-extern string read_hmap_modmap_fn, write_hmap_modmap_fn, read_voxel_brush_fn, write_voxel_brush_fn, font_texture_atlas_fn;
+extern string read_hmap_modmap_fn, write_hmap_modmap_fn, read_voxel_brush_fn, write_voxel_brush_fn, font_texture_atlas_fn, trace_capture_fn, tile_cache_dir, tree_cache_fn;
 extern vector<bbox> team_starts;
 extern player_state *sstates;
 extern pt_line_drawer obj_pld;
@@ -1456,7 +1457,8 @@ void keyboard2(int key, int x, int y) { // handling of special keys
 		show_bool_option_change("Spectate", spectate);
 		break;
 
-	case GLUT_KEY_F9: // unused
+	case GLUT_KEY_F9: // start/stop trace capture
+		toggle_trace_capture();
 		break;
 
 	case GLUT_KEY_F10: // switch cloud model / toggle smoke_dlights
@@ -1768,6 +1770,9 @@ int load_config(string const &config_file) {
 	kwmb.add("invert_model_nmap_bscale", invert_model_nmap_bscale);
 	kwmb.add("enable_dlight_shadows", enable_dlight_shadows);
 	kwmb.add("tree_indir_lighting", tree_indir_lighting);
+	kwmb.add("compact_building_indir_lmap", compact_building_indir_lmap); // less memory for the building indir lighting volume once its lights are stable (not peak memory,
+	// and not the global scene lightmap), but lighting is quantized to bfloat16 each time lights change after compaction
+	kwmb.add("chunked_lighting_files", chunked_lighting_files);
 	kwmb.add("only_pine_palm_trees", only_pine_palm_trees);
 	kwmb.add("enable_gamma_correction", enable_gamma_correct);
 	kwmb.add("use_z_prepass", use_z_prepass);
@@ -1811,6 +1816,7 @@ int load_config(string const &config_file) {
 	kwmb.add("allow_model3d_quads", allow_model3d_quads);
 	kwmb.add("keep_keycards_on_death", keep_keycards_on_death);
 	kwmb.add("enable_timing_profiler", enable_timing_profiler);
+	kwmb.add("enable_frame_profiler", frame_profiler_enabled);
 	kwmb.add("fast_transparent_spheres", fast_transparent_spheres);
 	kwmb.add("draw_building_interiors", draw_building_interiors);
 	kwmb.add("reverse_3ds_vert_winding_order", reverse_3ds_vert_winding_order);
@@ -1864,6 +1870,9 @@ int load_config(string const &config_file) {
 	kwmu.add("grass_density", grass_density);
 	kwmu.add("max_unique_trees", max_unique_trees);
 	kwmu.add("shadow_map_sz", shadow_map_sz);
+	kwmu.add("trace_capture_max_events", trace_capture_max_events);
+	kwmu.add("trace_capture_frames", trace_capture_frames);
+	kwmu.add("cobj_tree_build_quality", cobj_tree_build_quality);
 	kwmu.add("max_ray_bounces", MAX_RAY_BOUNCES);
 	kwmu.add("num_test_snowflakes", num_snowflakes);
 	kwmu.add("hmap_filter_width", hmap_filter_width);
@@ -1877,6 +1886,7 @@ int load_config(string const &config_file) {
 	kwmu.add("snow_coverage_resolution", snow_coverage_resolution);
 	kwmu.add("dlight_grid_bitshift", DL_GRID_BS);
 	kwmu.add("tiled_terrain_gen_heightmap_sz", tiled_terrain_gen_heightmap_sz);
+	kwmu.add("tile_cache_mem_mb", tile_cache_mem_mb);
 	kwmu.add("game_mode_disable_mask", game_mode_disable_mask);
 	kwmu.add("show_map_view_fractal", show_map_view_fractal);
 
@@ -1893,6 +1903,7 @@ int load_config(string const &config_file) {
 	kwmf.add("waypoint_sz_thresh", waypoint_sz_thresh);
 	kwmf.add("tree_deadness", tree_deadness);
 	kwmf.add("tree_dead_prob", tree_dead_prob);
+	kwmf.add("leaf_wind_time_budget_ms", leaf_wind_time_budget_ms);
 	kwmf.add("sun_rot", sun_rot);
 	kwmf.add("moon_rot", moon_rot);
 	kwmf.add("sun_theta", sun_theta);
@@ -1989,6 +2000,9 @@ int load_config(string const &config_file) {
 	kwms.add("read_voxel_brush_filename",  read_voxel_brush_fn);
 	kwms.add("write_voxel_brush_filename", write_voxel_brush_fn);
 	kwms.add("font_texture_atlas_fn", font_texture_atlas_fn);
+	kwms.add("trace_capture_filename", trace_capture_fn);
+	kwms.add("tile_cache_dir", tile_cache_dir);
+	kwms.add("tree_cache_filename", tree_cache_fn);
 	kwms.add("sphere_materials_fn", sphere_materials_fn);
 	kwms.add("write_heightmap_png", hmap_out_fn);
 	kwms.add("skybox_cube_map", skybox_cube_map_name);
@@ -2191,6 +2205,9 @@ int load_config(string const &config_file) {
 			}
 			smoke_bounds.push_back(sb);
 		}
+		else if (str == "lighting_load_bounds") { // only XY is used
+			if (read_cube(fp, geom_xform_t(), lighting_load_bounds) != 6) cfg_err("lighting_load_bounds command", error);
+		}
 		else if (str == "reflect_plane_z") {
 			cube_t cube;
 			if (read_cube(fp, geom_xform_t(), cube) != 6) cfg_err("reflect_plane_z command", error);
@@ -2358,6 +2375,7 @@ int main(int argc, char** argv) {
 		);
 	}
 	if (enable_timing_profiler) {toggle_timing_profiler();} // enable profiler logging on init without using the 'u' key
+	if (trace_capture_frames > 0) {start_trace_capture(trace_capture_frames);} // capture load time and the first N frames
 	progress();
 	glutCreateWindow("3D World");
 	progress();
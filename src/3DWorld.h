@@ -1308,6 +1308,32 @@ void register_timing_value(const char *str, int delta_time, bool no_loading_scre
 void toggle_timing_profiler();
 void timing_profiler_stats();
 
+// lock-free hierarchical frame profiler; see profiler.cpp
+unsigned const FRAME_PROF_INVALID = unsigned(-1);
+extern bool frame_profiler_enabled, trace_capture_active;
+
+struct frame_prof_zone_t { // statically registered zone ID; construct once per call site (function-local static)
+	unsigned id;
+	explicit frame_prof_zone_t(char const *const name);
+};
+struct frame_prof_token_t {
+	unsigned node=FRAME_PROF_INVALID, parent=FRAME_PROF_INVALID, zone=0;
+	unsigned long long start_ns=0;
+	bool valid() const {return (node != FRAME_PROF_INVALID);}
+};
+frame_prof_token_t frame_prof_begin_enabled(unsigned zone_id);
+void frame_prof_end_valid(frame_prof_token_t const &token);
+inline frame_prof_token_t frame_prof_begin(unsigned zone_id) {return ((frame_profiler_enabled || trace_capture_active) ? frame_prof_begin_enabled(zone_id) : frame_prof_token_t());}
+inline void frame_prof_end(frame_prof_token_t const &token) {if (token.valid()) {frame_prof_end_valid(token);}}
+unsigned frame_prof_get_cur_node(); // returns FRAME_PROF_INVALID if profiling is disabled
+unsigned frame_prof_set_cur_node(unsigned node); // returns the previous node; does nothing for FRAME_PROF_INVALID
+void frame_profiler_end_frame();
+void frame_profiler_stats();
+// Chrome trace-event JSON capture of timer and frame profiler scopes
+void start_trace_capture(unsigned num_frames); // num_frames=0 => capture until stopped
+void stop_trace_capture_and_write();
+void toggle_trace_capture();
+
 // macros
 #define GET_TIME_MS()    glutGet(GLUT_ELAPSED_TIME)
 #define RESET_TIME       int const timer1(GET_TIME_MS());
@@ -1333,11 +1359,16 @@ class timer_t {
 	std::string name;
 	int timer1;
 	bool enabled, no_loading_screen;
+	frame_prof_token_t prof_token;
 public:
 	timer_t(char const *const name_,  bool enabled_=1, bool nls=0) : name(name_), timer1(GET_TIME_MS()), enabled(enabled_), no_loading_screen(nls) {}
 	timer_t(std::string const &name_, bool enabled_=1, bool nls=0) : name(name_), timer1(GET_TIME_MS()), enabled(enabled_), no_loading_screen(nls) {}
+	timer_t(frame_prof_zone_t const &zone, bool enabled_=1) : timer1(0), enabled(enabled_), no_loading_screen(1) {if (enabled) {prof_token = frame_prof_begin(zone.id);}} // frame profiler only
 	~timer_t() {end();}
-	void end() {if (enabled && !name.empty()) {register_timing_value(name.c_str(), GET_DELTA_TIME, no_loading_screen); name.clear();}}
+	void end() {
+		if (prof_token.valid()) {frame_prof_end(prof_token); prof_token = frame_prof_token_t();}
+		if (enabled && !name.empty()) {register_timing_value(name.c_str(), GET_DELTA_TIME, no_loading_screen); name.clear();}
+	}
 };
 
 struct status_bar_t {
@@ -12,6 +12,10 @@
 #include "sinf.h"
 #include "cobj_bsp_tree.h"
 #include "draw_utils.h"
+#include "fnv_hash.h"
+#include <atomic>
+#include <chrono>
+#include <unordered_set>
 
 float const BURN_RADIUS      = 0.2;
 float const BURN_DAMAGE      = 80.0;
@@ -44,16 +48,18 @@ tree_type tree_types[NUM_TREE_TYPES] = { // not const - config file can override
 	tree_type(BARK6_TEX, PAPAYA_TEX,   1.0, 1.0, 1.0, 1.00, 2.0, 2.0, 0.5, 0.1,  0.0, colorRGBA(0.7, 0.6,  0.5,  1.0), WHITE)
 };
 
-vector<tree_cylin >   tree_builder_t::cylin_cache;
-vector<tree_branch>   tree_builder_t::branch_cache;
-vector<tree_branch *> tree_builder_t::branch_ptr_cache;
+thread_local vector<tree_cylin >   tree_builder_t::cylin_cache;
+thread_local vector<tree_branch>   tree_builder_t::branch_cache;
+thread_local vector<tree_branch *> tree_builder_t::branch_ptr_cache;
 
 
 bool has_any_billboard_coll(0), next_has_any_billboard_coll(0), tree_4th_branches(0);
 unsigned max_unique_trees(0);
+string tree_cache_fn; // optional file for caching generated shared trees across runs
 int tree_mode(1), tree_coll_level(2); // tree_mode: 0 = no trees, 1 = large only, 2 = small only, 3 = both large and small
 float leaf_color_coherence(0.5), tree_color_coherence(0.2), tree_deadness(-1.0), tree_dead_prob(0.0), nleaves_scale(1.0), branch_radius_scale(1.0), tree_height_scale(1.0);
 float tree_lod_scales[4] = {0, 0, 0, 0}; // branch_start, branch_end, leaf_start, leaf_end
+float leaf_wind_time_budget_ms(2.0); // per-frame CPU time limit for leaf wind updates; 0 = unlimited
 colorRGBA leaf_base_color(BLACK);
 tree_data_manager_t tree_data_manager;
 tree_cont_t t_trees(tree_data_manager);
@@ -61,7 +67,7 @@ tree_placer_t tree_placer;
 
 
 extern bool has_snow, no_sun_lpos_update, has_dl_sources, gen_tree_roots, tt_lightning_enabled, tree_indir_lighting, begin_motion, enable_grass_fire, rotate_trees;
-extern int num_trees, do_zoom, display_mode, animate2, iticks, draw_model, frame_counter;
+extern int num_trees, do_zoom, display_mode, animate2, iticks, draw_model, frame_counter, verbose_mode;
 extern int xoff2, yoff2, rand_gen_index, leaf_color_changed, scrolling, dx_scroll, dy_scroll, window_width, window_height;
 extern unsigned smoke_tid;
 extern float zmin, zmax, zmax_est, zbottom, water_plane_z, tree_scale, temperature, fticks, vegetation, tree_density_thresh, tree_slope_thresh;
@@ -308,6 +314,38 @@ bool tree_cont_t::check_cube_int(cube_t const &c) const {
 }
 
 
+void tree::update_leaf_orients_wind_batch(vector<tree *> &trees) { // closest trees first, in parallel, within the per-frame time budget
+
+	if (trees.empty()) return;
+	sort(trees.begin(), trees.end(), [](tree const *a, tree const *b) {return (a->get_last_size_scale() > b->get_last_size_scale());});
+	// trees that share a tree_data_t bend the same leaves, so only the closest one is updated; this also ensures that
+	// each tree_data_t is only modified by one thread; the SoA wind geom is built here, serially, since it may resize vectors
+	static std::unordered_set<tree_data_t const *> seen; // reused across calls
+	seen.clear();
+	unsigned num_unique(0);
+
+	for (tree *t : trees) {
+		if (!seen.insert(&t->tdata()).second) {t->leaf_orients_valid = 1; continue;} // leaves are bent by a closer tree with the same data
+		t->tdata().ensure_wind_geom();
+		trees[num_unique++] = t;
+	}
+	trees.resize(num_unique);
+	auto const start_time(std::chrono::steady_clock::now());
+	int const num(trees.size());
+	std::atomic<bool> over_budget(0);
+
+#pragma omp parallel for schedule(dynamic) if (num > 1)
+	for (int i = 0; i < num; ++i) {
+		if (over_budget) continue; // remaining trees keep their current leaf orients
+		
+		if (i > 0 && leaf_wind_time_budget_ms > 0.0) { // always update the closest tree
+			float const elapsed_ms(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start_time).count());
+			if (elapsed_ms > leaf_wind_time_budget_ms) {over_budget = 1; continue;}
+		}
+		trees[i]->update_leaf_orients_wind();
+	}
+}
+
 int tree_cont_t::draw_branches_and_leaves(shader_t &s, tree_lod_render_t &lod_renderer,
 	bool draw_branches, bool draw_leaves, bool shadow_only, bool reflection_pass, vector3d const &xlate)
 {
@@ -358,9 +396,7 @@ int tree_cont_t::draw_branches_and_leaves(shader_t &s, tree_lod_render_t &lod_re
 				}
 			}
 			tree_data_t::post_leaf_draw();
-			int const num_to_update(to_update_leaves.size());
-#pragma omp parallel for num_threads(max(1, min(4, num_to_update))) schedule(static) if (num_to_update > 1)
-			for (int i = 0; i < num_to_update; ++i) {to_update_leaves[i]->update_leaf_orients_wind();}
+			tree::update_leaf_orients_wind_batch(to_update_leaves);
 		}
 	}
 	return wsoff_loc;
@@ -604,6 +640,7 @@ void tree_data_t::remove_leaf_ix(unsigned i, bool update_data) {
 	assert(i < leaves.size());
 	leaves[i] = leaves.back();
 	leaves.pop_back();
+	clear_wind_geom();
 	if (!update_data) return;
 	unsigned const i4(i << 2), tnl4((unsigned)leaves.size() << 2);
 	assert(4*leaves.size() <= leaf_data.size());
@@ -1200,7 +1237,68 @@ bool tree_data_t::leaf_draw_setup(bool no_leaf_reset) {
 }
 
 
-void tree_data_t::bend_leaf(unsigned i, float angle) { // Note: slow
+void tree_data_t::ensure_wind_geom() {
+
+	unsigned const num(leaves.size());
+	if (wind_geom[0].size() == num) return; // already valid; leaves are only added when the tree is generated, which clears this
+	for (unsigned n = 0; n < LW_NUM; ++n) {wind_geom[n].resize(num);}
+
+	for (unsigned i = 0; i < num; ++i) {
+		tree_leaf const &l(leaves[i]);
+		vector3d const dir(l.pts[1] - l.pts[0]), side(l.pts[3] - l.pts[0]);
+		UNROLL_3X(wind_geom[LW_DX+i_][i] = dir[i_]; wind_geom[LW_NX+i_][i] = l.norm[i_]; wind_geom[LW_SX+i_][i] = side[i_];)
+		wind_geom[LW_LEN][i] = dir.mag();
+	}
+}
+
+// batched version of bend_leaf() for all leaves where bend[i] != 0; the math is done on SoA arrays without branches so that the compiler can vectorize it
+void tree_data_t::bend_leaves(vector<float> const &angles, vector<uint8_t> const &bend) {
+
+	unsigned const num(leaves.size());
+	if (num == 0) return;
+	assert(angles.size() >= num && bend.size() >= num && leaf_data.size() >= 4*num);
+	assert(wind_geom[0].size() == num); // must call ensure_wind_geom() first, serially
+	static thread_local vector<float> out[6]; // tip delta and new normal
+	for (unsigned n = 0; n < 6; ++n) {out[n].resize(num);}
+	float const *const dx(wind_geom[LW_DX].data()), *const dy(wind_geom[LW_DY].data()), *const dz(wind_geom[LW_DZ].data()), *const len(wind_geom[LW_LEN].data());
+	float const *const nx(wind_geom[LW_NX].data()), *const ny(wind_geom[LW_NY].data()), *const nz(wind_geom[LW_NZ].data());
+	float const *const sx(wind_geom[LW_SX].data()), *const sy(wind_geom[LW_SY].data()), *const sz(wind_geom[LW_SZ].data()), *const ang(angles.data());
+	float *const ox(out[0].data()), *const oy(out[1].data()), *const oz(out[2].data()), *const onx(out[3].data()), *const ony(out[4].data()), *const onz(out[5].data());
+
+	for (unsigned i = 0; i < num; ++i) {
+		// angles are in [-PI/2, PI/2], so use polynomial sin/cos, which vectorize, rather than table lookups
+		float const a(ang[i]), a2(a*a);
+		float const s(a*(1.0f - a2*(1.0f/6.0f - a2*(1.0f/120.0f - a2*(1.0f/5040.0f)))));
+		float const c(1.0f - a2*(0.5f - a2*(1.0f/24.0f - a2*(1.0f/720.0f - a2*(1.0f/40320.0f)))));
+		float const ls(len[i]*s);
+		float const ndx(dx[i]*c + nx[i]*ls), ndy(dy[i]*c + ny[i]*ls), ndz(dz[i]*c + nz[i]*ls); // new base to tip dir
+		float const cx(ndy*sz[i] - ndz*sy[i]), cy(ndz*sx[i] - ndx*sz[i]), cz(ndx*sy[i] - ndy*sx[i]); // cross_product(new_dir, side)
+		float const inv_mag(1.0f/sqrtf(max((cx*cx + cy*cy + cz*cz), 1.0E-12f)));
+		ox [i] = ndx - dx[i]; oy [i] = ndy - dy[i]; oz [i] = ndz - dz[i];
+		onx[i] = cx*inv_mag;  ony[i] = cy*inv_mag;  onz[i] = cz*inv_mag;
+	}
+	unsigned first(num), last(0);
+
+	for (unsigned i = 0; i < num; ++i) { // scatter into the interleaved vertex data
+		if (!bend[i]) continue;
+		tree_leaf const &l(leaves[i]);
+		vector3d const delta(ox[i], oy[i], oz[i]);
+		unsigned const ix(i<<2);
+		leaf_data[ix+1].v = l.pts[1] + delta;
+		leaf_data[ix+2].v = l.pts[2] + delta;
+		norm_comp nc; nc.set_norm_no_clamp(vector3d(onx[i], ony[i], onz[i])); // already normalized, no need to clamp
+		UNROLL_4X(leaf_data[i_+ix].set_norm(nc);)
+		min_eq(first, i);
+		last = i+1;
+	}
+	if (first >= last) return; // nothing bent
+	leaf_change_start = min(first, leaf_change_start);
+	leaf_change_end   = max(last,  leaf_change_end);
+	reset_leaves      = 1;
+}
+
+
+void tree_data_t::bend_leaf(unsigned i, float angle) { // Note: slow; use bend_leaves() for many leaves
 
 	assert(i < leaves.size());
 	tree_leaf const &l(leaves[i]);
@@ -1236,6 +1334,10 @@ void tree::update_leaf_orients_wind() { // leaves move in wind (somewhat slow)
 	bool const heal_pass(priv_data && LEAF_HEAL_RATE > 0 && world_mode == WMODE_GROUND && (rgen.rand()&7) == 0); // only update healed color every 8 frames
 	int last_xpos(0), last_ypos(0);
 	vector3d local_wind(zero_vector);
+	static thread_local vector<float> angles;
+	static thread_local vector<uint8_t> bend;
+	angles.resize(leaves.size());
+	bend  .resize(leaves.size());
 
 	for (unsigned i = 0; i < leaves.size(); ++i) { // process leaf wind and collisions
 		point p0(leaves[i].pts[0]);
@@ -1248,10 +1350,9 @@ void tree::update_leaf_orients_wind() { // leaves move in wind (somewhat slow)
 			last_xpos  = xpos;
 			last_ypos  = ypos;
 		}
-		if (local_wind != zero_vector) {
-			float const angle(PI_TWO*max(-1.0f, min(1.0f, dot_product(local_wind, leaves[i].norm)))); // not physically correct, but it looks good
-			td.bend_leaf(i, angle);
-		}
+		bend  [i] = (local_wind != zero_vector);
+		angles[i] = (bend[i] ? PI_TWO*max(-1.0f, min(1.0f, dot_product(local_wind, leaves[i].norm))) : 0.0f); // not physically correct, but it looks good
+
 		if (heal_pass && (rgen.rand()&63) == 0) { // leaf heals every 64 frames
 			short &lcolor(td.get_leaves()[i].lcolor); // non-const, can't use <leaves>
 
@@ -1261,13 +1362,21 @@ void tree::update_leaf_orients_wind() { // leaves move in wind (somewhat slow)
 			}
 		}
 	} // for i
+	td.bend_leaves(angles, bend);
 	leaf_orients_valid = 1;
 }
 
+unsigned tree::get_leaf_wind_update_period() const { // in frames; distant trees are updated less often
+	float const size_scale(last_size_scale*tdata().get_size_scale_mult());
+	return ((size_scale > 3.0) ? 1 : ((size_scale > 1.5) ? 2 : 4));
+}
+
 void tree::update_leaf_orients_all(vector<tree *> &to_update_leaves) {
 
 	tree_data_t &td(tdata());
-	if (td.check_if_needs_updated() || !leaf_orients_valid) {to_update_leaves.push_back(this);}
+	bool const needs_update(td.check_if_needs_updated()); // once per frame for shared tree data
+	unsigned const phase(int(tree_center.x*123.0f + tree_center.y*456.0f) & 255); // spread out updates of distant trees across frames
+	if (!leaf_orients_valid || (needs_update && ((frame_counter + phase) % get_leaf_wind_update_period()) == 0)) {to_update_leaves.push_back(this);}
 	if (!has_any_billboard_coll || leaf_cobjs.empty()) return; // no coll movement
 	// leaves move when struck by an object
 	vector<tree_leaf> const &leaves(td.get_leaves());
@@ -1338,6 +1447,7 @@ void tree_data_t::clear_data() {
 	clear_cont(all_cylins);
 	clear_cont(leaf_data);
 	clear_cont(leaves); // Note: not present in original delete_trees()
+	clear_wind_geom();
 }
 
 
@@ -1560,6 +1670,7 @@ void tree_data_t::gen_tree_data(int tree_type_, int size, float tree_depth, floa
 	assert(tree_type < NUM_TREE_TYPES);
 	leaf_data.clear();
 	clear_vbo_ixs();
+	clear_wind_geom();
 	float deadness(DISABLE_LEAVES ? 1.0 : tree_deadness);
 
 	if (deadness < 0.0) {
@@ -1574,6 +1685,12 @@ void tree_data_t::gen_tree_data(int tree_type_, int size, float tree_depth, floa
 	b_tex_scale = tree_types[tree_type].branch_tscale*height_scale/br_scale;
 	base_radius = builder.create_tree_branches(tree_type, size, tree_depth, base_color, height_scale, br_scale, nl_scale, bbo_scale, has_4th_branches, create_bush);
 	builder.create_all_cylins_and_leaves(all_cylins, leaves, tree_type, deadness, br_scale, nl_scale, has_4th_branches, size);
+	calc_bounds();
+	reverse(leaves.begin(), leaves.end()); // order leaves so that LOD removes from the center first, which is less noticeable
+	//PRINT_TIME("Gen Tree");
+}
+
+void tree_data_t::calc_bounds() { // from all_cylins and leaves
 
 	// set the bounding sphere center
 	assert(!all_cylins.empty());
@@ -1603,8 +1720,46 @@ void tree_data_t::gen_tree_data(int tree_type_, int size, float tree_depth, floa
 	sphere_radius = sqrt(sphere_radius);
 	lr_z_cent     = 0.5f*(lr_z1 + lr_z2);
 	lr_z          = 0.5f*(lr_z2 - lr_z1);
-	reverse(leaves.begin(), leaves.end()); // order leaves so that LOD removes from the center first, which is less noticeable
-	//PRINT_TIME("Gen Tree");
+}
+
+
+unsigned const MAX_CACHED_TREE_CYLINS = (1<<20), MAX_CACHED_TREE_LEAVES = (1<<22); // sanity limits for cached tree data; real trees are much smaller
+
+struct tree_data_header_t { // fixed size part of serialized tree data
+	int tree_type;
+	unsigned num_cylins, num_leaves;
+	colorRGBA base_color;
+	float base_radius, br_scale, b_tex_scale;
+	bool has_4th_branches;
+};
+
+bool tree_data_t::write_gen_data(FILE *fp) const {
+	tree_data_header_t const header{tree_type, (unsigned)all_cylins.size(), (unsigned)leaves.size(), base_color, base_radius, br_scale, b_tex_scale, has_4th_branches};
+	if (fwrite(&header, sizeof(header), 1, fp) != 1) return 0;
+	if (fwrite(all_cylins.data(), sizeof(draw_cylin), all_cylins.size(), fp) != all_cylins.size()) return 0;
+	return (fwrite(leaves.data(), sizeof(tree_leaf), leaves.size(), fp) == leaves.size());
+}
+
+bool tree_data_t::read_gen_data(FILE *fp) {
+	tree_data_header_t header;
+	if (fread(&header, sizeof(header), 1, fp) != 1) return 0;
+	if (header.tree_type < 0 || header.tree_type >= NUM_TREE_TYPES || header.num_cylins == 0) return 0; // invalid
+	if (header.num_cylins > MAX_CACHED_TREE_CYLINS || header.num_leaves > MAX_CACHED_TREE_LEAVES) return 0; // corrupt; don't allocate
+	all_cylins.resize(header.num_cylins);
+	leaves    .resize(header.num_leaves);
+	if (fread(all_cylins.data(), sizeof(draw_cylin), all_cylins.size(), fp) != all_cylins.size() ||
+		fread(leaves.data(), sizeof(tree_leaf), leaves.size(), fp) != leaves.size()) {all_cylins.clear(); leaves.clear(); return 0;}
+	tree_type        = header.tree_type;
+	base_color       = header.base_color;
+	base_radius      = header.base_radius;
+	br_scale         = header.br_scale;
+	b_tex_scale      = header.b_tex_scale;
+	has_4th_branches = header.has_4th_branches;
+	leaf_data.clear();
+	clear_vbo_ixs();
+	clear_wind_geom();
+	calc_bounds(); // order independent, so it's fine that leaves were already reversed
+	return 1;
 }
 
 
@@ -2378,6 +2533,99 @@ void tree_data_manager_t::ensure_init() {
 	}
 	last_tree_scale = tree_scale;
 	last_rgi        = rand_gen_index;
+	gen_all(); // generate all shared trees now rather than in the first tile that uses each one, so that results don't depend on tile creation order
+}
+
+uint64_t calc_tree_gen_params_hash(unsigned num_trees) { // hash of everything that affects generated shared trees
+	std::ostringstream oss;
+	oss << num_trees << " " << rand_gen_index << " " << tree_scale << " " << tree_height_scale << " " << branch_radius_scale << " " << nleaves_scale << " "
+		<< tree_deadness << " " << tree_dead_prob << " " << gen_tree_roots << " " << tree_4th_branches << " " << have_cities() << " " << sizeof(draw_cylin) << " " << sizeof(tree_leaf);
+
+	for (unsigned i = 0; i < NUM_TREE_TYPES; ++i) { // these can be overridden by the config file
+		tree_type const &t(tree_types[i]);
+		oss << " " << t.branch_size << " " << t.branch_radius << " " << t.leaf_size << " " << t.leaf_x_ar << " " << t.height_scale << " "
+			<< t.branch_break_off << " " << t.branch_tscale << " " << t.branch_color_var << " " << t.bush_prob;
+	}
+	string const str(oss.str());
+	return calc_fnv_hash(str.data(), str.size());
+}
+
+void tree_data_manager_t::gen_shared_tree(unsigned ix) { // thread safe; depends only on ix and global params
+	assert(ix < size());
+	unsigned const num_per_type(max(1U, (unsigned)size()/NUM_TREE_TYPES)); // must agree with tree_cont_t::add_new_tree()
+	int type(min(ix/num_per_type, unsigned(NUM_TREE_TYPES-1)));
+	rand_gen_t rgen;
+	rgen.set_state(805306457*(ix+1) + 12582917*rand_gen_index, 6291469*(ix+1) + 3145739*rand_gen_index);
+	rgen.rand_mix();
+	// same logic as tree::gen_tree(); bushes aren't allowed in cities
+	bool const create_bush(!have_cities() && rgen.rand_probability(tree_types[type].bush_prob));
+	if (create_bush) {type = (type + 1) % NUM_TREE_TYPES;}
+	tree_type const &treetype(tree_types[type]);
+	(*this)[ix].gen_tree_data(type, 0, get_default_tree_depth(), treetype.height_scale, treetype.branch_radius, 1.0, treetype.branch_break_off,
+		tree_4th_branches, nullptr, create_bush, rgen);
+}
+
+void tree_data_manager_t::gen_all() {
+
+	vector<unsigned> to_gen;
+	for (unsigned i = 0; i < size(); ++i) {if (!(*this)[i].is_created()) {to_gen.push_back(i);}}
+	if (to_gen.empty()) return; // common case
+	timer_t timer("Gen Shared Trees");
+	uint64_t const params_hash(calc_tree_gen_params_hash(size()));
+	vector<uint64_t> keys(size());
+
+	for (unsigned i = 0; i < size(); ++i) {keys[i] = calc_fnv_hash(&i, sizeof(i), params_hash);} // content key for each tree
+	unsigned const num_read(tree_cache_fn.empty() ? 0 : read_cache(keys));
+
+	if (num_read > 0) {
+		vector<unsigned> rem;
+		for (unsigned i : to_gen) {if (!(*this)[i].is_created()) {rem.push_back(i);}}
+		to_gen.swap(rem);
+	}
+#pragma omp parallel for schedule(dynamic)
+	for (int n = 0; n < (int)to_gen.size(); ++n) {gen_shared_tree(to_gen[n]);}
+	if (!tree_cache_fn.empty() && !to_gen.empty()) {write_cache(keys);}
+	if (verbose_mode) {cout << "Generated " << to_gen.size() << " shared trees and read " << num_read << " from the cache" << endl;}
+}
+
+unsigned const TREE_CACHE_MAGIC = 0x74726331; // "trc1"
+
+unsigned tree_data_manager_t::read_cache(vector<uint64_t> const &keys) {
+	FILE *fp(fopen(tree_cache_fn.c_str(), "rb"));
+	if (fp == nullptr) return 0; // no cache file yet
+	map<uint64_t, unsigned> key_to_ix;
+	for (unsigned i = 0; i < keys.size(); ++i) {key_to_ix[keys[i]] = i;}
+	unsigned header[2] = {0, 0}, num_read(0); // {magic, num_entries}
+
+	if (fread(header, sizeof(unsigned), 2, fp) == 2 && header[0] == TREE_CACHE_MAGIC) {
+		for (unsigned n = 0; n < header[1]; ++n) {
+			uint64_t key(0);
+			if (fread(&key, sizeof(key), 1, fp) != 1) break;
+			auto it(key_to_ix.find(key));
+			tree_data_t temp;
+			bool const use(it != key_to_ix.end() && !(*this)[it->second].is_created());
+			if (!(use ? (*this)[it->second] : temp).read_gen_data(fp)) break; // read error
+			num_read += use;
+		}
+	}
+	checked_fclose(fp);
+	return num_read;
+}
+
+void tree_data_manager_t::write_cache(vector<uint64_t> const &keys) const {
+	FILE *fp(fopen(tree_cache_fn.c_str(), "wb"));
+	if (fp == nullptr) {cout << "Error: Failed to open tree cache file " << tree_cache_fn << " for write" << endl; return;} // nonfatal
+	unsigned num_entries(0);
+	for (tree_data_t const &td : *this) {num_entries += td.is_created();}
+	unsigned const header[2] = {TREE_CACHE_MAGIC, num_entries};
+	bool success(fwrite(header, sizeof(unsigned), 2, fp) == 2);
+
+	for (unsigned i = 0; i < size() && success; ++i) {
+		if (!(*this)[i].is_created()) continue;
+		success = (fwrite(&keys[i], sizeof(uint64_t), 1, fp) == 1 && (*this)[i].write_gen_data(fp));
+	}
+	checked_fclose(fp);
+	if (!success) {remove(tree_cache_fn.c_str());} // don't leave partial files
 }
 
 void tree_data_manager_t::clear_context() {
@@ -0,0 +1,86 @@
+// 3D World - Reusable A* Search State with Per-Thread Pooled Node State
+// by Frank Gennari
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+// Holds the per-node state, open/closed flags, and open priority queue for an A* search over dense node indices;
+// nodes are reset lazily using a generation counter, so starting a new search doesn't need to clear or reallocate anything.
+// S is the user's per-node state and must be default constructible; the default value is what each node starts with.
+template<typename S> class a_star_search_t {
+	struct queue_entry_t {
+		float f_score;
+		unsigned ix;
+		queue_entry_t(float f, unsigned i) : f_score(f), ix(i) {}
+		// lower f_score first, then higher index; same order as the priority_queue<pair<-f_score, ix>> this replaces
+		bool operator<(queue_entry_t const &e) const {return ((f_score == e.f_score) ? (ix < e.ix) : (f_score > e.f_score));}
+	};
+	enum {NODE_OPEN=1, NODE_CLOSED=2};
+	std::vector<S> state;
+	std::vector<unsigned> node_gen; // node is reset when this != cur_gen
+	std::vector<uint8_t> flags;
+	std::vector<queue_entry_t> open_queue; // binary heap
+	unsigned cur_gen=0;
+	bool in_use=0;
+
+	void check_node(unsigned ix) {
+		assert(ix < state.size());
+		if (node_gen[ix] == cur_gen) return; // already valid for this search
+		node_gen[ix] = cur_gen;
+		state   [ix] = S();
+		flags   [ix] = 0;
+	}
+public:
+	// call at the start of each search; only grows the arrays
+	void begin(unsigned num_nodes) {
+		assert(!in_use); // nested searches with the same state type on the same thread aren't supported
+		in_use = 1;
+
+		if (++cur_gen == 0) { // generation counter wraparound, reset everything
+			std::fill(node_gen.begin(), node_gen.end(), 0);
+			cur_gen = 1;
+		}
+		if (state.size() < num_nodes) {
+			state   .resize(num_nodes);
+			node_gen.resize(num_nodes, 0);
+			flags   .resize(num_nodes, 0);
+		}
+		open_queue.clear();
+	}
+	void end() {in_use = 0;}
+	S       &get_state(unsigned ix)       {check_node(ix); return state[ix];}
+	S const &get_state(unsigned ix) const {assert(ix < state.size() && node_gen[ix] == cur_gen); return state[ix];} // must have been visited
+	bool is_open  (unsigned ix) {check_node(ix); return (flags[ix] & NODE_OPEN  );}
+	bool is_closed(unsigned ix) {check_node(ix); return (flags[ix] & NODE_CLOSED);}
+	void set_open (unsigned ix) {check_node(ix); flags[ix] = NODE_OPEN;}
+	void set_closed(unsigned ix) {check_node(ix); flags[ix] = NODE_CLOSED;} // also clears open
+
+	bool queue_empty() const {return open_queue.empty();}
+	void push(float f_score, unsigned ix) {open_queue.emplace_back(f_score, ix); std::push_heap(open_queue.begin(), open_queue.end());}
+
+	unsigned pop() {
+		assert(!open_queue.empty());
+		std::pop_heap(open_queue.begin(), open_queue.end());
+		unsigned const ix(open_queue.back().ix);
+		open_queue.pop_back();
+		return ix;
+	}
+};
+
+// returns the search object for this thread, started for num_nodes nodes; it's released when the scope object is destroyed
+template<typename S> class a_star_scope_t {
+	a_star_search_t<S> &search;
+public:
+	a_star_scope_t(unsigned num_nodes) : search(get_pool()) {search.begin(num_nodes);}
+	~a_star_scope_t() {search.end();}
+	a_star_search_t<S> &operator*() const {return search;}
+	a_star_search_t<S> *operator->() const {return &search;}
+
+	static a_star_search_t<S> &get_pool() {
+		static thread_local a_star_search_t<S> pool; // one per thread and state type; memory is reused across searches
+		return pool;
+	}
+};
+
@@ -6,6 +6,7 @@
 
 #include "3DWorld.h"
 #include <zlib.h>
+#include <limits>
 
 using std::string;
 
@@ -51,6 +52,29 @@ struct binary_file_reader : public binary_file_io {
 		else {assert(0);} // no file opened
 		return 0;
 	}
+	// absolute position; returns 0 if pos can't be represented by this platform's file offset type; Note: slow for gz files, and only forward seeks are efficient
+	bool seek(uint64_t pos) {
+		if (fp) {
+#ifdef _MSC_VER
+			if (pos > uint64_t(std::numeric_limits<__int64>::max())) return 0;
+			return (_fseeki64(fp, __int64(pos), SEEK_SET) == 0); // long is 32 bits with MSVC, so fseek() can't seek past 2GB
+#else
+			if (pos > uint64_t(std::numeric_limits<off_t>::max())) return 0;
+			return (fseeko(fp, off_t(pos), SEEK_SET) == 0);
+#endif
+		}
+		else if (gzf) {
+#ifdef Z_LARGE64
+			if (pos > uint64_t(std::numeric_limits<z_off64_t>::max())) return 0;
+			return (gzseek64(gzf, z_off64_t(pos), SEEK_SET) == z_off64_t(pos));
+#else
+			if (pos > uint64_t(std::numeric_limits<z_off_t>::max())) return 0; // z_off_t may be 32 bits
+			return (gzseek(gzf, z_off_t(pos), SEEK_SET) == z_off_t(pos));
+#endif
+		}
+		else {assert(0);} // no file opened
+		return 0;
+	}
 };
 struct binary_file_writer : public binary_file_io {
 	bool open(string const &filename) {return binary_file_io::open(filename, "wb", "writing");}
@@ -300,6 +300,66 @@ void object_line_coll(dwobject &obj, point const &old_pos, float radius, unsigne
 }
 
 
+// Precipitation objects don't interact with each other, so the line queries against the cobj trees made for them in process_groups()
+// can be run in parallel before the serial object update. The query endpoints are stored in SoA form, and a result is only used
+// if the object is still at the queried position with the same velocity. Cobjs added, removed, or moved by earlier objects in the serial loop
+// are tracked, and any query whose line crosses one of their bounds is redone inline so that it sees the current cobj state.
+class precip_coll_batch_t {
+	vector<point> pos1, pos2;
+	vector<int> cindex, batch_ix; // batch_ix is indexed by object, -1 = not batched
+	vector<cube_t> changed; // bounds of cobjs modified since the queries were run
+	cube_t changed_bcube;
+	bool active=0;
+public:
+	void clear() {pos1.clear(); pos2.clear(); cindex.clear(); batch_ix.clear(); changed.clear(); changed_bcube.set_to_zeros(); active = 0;}
+
+	void cobj_changed(cube_t const &bcube) {
+		if (!active) return;
+		changed.push_back(bcube);
+		changed_bcube.assign_or_union_with_cube(bcube);
+	}
+
+	void build(obj_group const &objg, size_t iter_count, float radius, float time, float grav_dz) { // matches the query in process_groups()
+		clear();
+		batch_ix.resize(iter_count, -1);
+
+		for (size_t j = 0; j < iter_count; ++j) {
+			dwobject const &obj(objg.get_obj(j));
+			if (obj.status != 1 || obj.health < 0.0 || obj.time < 0 || (obj.flags & CAMERA_VIEW)) continue; // not airborne or not advanced normally
+			if (((obj.flags & XY_STOPPED) && (obj.flags & Z_STOPPED)) || obj.pos.z >= czmax || obj.pos.z <= czmin || !is_over_mesh(obj.pos)) continue;
+			point p2(obj.pos + obj.velocity*time);
+			p2.z -= grav_dz;
+			if (dist_less_than(obj.pos, p2, radius)) continue; // no line query needed
+			batch_ix[j] = pos1.size();
+			pos1.push_back(obj.pos);
+			pos2.push_back(p2);
+		}
+		cindex.resize(pos1.size(), -1);
+#pragma omp parallel for schedule(static,64)
+		for (int i = 0; i < (int)pos1.size(); ++i) {check_coll_line(pos1[i], pos2[i], cindex[i], -1, 0, 0);} // return value is unused
+		active = !pos1.empty();
+	}
+	bool get_cindex(unsigned j, point const &p1, point const &p2, int &cix) const { // returns 1 if this query was batched
+		if (j >= batch_ix.size() || batch_ix[j] < 0) return 0;
+		unsigned const i(batch_ix[j]);
+		if (pos1[i] != p1 || pos2[i] != p2) return 0; // object was moved or its velocity changed
+
+		if (!changed.empty() && check_line_clip(p1, p2, changed_bcube.d)) {
+			for (cube_t const &c : changed) {
+				if (check_line_clip(p1, p2, c.d)) return 0; // a cobj along this line was modified; redo the query
+			}
+		}
+		cix = cindex[i];
+		return 1;
+	}
+};
+
+precip_coll_batch_t precip_coll_batch;
+
+void precip_coll_batch_cobj_changed(cube_t const &bcube) {precip_coll_batch.cobj_changed(bcube);}
+void invalidate_precip_coll_batch() {precip_coll_batch.clear();} // all results become invalid when the cobj trees are rebuilt
+
+
 void set_global_state() {
 
 	camera_view = 0;
@@ -310,6 +370,8 @@ void set_global_state() {
 
 void process_groups() {
 
+	static frame_prof_zone_t const prof_zone("Process Groups");
+	timer_t const timer(prof_zone); // frame profiler only
 	if (animate2) {advance_physics_objects();}
 
 	if (display_mode & 0x0200) {
@@ -389,6 +451,7 @@ void process_groups() {
 		if (reflective) {cp.metalness = dodgeball_metalness; cp.tscale = 0.0; cp.color = WHITE; cp.spec_color = WHITE; cp.shine = 100.0;} // reflective metal sphere
 		size_t const iter_count((large_radius || type == MAT_SPHERE || app_rate > 0) ? max_objs : objg.end_id); // optimization to use end_id when valid
 		bool defer_remove_cobj(0);
+		if (MORE_COLL_TSTEPS && precip && !large_radius) {precip_coll_batch.build(objg, iter_count, radius, time, grav_dz);} // before any object updates
 
 		for (size_t jj = 0; jj < iter_count; ++jj) {
 			unsigned const j(unsigned((type == SMILEY) ? (jj + scounter)%max_objs : jj)); // handle smiley permutation
@@ -484,7 +547,9 @@ void process_groups() {
 								pos2.z -= grav_dz; // maybe want to try with and without this?
 								// Note: we only do the line intersection test if the object moves by more than its radius this frame (static leaves don't)
 								// Note: could also test pos.z > v_collision_matrix[y][x].zmax
-								if (!dist_less_than(pos, pos2, radius)) {check_coll_line(pos, pos2, cindex, -1, 0, 0);} // return value is unused
+								if (!dist_less_than(pos, pos2, radius) && !(precip && precip_coll_batch.get_cindex(j, pos, pos2, cindex))) {
+									check_coll_line(pos, pos2, cindex, -1, 0, 0); // return value is unused
+								}
 							}
 							assert(spf > 0);
 
@@ -592,6 +657,7 @@ void process_groups() {
 			if (type == LANDMINE && obj.status == 1 && !(obj.flags & (STATIC_COBJ_COLL | PLATFORM_COLL))) {obj.time = 0;} // don't start time until it lands
 			if (defer_remove_cobj) {remove_reset_coll_obj(obj.coll_id); defer_remove_cobj = 0;}
 		} // for jj
+		if (precip) {precip_coll_batch.clear();}
 		objg.flags |= WAS_ADVANCED;
 		if (num_objs > 0 && (SHOW_PROC_TIME /*|| type == SMILEY*/)) {cout << "type = " << type << ", num = " << num_objs << " "; PRINT_TIME("Process");}
 	} // for i
@@ -740,6 +806,7 @@ void coll_obj::move_cobj(vector3d const &vd, bool update_colls) {
 
 	if (update_colls) {remove_coll_object(id, 0);}
 	shift_by(vd); // move object
+	precip_coll_batch_cobj_changed(*this); // old bounds were added on removal
 	if (update_colls) {re_add_coll_cobj(id, 0);}
 	if (update_colls && (is_rain_enabled() || is_wet() || is_reflective())) {check_indoors_outdoors();} // update indoor/outdoor state if it's raining, reflective, or if already wet
 }
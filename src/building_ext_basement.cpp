@@ -87,13 +87,13 @@ struct ext_basement_room_params_t {
 bool building_t::is_basement_room_under_mesh_not_int_bldg(cube_t &room, building_t const *exclude) const {
 	float const ceiling_zval(room.z2() - get_fc_thickness());
 	if (query_min_height(room, ceiling_zval) < ceiling_zval)  return 0; // check for terrain clipping through ceiling
-	// check for other buildings, including their extended basements;
-	// Warning: not thread safe, since we can be adding basements to another building at the same time
-	if (check_buildings_cube_coll(room, 0, 1, this, exclude)) return 0; // xy_only=0, inc_basement=1, exclude ourself
 	cube_t const grid_bcube(get_grid_bcube_for_building(*this));
 	assert(!grid_bcube.is_all_zeros()); // must be found
 	assert(grid_bcube.contains_cube_xy(bcube)); // must contain our building
 	if (!grid_bcube.contains_cube_xy(room)) return 0; // outside the grid (tile or city) bcube
+	// check for other buildings, including their extended basements; must be after the grid bcube check,
+	// since the parallel generation waves in building_creator_t assume we only query buildings in and adjacent to our grid
+	if (check_buildings_cube_coll(room, 0, 1, this, exclude)) return 0; // xy_only=0, inc_basement=1, exclude ourself
 	if (cube_int_underground_obj    (room)) return 0; // check tunnels, in-ground pools, etc.
 	return 1;
 }
@@ -18,7 +18,7 @@ float const ATTIC_LIGHT_RADIUS_SCALE = 2.0; // larger radius in attic, since spa
 
 vector<point> enabled_bldg_lights;
 
-extern bool camera_in_building, player_in_walkway, some_person_has_idle_animation;
+extern bool camera_in_building, player_in_walkway, some_person_has_idle_animation, compact_building_indir_lmap;
 extern int MESH_Z_SIZE, display_mode, display_framerate, camera_surf_collide, animate2, frame_counter, building_action_key, player_in_basement, player_in_elevator, player_in_attic;
 extern unsigned LOCAL_RAYS, MAX_RAY_BOUNCES, NUM_THREADS;
 extern float indir_light_exp, fticks;
@@ -434,11 +434,15 @@ colorRGBA get_outdoor_light_color() {
 }
 
 unsigned const IS_WINDOW_BIT = (1<<24); // if this bit is set, the light is from a window; if not, it's from a light room object
+// each compact()/expand() quantizes the whole volume to bfloat16, and later negative lights subtract from the quantized totals,
+// so only compact after the light set has been unchanged for this long rather than after every light
+float const LMAP_COMPACT_DELAY = 10.0*TICKS_PER_SECOND;
 
 class building_indir_light_mgr_t {
 	bool is_running, kill_thread, lighting_updated, needs_to_join, need_bvh_rebuild, update_windows, is_negative_light, in_ext_basement;
 	int cur_bix, cur_light, cur_floor;
 	unsigned cur_tid;
+	float idle_time=0.0; // ticks since the last light was added or removed, used to delay compaction
 	colorRGBA outdoor_color;
 	cube_t valid_area, light_bounds;
 	vector<unsigned char> tex_data;
@@ -449,6 +453,7 @@ class building_indir_light_mgr_t {
 	vect_cube_with_ix_t windows;
 	cube_bvh_t bvh;
 	lmap_manager_t lmgr;
+	vector<lmap_accum_t> lmap_accums; // one per ray tracing thread
 	std::thread rt_thread;
 
 	void init_lmgr(bool clear_lighting) {
@@ -460,6 +465,7 @@ class building_indir_light_mgr_t {
 	}
 	void start_lighting_compute(building_t const &b) {
 		assert(cur_light >= 0);
+		lmgr.expand(); // in case it was compacted; the light set was stable for LMAP_COMPACT_DELAY, so this should be rare
 		init_lmgr(0); // clear_lighting=0
 		is_running = 1;
 		lighting_updated = 1;
@@ -564,12 +570,18 @@ class building_indir_light_mgr_t {
 		building_colors_t bcolors;
 		b.set_building_colors(bcolors);
 		
+		lmap_accums.resize(num_rt_threads);
+		// each thread accumulates into its own lmap_accum_t, which are reduced into lmgr at the end, so the result is deterministic
+#pragma omp parallel num_threads(num_rt_threads)
+		{
+		lmap_accum_t &lmap_accum(lmap_accums[omp_get_thread_num_3dw()]);
+		lmap_accum.begin(&lmgr);
 		// Note: dynamic scheduling is faster, and using blocks doesn't help
-#pragma omp parallel for schedule(dynamic) num_threads(num_rt_threads)
+#pragma omp for schedule(dynamic)
 		for (int n = 0; n < num_rays; ++n) {
 			if (kill_thread) continue;
 			rand_gen_t rgen;
-			rgen.set_state(n+1, cur_light); // should be deterministic, though add_path_to_lmcs() is not (due to thread races)
+			rgen.set_state(n+1, cur_light); // deterministic
 			vector3d pri_dir;
 			colorRGBA ray_lcolor(lcolor), ccolor(WHITE);
 			bool const is_skylight_dir(is_skylight && (n&1)); // alternate between sky ambient and sun/moon directional
@@ -629,6 +641,10 @@ class building_indir_light_mgr_t {
 				} // for bounce
 			} // for splits
 		} // for n
+		lmap_accum.end();
+		} // end omp parallel
+		for (unsigned i = 1; i < lmap_accums.size(); ++i) {lmap_accums[0].merge(lmap_accums[i]); lmap_accums[i].clear();}
+		lmap_accums[0].apply_and_clear();
 		is_running = 0; // flag as done
 	}
 	void wait_for_finish(bool force_kill) {
@@ -685,6 +701,7 @@ public:
 	void invalidate_lighting() {
 		is_negative_light = in_ext_basement = 0;
 		cur_light = -1;
+		idle_time = 0.0;
 		remove_queue.clear();
 		lights_complete.clear();
 		lights_seen.clear();
@@ -777,7 +794,14 @@ public:
 				if (cur_light < 0 && lights_complete.find(*i) == lights_complete.end()) {cur_light = *i;} // find an incomplete light
 			}
 		}
-		if (cur_light >= 0) {start_lighting_compute(b);} // this light is next
+		if (cur_light >= 0) { // this light is next
+			idle_time = 0.0;
+			start_lighting_compute(b);
+		}
+		else if (compact_building_indir_lmap && !lmgr.is_compact()) { // all lights are done; the texture can still be updated from the compact data
+			idle_time += fticks;
+			if (idle_time > LMAP_COMPACT_DELAY) {lmgr.compact();} // light set is stable
+		}
 		tid = cur_tid;
 	}
 	void register_light_state_change(unsigned light_ix, bool light_is_on, bool in_elevator, bool geom_changed) {
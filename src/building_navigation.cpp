@@ -7,7 +7,7 @@
 #include "city.h" // for person_t
 #include "profiler.h"
 #include "nav_grid.h"
-#include <queue>
+#include "a_star.h"
 
 
 float const COLL_RADIUS_SCALE = 0.75; // somewhat smaller than radius, but larger than PED_WIDTH_SCALE
@@ -167,21 +167,17 @@ bool cube_nav_grid::find_path(point const &p1, point const &p2, ai_path_t &path)
 		return 1;
 	}
 	if (path.empty()) {path.push_back(p1);} // will assert otherwise
-	vector<a_star_node_state_t> state(nodes.size()); // dense vector; unordered_map seems to be slower
-	vector<uint8_t> open(nodes.size(), 0), closed(nodes.size(), 0); // tentative/already evaluated nodes
-	std::priority_queue<pair<float, ix_pair_t> > open_queue;
-	a_star_node_state_t &start(state[start_ix]);
+	a_star_scope_t<a_star_node_state_t> search(nodes.size()); // pooled per-thread node state; node index order matches the old ix_pair_t order
+	a_star_node_state_t &start(search->get_state(start_ix));
 	start.g_score  = 0.0;
 	start.f_score  = get_distance(nx1, ny1, nx2, ny2); // estimated total cost from start to end
-	open[start_ix] = 1;
-	open_queue.push(make_pair(-start.f_score, ix_pair_t(nx1, ny1)));
+	search->set_open(start_ix);
+	search->push(start.f_score, start_ix);
 
-	while (!open_queue.empty()) {
-		ix_pair_t const cur(open_queue.top().second);
-		unsigned const cur_ix(get_node_ix(cur.x, cur.y));
-		open_queue.pop();
-		closed[cur_ix] = 1;
-		open  [cur_ix] = 0;
+	while (!search->queue_empty()) {
+		unsigned const cur_ix(search->pop());
+		ix_pair_t const cur((cur_ix % num[0]), (cur_ix / num[0]));
+		search->set_closed(cur_ix);
 
 		for (int dy = -1; dy <= 1; ++dy) { // check 3x3 grid except center
 			for (int dx = -1; dx <= 1; ++dx) {
@@ -189,11 +185,11 @@ bool cube_nav_grid::find_path(point const &p1, point const &p2, ai_path_t &path)
 				unsigned const new_x(cur.x + dx), new_y(cur.y + dy); // may wrap around to 2^32
 				if (!are_ixs_valid(new_x, new_y)) continue; // off the grid
 				unsigned const new_ix(get_node_ix(new_x, new_y));
-				if (          closed[new_ix] ) continue; // already closed (duplicate)
+				if (search->is_closed(new_ix)) continue; // already closed (duplicate)
 				if (is_blocked(nodes[new_ix])) continue; // blocked
-				a_star_node_state_t &sn(state[new_ix]);
-				float const new_g_score(state[cur_ix].g_score + get_distance(cur.x, cur.y, new_x, new_y));
-				if (!open[new_ix]) {open[new_ix] = 1;}
+				a_star_node_state_t &sn(search->get_state(new_ix));
+				float const new_g_score(search->get_state(cur_ix).g_score + get_distance(cur.x, cur.y, new_x, new_y));
+				if (!search->is_open(new_ix)) {search->set_open(new_ix);}
 				else if (new_g_score >= sn.g_score) continue; // not better
 				sn.set(cur.x, cur.y, new_x, new_y);
 
@@ -205,8 +201,7 @@ bool cube_nav_grid::find_path(point const &p1, point const &p2, ai_path_t &path)
 					int prev_dx(0), prev_dy(0); // starts at an invalid value so that the first point is always added
 
 					while (path_ix != start_ix) {
-						assert(path_ix < state.size());
-						a_star_node_state_t &sp(state[path_ix]);
+						a_star_node_state_t const &sp(search->get_state(path_ix));
 						int const xn(sp.came_from[0]), yn(sp.came_from[1]);
 						assert(xn >= 0 && yn >= 0);
 						assert(xn != (int)prev_x || yn != (int)prev_y); // must have a delta
@@ -236,7 +231,7 @@ bool cube_nav_grid::find_path(point const &p1, point const &p2, ai_path_t &path)
 				}
 				sn.g_score = new_g_score;
 				sn.f_score = sn.g_score + get_distance(new_x, new_y, nx2, ny2);
-				open_queue.push(make_pair(-sn.f_score, ix_pair_t(new_x, new_y)));
+				search->push(sn.f_score, new_ix);
 			} // for dx
 		} // for dy
 	} // end while()
@@ -687,7 +682,7 @@ public:
 		}
 		return walk_area;
 	}
-	bool reconstruct_path(vector<a_star_node_state_t> const &state, vect_cube_t const &avoid, building_t const &building, point const &cur_pt,
+	bool reconstruct_path(a_star_search_t<a_star_node_state_t> const &state, vect_cube_t const &avoid, building_t const &building, point const &cur_pt,
 		float radius, unsigned start_ix, unsigned end_ix, unsigned ped_ix, bool is_first_path, bool up_or_down, unsigned ped_rseed,
 		point const *const custom_dest, ai_path_t &path) const
 	{
@@ -698,8 +693,8 @@ public:
 
 		while (1) {
 			node_t const &node(get_node(n));
-			point const &next(state[n].path_pt);
-			int const came_from(state[n].came_from_ix);
+			point const &next(state.get_state(n).path_pt);
+			int const came_from(state.get_state(n).came_from_ix);
 			bool const is_first_pt(path.empty());
 			cube_t const walk_area(calc_walkable_room_area(node, radius));
 			
@@ -826,56 +821,53 @@ public:
 		assert(room1 < nodes.size() && room2 < nodes.size());
 		assert(room1 != room2);
 		path.clear();
-		vector<a_star_node_state_t> state(nodes.size());
-		vector<uint8_t> open(nodes.size(), 0), closed(nodes.size(), 0); // tentative/already evaluated nodes
-		std::priority_queue<pair<float, unsigned> > open_queue;
+		a_star_scope_t<a_star_node_state_t> search(nodes.size()); // pooled per-thread node state
 		point dest_pos;
 		if (custom_dest) {dest_pos = *custom_dest;}
 		else {dest_pos = get_node(room2).get_center(cur_pt.z);} // Note: approximate, actual dest may be different
-		a_star_node_state_t &start(state[room1]);
+		a_star_node_state_t &start(search->get_state(room1));
 		start.g_score = 0.0;
 		start.f_score = p2p_dist_xy(cur_pt, dest_pos); // estimated total cost from start to goal through current
 		start.path_pt = cur_pt;
-		open[room1]   = 1;
-		open_queue.push(make_pair(-start.f_score, room1));
+		search->set_open(room1);
+		search->push(start.f_score, room1);
 
-		while (!open_queue.empty()) {
-			unsigned const cur(open_queue.top().second);
-			open_queue.pop();
+		while (!search->queue_empty()) {
+			unsigned const cur(search->pop());
 			node_t const &cur_node(get_node(cur));
-			closed[cur] = 1;
-			open  [cur] = 0;
+			search->set_closed(cur);
 
 			for (auto i = cur_node.conn_rooms.begin(); i != cur_node.conn_rooms.end(); ++i) {
 				assert(i->ix < nodes.size());
-				if (closed[i->ix]) continue; // already closed (duplicate)
+				if (search->is_closed(i->ix)) continue; // already closed (duplicate)
 				bool const is_goal(i->ix == room2);
 				node_t const &conn_node(get_node(i->ix));
 				if (conn_node.is_vert_conn() && !use_stairs && !is_goal) continue; // skip stairs/ramp in this mode
 				if (!can_use_conn(*i, doors, cur_pt.z, has_key))         continue; // blocked by closed or locked door; must do this check before setting open state
 				point const node_pt((cur == room1) ? cur_pt   : cur_node .get_center(cur_pt.z));
 				point const next_pt(is_goal        ? dest_pos : conn_node.get_center(cur_pt.z));
-				a_star_node_state_t &sn(state[i->ix]);
+				a_star_node_state_t &sn(search->get_state(i->ix));
+				a_star_node_state_t const &sc(search->get_state(cur));
 				vector2d const &pt(i->pt[up_or_down]); // point in doorway, etc.
-				float const dist_through_cur(state[cur].g_score + p2p_dist_xy(node_pt, pt) + p2p_dist_xy(pt, next_pt));
+				float const dist_through_cur(sc.g_score + p2p_dist_xy(node_pt, pt) + p2p_dist_xy(pt, next_pt));
 				float new_g_score(dist_through_cur);
 				// in the case of long hallways, the shortest path may pass between doors/adjacencies rather than through the center of the room/node,
 				// so we take that into account here by calculating the straight line path between room entrance and exit without going through the center
-				point const &prev_edge_pt(state[cur].path_pt); // point in doorway, etc.
-				float const dist_without_last_seg(state[cur].g_score - p2p_dist_xy(node_pt, prev_edge_pt));
+				point const &prev_edge_pt(sc.path_pt); // point in doorway, etc.
+				float const dist_without_last_seg(sc.g_score - p2p_dist_xy(node_pt, prev_edge_pt));
 				float const dist_door_to_door(dist_without_last_seg + p2p_dist_xy(pt, prev_edge_pt));
 				min_eq(new_g_score, dist_door_to_door); // dist_door_to_door is always smaller?
-				if (!open[i->ix]) {open[i->ix] = 1;}
+				if (!search->is_open(i->ix)) {search->set_open(i->ix);}
 				else if (new_g_score >= sn.g_score) continue; // not better
 				sn.came_from_ix = cur;
 				sn.path_pt.assign(pt.x, pt.y, cur_pt.z);
 				
 				if (is_goal) { // done, reconstruct path (in reverse)
-					return reconstruct_path(state, avoid, building, cur_pt, radius, i->ix, room1, ped_ix, is_first_path, up_or_down, ped_rseed, custom_dest, path);
+					return reconstruct_path(*search, avoid, building, cur_pt, radius, i->ix, room1, ped_ix, is_first_path, up_or_down, ped_rseed, custom_dest, path);
 				}
 				sn.g_score = new_g_score;
 				sn.f_score = sn.g_score + p2p_dist_xy(next_pt, dest_pos);
-				open_queue.push(make_pair(-sn.f_score, i->ix));
+				search->push(sn.f_score, i->ix);
 			} // for i
 		} // end while()
 		return 0; // failed - no path from room1 to room2
@@ -8,6 +8,7 @@
 #include "subdiv.h" // for sd_sphere_d
 #include "profiler.h"
 #include "openal_wrap.h"
+#include <mutex>
 
 
 unsigned room_geom_mem(0);
@@ -380,12 +381,11 @@ void rgeom_mat_t::add_triangle_to_verts(point const v[3], colorRGBA const &color
 
 class rgeom_alloc_t {
 	deque<rgeom_storage_t> free_list; // one per unique texture ID/material
+	std::mutex mutex; // guards free_list; materials may be created on worker threads (small + text VBOs)
 public:
-	void alloc_safe(rgeom_storage_t &s) {
-#pragma omp critical(rgeom_alloc)
-		alloc(s);
-	}
+	void alloc_safe(rgeom_storage_t &s) {alloc(s);} // alloc() is always thread safe now
 	void alloc(rgeom_storage_t &s) { // attempt to use free_list entry to reuse existing capacity
+		std::lock_guard<std::mutex> lock(mutex);
 		if (free_list.empty()) return; // no pre-alloc
 		//cout << TXT(free_list.size()) << TXT(free_list.back().get_tot_vert_capacity()) << endl; // total mem usage is 913/1045
 
@@ -401,10 +401,12 @@ public:
 	void free(rgeom_storage_t &s) {
 		s.clear(); // in case the caller didn't clear it
 		if (s.get_mem_usage() == 0) return; // no memory allocated, no point in adding to the free list
+		std::lock_guard<std::mutex> lock(mutex);
 		free_list.push_back(rgeom_storage_t(s.tex)); // record tex of incoming element
 		s.swap_vectors(free_list.back()); // transfer existing capacity to free list; clear capacity from s
 	}
-	unsigned get_mem_usage() const {
+	unsigned get_mem_usage() { // Note: not const because it locks the mutex
+		std::lock_guard<std::mutex> lock(mutex);
 		unsigned mem(free_list.size()*sizeof(rgeom_storage_t));
 		for (auto i = free_list.begin(); i != free_list.end(); ++i) {
 			//cout << i->tex.tid << "\t" << i->tex.shadowed << "\t" << (i->quad_verts.capacity() + i->itri_verts.capacity()) << "\t" << i->get_mem_usage() << endl; // TESTING
@@ -412,9 +414,9 @@ public:
 		}
 		return mem;
 	}
-	unsigned size() const {return free_list.size();}
+	unsigned size() {std::lock_guard<std::mutex> lock(mutex); return free_list.size();}
 };
-rgeom_alloc_t rgeom_alloc; // static allocator with free list, shared across all buildings; not thread safe
+rgeom_alloc_t rgeom_alloc; // static allocator with free list, shared across all buildings; thread safe
 
 
 vbo_cache_t::vbo_cache_entry_t vbo_cache_t::alloc(unsigned size, bool is_index) {
@@ -921,6 +923,11 @@ void building_room_geom_t::create_static_vbos(building_t const &building) {
 	mats_exterior.create_vbos(building); // Note: ideally we want to include window dividers from trim_objs, but that may not have been created yet
 	//cout << "static: size: " << rgeom_alloc.size() << " mem: " << rgeom_alloc.get_mem_usage() << endl; // start=47MB, peak=132MB
 }
+void building_room_geom_t::create_static_vbos_if_needed(building_t const &building) { // same as draw(), but can be called before the building is drawn
+	if (mats_static.valid) return;
+	create_obj_model_insts(building);
+	create_static_vbos(building);
+}
 
 void building_room_geom_t::create_small_static_vbos(building_t const &building) {
 	//highres_timer_t timer("Gen Room Geom Small"); // 7.8ms, slow building at 26,16; up to 36ms on new computer for buildings with large retail areas
@@ -1459,20 +1466,30 @@ void building_t::gen_and_draw_room_geom(brg_batch_draw_t *bbd, shader_t &s, shad
 			return;
 		}
 	}
-	if (!has_room_geom()) {
-		interior->room_geom.reset(new building_room_geom_t(bcube.get_llc()));
-		// capture state before generating backrooms, which may add more doors
-		interior->room_geom->init_num_doors   = interior->doors      .size();
-		interior->room_geom->init_num_dstacks = interior->door_stacks.size();
-		rand_gen_t rgen;
-		rgen.set_state(building_ix, parts.size()); // set to something canonical per building
-		interior->room_geom->decal_manager.rgen = rgen; // copy rgen for use with decals
-		gen_room_details(rgen, building_ix); // generate so that we can draw it
-		assert(has_room_geom());
-	}
+	gen_room_geom_if_needed(building_ix);
 	if (has_room_geom() && (inc_small == 2 || inc_small == 3)) {add_wall_and_door_trim_if_needed();} // gen trim (exterior and interior) when close to the player
 	draw_room_geom(bbd, s, amask_shader, oc, xlate, building_ix, shadow_only, reflection_pass, inc_small, player_in_building);
 }
+bool building_t::gen_room_geom_if_needed(unsigned building_ix) { // returns 1 if generated
+	if (!interior || has_room_geom()) return 0;
+	interior->room_geom.reset(new building_room_geom_t(bcube.get_llc()));
+	// capture state before generating backrooms, which may add more doors
+	interior->room_geom->init_num_doors   = interior->doors      .size();
+	interior->room_geom->init_num_dstacks = interior->door_stacks.size();
+	rand_gen_t rgen;
+	rgen.set_state(building_ix, parts.size()); // set to something canonical per building
+	interior->room_geom->decal_manager.rgen = rgen; // copy rgen for use with decals
+	gen_room_details(rgen, building_ix); // generate so that we can draw it
+	assert(has_room_geom());
+	return 1;
+}
+// generates room objects and the static object VBOs ahead of the building being drawn; the result is the same as when generated by the draw call
+void building_t::prefetch_room_geom(unsigned building_ix) {
+	if (!global_building_params.enable_rotated_room_geom && is_rotated()) return; // not drawn
+	if (!gen_room_geom_if_needed(building_ix)) return; // no interior, or already generated
+	//highres_timer_t timer("Prefetch Room Geom");
+	interior->room_geom->create_static_vbos_if_needed(*this);
+}
 void building_t::clear_room_geom() {
 	if (!has_room_geom()) return;
 	if (interior->room_geom->modified_by_player) return; // keep the player's modifications and don't delete the room geom
@@ -1590,15 +1607,25 @@ float get_ao_shadow(room_object_t const &c, bool enable_indir) {
 	return 0.0; // no shadow
 }
 
+// used to limit per-frame geom gen time; doesn't apply to shadow pass, in case shadows are cached; shared by draw() and room geom prefetch
+int rgeom_gen_frame(0);
+unsigned num_rgeom_gen_this_frame(0);
+
+void check_rgeom_gen_frame() {
+	if (frame_counter < 100 || frame_counter > rgeom_gen_frame) {num_rgeom_gen_this_frame = 0; rgeom_gen_frame = frame_counter;} // unlimited for the first 100 frames
+}
+bool room_geom_gen_budget_avail() {
+	check_rgeom_gen_frame();
+	return (num_rgeom_gen_this_frame < max(global_building_params.max_room_geom_gen_per_frame, 1U));
+}
+void register_room_geom_gen(unsigned num) {check_rgeom_gen_frame(); num_rgeom_gen_this_frame += num;}
+
 // Note: non-const because it creates the VBO; inc_small: 0=large only, 1=large+small, 2=large+small+ext detail, 3=large+small+ext detail+int detail, 4=ext only
 void building_room_geom_t::draw(brg_batch_draw_t *bbd, shader_t &s, shader_t &amask_shader, building_t const &building, occlusion_checker_noncity_t &oc,
 	vector3d const &xlate, unsigned building_ix, bool shadow_only, bool reflection_pass, unsigned inc_small, bool player_in_building)
 {
 	if (empty()) return; // no geom
 	unsigned const num_screenshot_tids(get_num_screenshot_tids());
-	static int last_frame(0);
-	static unsigned num_geom_this_frame(0); // used to limit per-frame geom gen time; doesn't apply to shadow pass, in case shadows are cached
-	if (frame_counter < 100 || frame_counter > last_frame) {num_geom_this_frame = 0; last_frame = frame_counter;} // unlimited for the first 100 frames
 	point const camera_bs(camera_pdu.pos - xlate);
 	float const floor_spacing(building.get_window_vspace());
 	bool const draw_ext_only(inc_small == 4);
@@ -1633,11 +1660,11 @@ void building_room_geom_t::draw(brg_batch_draw_t *bbd, shader_t &s, shader_t &am
 	// generate vertex data in the shadow pass or if we haven't hit our generation limit; must be consistent for static and small geom
 	// Note that the distance cutoff for mats_static and mats_small is different, so we generally won't be creating them both
 	// unless the player just appeared by this building, or we need to update the geometry; in either case this is higher priority and we want to update both
-	if (shadow_only || num_geom_this_frame < max(global_building_params.max_room_geom_gen_per_frame, 1U)) {
+	if (shadow_only || room_geom_gen_budget_avail()) {
 		if (!mats_static.valid) { // create static materials if needed
 			create_obj_model_insts(building);
 			create_static_vbos(building);
-			if (!shadow_only) {++num_geom_this_frame;}
+			if (!shadow_only) {register_room_geom_gen();}
 		}
 		bool const create_small(inc_small && !mats_small.valid), create_text(draw_int_detail_objs && !mats_text.valid);
 		//highres_timer_t timer("Create Small + Text VBOs", (create_small || create_text));
@@ -1661,13 +1688,13 @@ void building_room_geom_t::draw(brg_batch_draw_t *bbd, shader_t &s, shader_t &am
 			mats_amask.create_vbos(building);
 		}
 		if (create_text) {mats_text.create_vbos(building);}
-		if (!shadow_only) {num_geom_this_frame += (unsigned(create_small) + unsigned(create_text));}
+		if (!shadow_only) {register_room_geom_gen(unsigned(create_small) + unsigned(create_text));}
 
 		// Note: not created on the shadow pass unless trim_objs has been created so that we don't miss including it;
 		// the trim_objs test is needed to handle parking garage and attic objects, which are also drawn as details
 		if (draw_detail_objs && (!shadow_only || !trim_objs.empty()) && !mats_detail.valid) { // create detail materials if needed (mats_detail and mats_ext_detail)
 			create_detail_vbos(building);
-			if (!shadow_only) {++num_geom_this_frame;}
+			if (!shadow_only) {register_room_geom_gen();}
 		}
 	}
 	if (draw_lights && !mats_lights .valid) {create_lights_vbos (building);} // create lights  materials if needed (no limit)
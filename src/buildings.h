@@ -308,7 +308,7 @@ struct building_params_t {
 	bool gen_building_interiors=1, add_city_interiors=0, enable_rotated_room_geom=0, add_secondary_buildings=0, add_office_basements=0, add_office_br_basements=0;
 	bool put_doors_in_corners=0, cities_all_bldg_mats=0, small_city_buildings=0;
 	unsigned num_place=0, num_tries=10, cur_prob=1, max_shadow_maps=32, buildings_rand_seed=0, max_ext_basement_hall_branches=4, max_ext_basement_room_depth=4;
-	unsigned max_room_geom_gen_per_frame=1;
+	unsigned max_room_geom_gen_per_frame=1, room_geom_prefetch_frames=0; // 0 disables room geom prefetch
 	float ao_factor=0.0, sec_extra_spacing=0.0, player_coll_radius_scale=1.0, interior_view_dist_scale=1.0;
 	float window_width=0.0, window_height=0.0, window_xspace=0.0, window_yspace=0.0; // windows
 	float wall_split_thresh=4.0, max_fp_wind_xscale=0.0, max_fp_wind_yscale=0.0, basement_water_level_min=0.0, basement_water_level_max=0.0; // interiors
@@ -1174,6 +1174,7 @@ struct building_room_geom_t {
 		point const &camera_bs, bool shadow_only, bool reflection_pass, bool check_clip_cube) const;
 	unsigned allocate_dynamic_state();
 	room_obj_dstate_t &get_dstate(room_object_t const &obj);
+	void create_static_vbos_if_needed(building_t const &building);
 private:
 	building_materials_t &get_building_mat(tid_nm_pair_t const &tex, bool dynamic, unsigned small, bool transparent, bool exterior);
 	void create_static_vbos(building_t const &building);
@@ -1876,6 +1877,8 @@ struct building_t : public building_geom_t {
 		unsigned building_ix, bool shadow_only, bool reflection_pass, unsigned inc_small, bool player_in_building);
 	void gen_and_draw_room_geom(brg_batch_draw_t *bbd, shader_t &s, shader_t &amask_shader, occlusion_checker_noncity_t &oc, vector3d const &xlate,
 		unsigned building_ix, bool shadow_only, bool reflection_pass, unsigned inc_small, bool player_in_building, bool ext_basement_conn_visible);
+	bool gen_room_geom_if_needed(unsigned building_ix);
+	void prefetch_room_geom(unsigned building_ix);
 	bool has_cars_to_draw(bool player_in_building) const;
 	void draw_cars_in_building(shader_t &s, vector3d const &xlate, bool player_in_building, bool shadow_only) const;
 	bool check_for_water_splash(point const &pos_bs, float size=1.0, bool full_room_height=0, bool draw_splash=0, bool alert_zombies=1) const;
@@ -2517,6 +2520,8 @@ bool player_take_damage(float damage_scale, int poison_type=0, uint8_t *has_key=
 float get_bldg_player_height();
 cube_t get_stairs_bcube_expanded(stairwell_t const &s, float ends_clearance, float sides_clearance, float doorway_width);
 float get_door_open_dist();
+bool room_geom_gen_budget_avail();
+void register_room_geom_gen(unsigned num=1);
 // functions in building_room_obj_expand.cc
 point gen_xy_pos_in_area(cube_t const &S, vector3d const &sz, rand_gen_t &rgen, float zval=0.0);
 point gen_xy_pos_in_area(cube_t const &S, float radius, rand_gen_t &rgen, float zval=0.0);
@@ -7,7 +7,9 @@
 #include "explosion.h" // for add_blastr()
 #include "lightmap.h" // for light_source
 #include "profiler.h"
+#include "worker_pool.h"
 #include <cfloat> // for FLT_MAX
+#include <atomic>
 
 bool const DYNAMIC_HELICOPTERS = 1;
 bool const POLICE_LIGHT_SHADOW = 1;
@@ -15,6 +17,7 @@ float const MIN_CAR_STOP_SEP   = 0.25; // in units of car lengths
 
 extern bool tt_fire_button_down, enable_hcopter_shadows, city_action_key, camera_in_building, player_in_walkway;
 extern int display_mode, game_mode, map_mode, animate2, player_in_basement, player_in_closet, player_in_attic, camera_surf_collide;
+extern unsigned NUM_THREADS;
 extern float fticks, FAR_CLIP;
 extern point pre_smap_player_pos;
 extern vector<light_source> dl_sources;
@@ -1223,6 +1226,9 @@ bool car_manager_t::check_car_for_ped_colls(car_t &car) const {
 	return 0;
 }
 
+car_manager_t::car_manager_t(city_road_gen_t const &road_gen_) : road_gen(road_gen_), dstate(car_model_loader, helicopter_model_loader) {}
+car_manager_t::~car_manager_t() {}
+
 void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed) {
 	if (!animate2) return;
 	helicopters_next_frame(car_speed);
@@ -1234,14 +1240,15 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 #pragma omp critical(modify_car_data)
 	{
 		if (car_destroyed) {remove_destroyed_cars();} // at least one car was destroyed in the previous frame - remove it/them
-		sort(cars.begin(), cars.end(), sort_func); // sort by city/road/position for intersection tests and tile shadow map binds
+		// sort by city/road/position for intersection tests and tile shadow map binds; cars rarely change order, so this is usually an insertion sort
+		adaptive_sort(cars, sort_func);
 	}
 	entering_city.clear();
 	car_blocks.clear();
 	float const speed(CAR_SPEED_SCALE*car_speed*get_clamped_fticks());
 	bool saw_parked(0);
 
-	for (auto i = cars.begin(); i != cars.end(); ++i) { // move cars
+	for (auto i = cars.begin(); i != cars.end(); ++i) { // build car blocks
 		unsigned const cix(i - cars.begin());
 		i->car_in_front = nullptr; // reset for this frame
 
@@ -1250,18 +1257,37 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 			saw_parked = 0; // reset for next city
 			car_blocks.emplace_back(cix, i->cur_city);
 		}
-		if (i->is_parked()) {
-			if (!saw_parked) {car_blocks.back().first_parked = cix; saw_parked = 1;}
-			i->maybe_wake(rgen);
-			continue; // no update for parked cars
+		if (i->is_parked() && !saw_parked) {car_blocks.back().first_parked = cix; saw_parked = 1;}
+	}
+	if (!saw_parked && !car_blocks.empty()) {car_blocks.back().first_parked = cars.size();} // no parked cars in final city
+	// move cars in parallel by city; car_t::move() only modifies the car itself, so the result doesn't depend on the number of threads;
+	// this runs inside a parallel region in display_world.cpp, where a nested omp parallel for would be inactive, so use worker threads instead
+	unsigned const num_blocks(car_blocks.size()), num_threads(min(num_blocks, max(1U, NUM_THREADS-min(NUM_THREADS, 2U)))); // leave threads for drawing and peds
+	std::atomic<unsigned> next_block(0);
+
+	auto move_cars = [&]() {
+		for (unsigned b = next_block++; b < num_blocks; b = next_block++) {
+			unsigned const end((b+1 < num_blocks) ? car_blocks[b+1].start : cars.size());
+
+			for (unsigned c = car_blocks[b].start; c < end; ++c) {
+				if (!cars[c].is_parked()) {cars[c].move(speed);}
+			}
 		}
-		i->move(speed);
+	};
+	if (num_threads > 1 && cars.size() > 1000) { // only use threads when there's enough work
+		if (!move_pool) {move_pool.reset(new worker_pool_t);}
+		move_pool->run(num_threads, move_cars);
+	}
+	else {move_cars();}
+
+	for (auto i = cars.begin(); i != cars.end(); ++i) { // serial per-car updates with side effects, in car order
+		unsigned const cix(i - cars.begin());
+		if (i->is_parked()) {i->maybe_wake(rgen); continue;} // no update for parked cars
 		if (i->entering_city) {entering_city.push_back(cix);} // record for use in collision detection
 		if (!i->stopped_at_light && i->is_almost_stopped() && i->in_isect()) {get_car_isec(*i).stoplight.mark_blocked(i->dim, i->dir);} // blocking intersection
 		register_car_at_city(*i);
 		if (is_active_emergency_vehicle(car_model_loader, *i, 0, 1)) {play_car_sound_if_close(i->get_center(), SOUND_POLICE);} // lights=0, siren=1
 	} // for i
-	if (!saw_parked && !car_blocks.empty()) {car_blocks.back().first_parked = cars.size();} // no parked cars in final city
 	car_blocks.emplace_back(cars.size(), 0); // add terminator
 
 	for (auto i = cars.begin(); i != cars.end(); ++i) { // collision detection
@@ -1292,7 +1318,7 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 
 	if (map_mode) { // create cars_by_road
 		// cars have moved since the last sort and may no longer be in city/road order, so we need to re-sort them
-		sort(cars.begin(), cars.end(), sort_func);
+		adaptive_sort(cars, sort_func);
 		car_blocks_by_road.clear();
 		cars_by_road.clear();
 		unsigned cur_city(1<<31), cur_road(1<<31); // start at invalid values
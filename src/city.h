@@ -744,6 +744,8 @@ struct ped_city_vect_t {
 	void clear();
 };
 
+class worker_pool_t;
+
 class car_manager_t { // and trucks and helicopters
 
 	car_model_loader_t car_model_loader;
@@ -769,6 +771,7 @@ class car_manager_t { // and trucks and helicopters
 	car_draw_state_t dstate;
 	rand_gen_t rgen;
 	vector<unsigned> entering_city;
+	unique_ptr<worker_pool_t> move_pool; // for moving cars in parallel by city
 	unsigned first_parked_car=0;
 	bool car_destroyed=0;
 
@@ -788,7 +791,8 @@ class car_manager_t { // and trucks and helicopters
 	void draw_helicopters(bool shadow_only);
 public:
 	friend class city_spectate_manager_t;
-	car_manager_t(city_road_gen_t const &road_gen_) : road_gen(road_gen_), dstate(car_model_loader, helicopter_model_loader) {}
+	car_manager_t(city_road_gen_t const &road_gen_);
+	~car_manager_t(); // required for worker_pool_t
 	bool empty() const {return cars.empty();}
 	void clear() {cars.clear(); car_blocks.clear();}
 	bool has_car_models() const {return !car_model_loader.empty();}
@@ -863,6 +867,14 @@ class ped_manager_t { // pedestrians
 		city_ixs_t() : ped_ix(0), plot_ix(0) {}
 		void assign(unsigned ped_ix_, unsigned plot_ix_) {ped_ix = ped_ix_; plot_ix = plot_ix_;}
 	};
+	// per-city state for the parallel ped update; writes to shared state are buffered here and applied serially in city order
+	struct city_update_t {
+		rand_gen_t rgen;
+		path_finder_t path_finder;
+		ai_path_t grid_path;
+		vector<pair<point, uint8_t>> crosswalks_in_use; // {pos, 2*dim+dir}
+		bool new_plot=0; // at least one ped moved to a new plot
+	};
 	city_road_gen_t const &road_gen;
 	car_manager_t const &car_manager; // used for ped road crossing safety and dest car selection
 	ped_model_loader_t ped_model_loader;
@@ -870,6 +882,8 @@ class ped_manager_t { // pedestrians
 	vector<city_ixs_t> by_city; // first ped/plot index for each city
 	vector<unsigned> by_plot;
 	vector<unsigned char> need_to_sort_city;
+	vector<city_update_t> city_updates;
+	static thread_local city_update_t *cur_city_update; // set while updating a city
 	car_city_vect_t empty_cars_vect;
 	vector<car_city_vect_t> cars_by_city;
 	vector<point> bldg_ppl_pos;
@@ -877,6 +891,7 @@ class ped_manager_t { // pedestrians
 	rand_gen_t rgen;
 	ao_draw_state_t dstate;
 	unique_ptr<city_cube_nav_grid_manager> nav_grid_mgr;
+	unique_ptr<worker_pool_t> update_pool; // for the parallel per-city ped update
 	int selected_ped_ssn=-1;
 	unsigned animation_id=ANIM_ID_WALK, tot_num_plots=0;
 	bool ped_destroyed=0, need_to_sort_peds=0, prev_choose_zombie=0;
@@ -887,6 +902,8 @@ class ped_manager_t { // pedestrians
 	void expand_cube_for_ped(cube_t &cube) const;
 	void remove_destroyed_peds();
 	void sort_by_city_and_plot();
+	void update_peds_in_city(unsigned city, float delta_dir);
+	void apply_city_updates();
 	road_isec_t const &get_car_isec(car_base_t const &car) const;
 	int get_road_ix_for_ped_crossing(pedestrian_t const &ped, bool road_dim) const;
 	void setup_occluders();
@@ -895,9 +912,12 @@ class ped_manager_t { // pedestrians
 	car_city_vect_t const &get_cars_for_city(unsigned city) const {return ((city < cars_by_city.size()) ? cars_by_city[city] : empty_cars_vect);}
 public:
 	friend class city_spectate_manager_t;
-	// for use in pedestrian_t, mostly for collisions and path finding
+	// for use in pedestrian_t, mostly for collisions and path finding; these return per-city state during the parallel ped update
 	path_finder_t path_finder;
 	ai_path_t grid_path;
+	path_finder_t &get_path_finder() {return (cur_city_update ? cur_city_update->path_finder : path_finder);}
+	ai_path_t     &get_grid_path  () {return (cur_city_update ? cur_city_update->grid_path   : grid_path  );}
+	rand_gen_t    &get_rgen       () {return (cur_city_update ? cur_city_update->rgen        : rgen       );}
 
 	ped_manager_t(city_road_gen_t const &road_gen_, car_manager_t const &car_manager_);
 	ped_manager_t (ped_manager_t const &) = delete; // forbidden
@@ -2914,8 +2914,21 @@ bool ped_manager_t::gen_ped_pos(pedestrian_t &ped) {return road_gen.gen_ped_pos(
 
 bool ped_manager_t::mark_crosswalk_in_use(pedestrian_t const &ped) {
 	bool const dim(fabs(ped.dir.y) > fabs(ped.dir.x)), dir(ped.dir[dim] > 0); // something like this?
+	if (cur_city_update) {cur_city_update->crosswalks_in_use.emplace_back(ped.pos, (2*dim + dir)); return 1;} // applied later in apply_city_updates()
 	return road_gen.get_city(ped.city).mark_crosswalk_in_use(ped.pos, dim, dir);
 }
+void ped_manager_t::apply_city_updates() { // serial, in city order
+	for (unsigned city = 0; city < city_updates.size(); ++city) {
+		city_update_t &cu(city_updates[city]);
+
+		for (auto const &cw : cu.crosswalks_in_use) {road_gen.get_city(city).mark_crosswalk_in_use(cw.first, (cw.second >> 1), (cw.second & 1));}
+		cu.crosswalks_in_use.clear();
+		if (!cu.new_plot) continue;
+		if (!need_to_sort_city.empty()) {need_to_sort_city[city] = 1;}
+		need_to_sort_peds = 1;
+		cu.new_plot = 0;
+	}
+}
 bool ped_manager_t::check_isec_sphere_coll(pedestrian_t const &ped, cube_t &coll_cube) const {
 	return road_gen.get_city(ped.city).check_isec_sphere_coll(ped.pos, 0.6*ped.radius, coll_cube); // Note: no xlate is required since peds and city are in the same coord space
 }
@@ -2934,6 +2947,7 @@ void ped_manager_t::setup_occluders() {
 bool ped_manager_t::choose_dest_building_or_parked_car(pedestrian_t &ped) { // modifies rgen, non-const
 	unsigned const prev_dest_plot(ped.dest_plot);
 	ped.clear_current_dest(); // will choose a new dest
+	rand_gen_t &rgen(get_rgen());
 
 	if (city_params.num_cars == 0 || (rgen.rand() & 3) != 0) { // choose a dest building 75% of the time, 100% of the time if there are no cars
 		ped.has_dest_bldg = road_gen.choose_dest_building(ped.city, ped.dest_plot, ped.dest_bldg, rgen);
@@ -2951,7 +2965,7 @@ void ped_manager_t::choose_new_ped_plot_pos(pedestrian_t &ped) {
 	if (city_params.ped_respawn_at_dest) { // respawn
 		for (unsigned n = 0; n < 100; ++n) { // keep respawning until it's not visible by the camera
 			float const prev_zval(ped.pos.z);
-			bool const ret(road_gen.get_city(ped.city).gen_ped_pos(ped, rgen));
+			bool const ret(road_gen.get_city(ped.city).gen_ped_pos(ped, get_rgen()));
 			ped.pos.z = prev_zval; // restore orig zval - don't want to change this (zval was set from ped radius post-model scale but should be pre-model scale)
 			if (!ret) break; // failed to respawn, leave at current pos (should be very rare)
 			float const draw_dist(500.0*get_ped_radius());
@@ -3175,10 +3189,14 @@ public:
 		if (!city_params.enabled()) return;
 
 		if (!use_threads_2_3 || omp_get_thread_num_3dw() == 1) { // thread 1
+			FRAME_PROF_ZONE("City Roads and Cars Update");
 			road_gen.next_frame(); // update stoplights; must be before car_manager next_frame() call
 			car_manager.next_frame(ped_manager, city_params.car_speed);
 		}
-		if (!use_threads_2_3 || omp_get_thread_num_3dw() == 2) {ped_manager.next_frame();} // thread=2
+		if (!use_threads_2_3 || omp_get_thread_num_3dw() == 2) { // thread=2
+			FRAME_PROF_ZONE("City Pedestrians Update");
+			ped_manager.next_frame();
+		}
 	}
 	void draw(int shadow_only, int reflection_pass, int trans_op_mask, vector3d const &xlate) { // shadow_only: 0=non-shadow pass, 1=sun/moon shadow, 2=dynamic shadow
 		if (player_in_basement >= 2)            return; // player is fully in the basement, not on stairs - don't draw anything
@@ -4,6 +4,11 @@
 
 #include "3DWorld.h"
 #include "cobj_bsp_tree.h"
+#include <atomic>
+#include <cfloat> // for FLT_MAX
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h> // for ray packet slab tests
+#endif
 
 
 unsigned const MAX_LEAF_SIZE = 2;
@@ -12,6 +17,7 @@ float const OVERLAP_AMT      = 0.02;
 
 
 extern bool mt_cobj_tree_build, begin_motion;
+extern unsigned cobj_tree_build_quality;
 extern int display_mode, frame_counter, cobj_counter;
 extern coll_obj_group coll_objects;
 extern vector<unsigned> falling_cobjs;
@@ -123,6 +129,69 @@ bool cobj_tree_base::node_ix_mgr::check_node(unsigned &nix) const {
 }
 
 
+// struct-of-arrays ray packet used by check_coll_line_packet(); each lane holds the same p1/dinv state as a scalar node_ix_mgr
+struct ray_packet_t {
+	alignas(32) float org[3][RAY_PACKET_SIZE], dinv[3][RAY_PACKET_SIZE];
+	alignas(32) int neg[3][RAY_PACKET_SIZE]; // all bits set if dinv was negative in this dim; selects the near/far slab like get_line_clip<xneg,yneg,zneg>
+
+	void set_ray(unsigned r, point const &p1, point const &p2) {
+		vector3d dv(p2 - p1);
+		dv.invert();
+		UNROLL_3X(org[i_][r] = p1[i_]; neg[i_][r] = ((dv[i_] < 0.0) ? -1 : 0);)
+		set_dinv(r, dv);
+	}
+	void set_dinv(unsigned r, vector3d const &dv) {UNROLL_3X(dinv[i_][r] = dv[i_];)} // dv must already be inverted
+	void clear_ray(unsigned r) {UNROLL_3X(org[i_][r] = dinv[i_][r] = 0.0; neg[i_][r] = 0;)} // unused lane; never active
+
+	// performance critical; returns a bitmask of lanes whose line intersects d, bit-exact with get_line_clip() (including NaN and -0.0 handling)
+	unsigned get_clip_mask(float const d[3][2]) const {
+#if defined(__AVX__)
+		__m256 tmin(_mm256_setzero_ps()), tmax(_mm256_set1_ps(1.0f));
+
+		for (unsigned i = 0; i < 3; ++i) {
+			__m256 const lo(_mm256_set1_ps(d[i][0])), hi(_mm256_set1_ps(d[i][1])), org_v(_mm256_load_ps(org[i])), dinv_v(_mm256_load_ps(dinv[i]));
+			__m256 const neg_v(_mm256_castsi256_ps(_mm256_load_si256((__m256i const *)neg[i])));
+			__m256 const t1(_mm256_mul_ps(_mm256_sub_ps(_mm256_blendv_ps(lo, hi, neg_v), org_v), dinv_v)); // near slab
+			__m256 const t2(_mm256_mul_ps(_mm256_sub_ps(_mm256_blendv_ps(hi, lo, neg_v), org_v), dinv_v)); // far slab
+			tmax = _mm256_min_ps(t2, tmax); // same as (t2 < tmax) ? t2 : tmax
+			tmin = _mm256_max_ps(t1, tmin); // same as (t1 > tmin) ? t1 : tmin
+		}
+		return _mm256_movemask_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LT_OQ));
+#elif defined(__SSE2__) || defined(_M_X64)
+		unsigned mask(0);
+
+		for (unsigned n = 0; n < RAY_PACKET_SIZE; n += 4) {
+			__m128 tmin(_mm_setzero_ps()), tmax(_mm_set1_ps(1.0f));
+
+			for (unsigned i = 0; i < 3; ++i) {
+				__m128 const lo(_mm_set1_ps(d[i][0])), hi(_mm_set1_ps(d[i][1])), org_v(_mm_load_ps(org[i]+n)), dinv_v(_mm_load_ps(dinv[i]+n));
+				__m128 const neg_v(_mm_castsi128_ps(_mm_load_si128((__m128i const *)(neg[i]+n))));
+				__m128 const near_v(_mm_or_ps(_mm_and_ps(neg_v, hi), _mm_andnot_ps(neg_v, lo))), far_v(_mm_or_ps(_mm_and_ps(neg_v, lo), _mm_andnot_ps(neg_v, hi)));
+				tmax = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(far_v,  org_v), dinv_v), tmax);
+				tmin = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(near_v, org_v), dinv_v), tmin);
+			}
+			mask |= (_mm_movemask_ps(_mm_cmplt_ps(tmin, tmax)) << n);
+		}
+		return mask;
+#else // scalar fallback
+		unsigned mask(0);
+
+		for (unsigned n = 0; n < RAY_PACKET_SIZE; ++n) {
+			float tmin(0.0), tmax(1.0);
+
+			for (unsigned i = 0; i < 3; ++i) {
+				bool const is_neg(neg[i][n] != 0);
+				float const t1((d[i][is_neg] - org[i][n])*dinv[i][n]), t2((d[i][!is_neg] - org[i][n])*dinv[i][n]);
+				if (t2 < tmax) {tmax = t2;} if (t1 > tmin) {tmin = t1;}
+			}
+			if (tmin < tmax) {mask |= (1U << n);}
+		}
+		return mask;
+#endif
+	}
+};
+
+
 // *** cobj_tree_simple_type_t ***
 
 
@@ -296,6 +365,76 @@ bool cobj_tree_tquads_t::check_coll_line(point const &p1, point const &p2, point
 }
 
 
+// traces up to RAY_PACKET_SIZE lines together; each query gets the same hit, cpos, and cnorm as the scalar check_coll_line() with exact=1
+// rays share the node slab tests; a ray that misses a node is inactive until the traversal reaches that node's next_node_id,
+// so each ray visits the same leaves in the same order as the scalar version;
+// queries are not reset: hit/cindex/cpos/cnorm are only written when a closer hit is found
+void cobj_bvh_tree::check_coll_line_packet(coll_line_query_t *queries, unsigned num, int ignore_cobj, bool exact, int test_alpha,
+	bool skip_non_drawn, bool skip_movable) const
+{
+	assert(num <= RAY_PACKET_SIZE);
+	if (nodes.empty() || num == 0) return;
+	unsigned const num_nodes((unsigned)nodes.size()), all_mask((1U << num) - 1U);
+	unsigned active(all_mask), inactive(0), done(0), min_resume_nix(num_nodes), resume_nix[RAY_PACKET_SIZE] = {0}; // masks are per-ray bits
+	float tmax[RAY_PACKET_SIZE], max_alpha[RAY_PACKET_SIZE];
+	ray_packet_t rp;
+
+	for (unsigned r = 0; r < RAY_PACKET_SIZE; ++r) {
+		if (r < num) {rp.set_ray(r, queries[r].p1, queries[r].p2);} else {rp.clear_ray(r);}
+		tmax[r]      = 1.0;
+		max_alpha[r] = 0.0;
+	}
+	for (unsigned nix = 0; nix < num_nodes;) {
+		tree_node const &n(nodes[nix]);
+		unsigned const hit_mask(active & rp.get_clip_mask(n.d));
+		assert(n.next_node_id > nix);
+
+		if (hit_mask == 0) {nix = n.next_node_id;} // all active rays failed the bbox test
+		else {
+			unsigned const miss_mask(active & ~hit_mask);
+
+			if (miss_mask) { // these rays skip this subtree
+				for (unsigned r = 0; r < num; ++r) {if (miss_mask & (1U << r)) {resume_nix[r] = n.next_node_id;}}
+				min_resume_nix = min(min_resume_nix, n.next_node_id);
+				inactive |= miss_mask;
+				active    = hit_mask;
+			}
+			for (unsigned r = 0; r < num && n.start < n.end; ++r) {
+				if (!(hit_mask & (1U << r))) continue;
+				coll_line_query_t &q(queries[r]);
+
+				for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+					if (skip_line_cobj(i, q.p1, ignore_cobj, test_alpha, max_alpha[r], skip_non_drawn, q.skip_init_colls, skip_movable)) continue;
+					coll_obj const &c(get_cobj(i));
+					float t(0.0);
+					if (!c.line_int_exact(q.p1, q.p2, t, q.cnorm, 0.0, tmax[r])) continue;
+					q.cindex = cixs[i];
+					q.cpos   = q.p1 + (q.p2 - q.p1)*t;
+					q.hit    = 1;
+					if (!exact && test_alpha != 2) {active &= ~(1U << r); done |= (1U << r); break;} // return first hit
+					max_alpha[r] = c.cp.color.alpha;
+					vector3d dinv(q.cpos - q.p1);
+					dinv.invert();
+					rp.set_dinv(r, dinv);
+					tmax[r] = t;
+				}
+			} // for r
+			if (done == all_mask) break;
+			++nix;
+		}
+		if (nix >= min_resume_nix) { // reactivate rays that skipped ahead to this node
+			min_resume_nix = num_nodes;
+
+			for (unsigned r = 0; r < num; ++r) {
+				if (!(inactive & (1U << r))) continue;
+				if (resume_nix[r] <= nix) {active |= (1U << r); inactive &= ~(1U << r);} // Note: resume_nix[r] == nix
+				else {min_resume_nix = min(min_resume_nix, resume_nix[r]);}
+			}
+		}
+	}
+}
+
+
 // *** cobj_tree_sphere_t ***
 
 
@@ -396,6 +535,10 @@ void cobj_bvh_tree::add_cobjs(bool verbose) {
 // to be called from within add_cobjs() or after a call to add_cobj_ids()
 void cobj_bvh_tree::build_tree_from_cixs(bool do_mt_build) {
 
+	if (cobj_tree_build_quality > 0) { // 1 = median split, 2 = binned SAH
+		build_tree_sah(do_mt_build, (cobj_tree_build_quality >= 2));
+		return;
+	}
 	max_depth = max_leaf_count = num_leaf_nodes = 0;
 	nodes.resize(get_conservative_num_nodes(cixs.size()) + 64*do_mt_build); // add 8 extra nodes for each of 8 top level splits
 	unsigned const root(0);
@@ -413,6 +556,21 @@ void cobj_bvh_tree::build_tree_from_cixs(bool do_mt_build) {
 }
 
 
+bool cobj_bvh_tree::skip_line_cobj(unsigned i, point const &p1, int ignore_cobj, int test_alpha, float max_alpha,
+	bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const
+{
+	if ((int)cixs[i] == ignore_cobj) return 1;
+	coll_obj const &c(get_cobj(i));
+	if (!obj_ok(c))                  return 1;
+	if (skip_non_drawn  && !c.cp.might_be_drawn())                    return 1;
+	if (skip_movable    && c.is_movable())                            return 1;
+	if (test_alpha == 1 && c.is_semi_trans())                         return 1; // semi-transparent, can see through
+	if (test_alpha == 2 && c.cp.color.alpha <= max_alpha)             return 1; // lower alpha than an earlier object
+	if (test_alpha == 3 && c.cp.color.alpha < MIN_SHADOW_ALPHA)       return 1; // less than min alpha
+	if (skip_init_colls && c.contains_pt(p1) && c.contains_point(p1)) return 1;
+	return 0;
+}
+
 // test_alpha: 0 = allow any alpha value, 1 = require alpha = 1.0, 2 = get intersected cobj with max alpha, 3 = require alpha >= MIN_SHADOW_ALPHA
 bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex,
 	int ignore_cobj, bool exact, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const
@@ -430,16 +588,9 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
 			// Note: we test cobj against the original (unclipped) p1 and p2 so that t is correct
 			// Note: we probably don't need to return cnorm and cpos in inexact mode, but it shouldn't be too expensive to do so
-			if ((int)cixs[i] == ignore_cobj) continue;
+			if (skip_line_cobj(i, p1, ignore_cobj, test_alpha, max_alpha, skip_non_drawn, skip_init_colls, skip_movable)) continue;
 			coll_obj const &c(get_cobj(i));
-			if (!obj_ok(c))                  continue;
-			if (skip_non_drawn  && !c.cp.might_be_drawn())                    continue;
-			if (skip_movable    && c.is_movable())                            continue;
-			if (test_alpha == 1 && c.is_semi_trans())                         continue; // semi-transparent, can see through
-			if (test_alpha == 2 && c.cp.color.alpha <= max_alpha)             continue; // lower alpha than an earlier object
-			if (test_alpha == 3 && c.cp.color.alpha < MIN_SHADOW_ALPHA)       continue; // less than min alpha
-			if (skip_init_colls && c.contains_pt(p1) && c.contains_point(p1)) continue;
-			if (!c.line_int_exact(p1, p2, t, cnorm, tmin, tmax))              continue;
+			if (!c.line_int_exact(p1, p2, t, cnorm, tmin, tmax)) continue;
 			cindex = cixs[i];
 			cpos   = p1 + (p2 - p1)*t;
 			//if (c.type == COLL_POLYGON && dot_product((p2 - p1), c.norm) < 0.0) {} // back-facing polygon test
@@ -727,6 +878,288 @@ void cobj_bvh_tree::build_tree(unsigned nix, unsigned skip_dims, unsigned depth,
 	nodes[nix].start = nodes[nix].end = 0; // branch node has no leaves
 }
 
+// *** binned SAH builder ***
+// Builds a binary BVH top-down, splitting nodes on object centers using either the median of the largest axis (fast) or the minimum
+// surface area heuristic cost over binned candidate planes on all three axes. Subtrees are built as OpenMP tasks, which are scheduled
+// across all threads with work stealing, and large nodes bin their objects in parallel chunks. Nodes are allocated from a preallocated
+// pool in whatever order threads reach them and then flattened into the depth-first order with next_node_id skip links that the
+// traversal code expects. The output only depends on the input order of cixs, not on thread count or scheduling.
+
+unsigned const SAH_NUM_BINS         = 16;
+unsigned const SAH_MAX_LEAF_SIZE    = 8;     // max objects in a leaf created because it's cheaper than splitting
+unsigned const SAH_TASK_MIN_OBJS    = 1024;  // don't create tasks for subtrees smaller than this
+unsigned const SAH_PAR_BIN_MIN_OBJS = 65536; // bin nodes at least this large in parallel chunks
+unsigned const SAH_PAR_BIN_CHUNKS   = 16;
+float    const SAH_TRAVERSAL_COST   = 1.0;
+float    const SAH_INTERSECT_COST   = 1.5; // relative to traversal cost; cobj intersection tests are more expensive than bbox tests
+
+class cobj_bvh_tree::sah_builder_t {
+
+	struct prim_t {
+		cube_t bc;
+		unsigned cix;
+		float get_center(unsigned dim) const {return 0.5f*(bc.d[dim][0] + bc.d[dim][1]);}
+	};
+	struct bnode_t : public cube_t {
+		unsigned start=0, end=0, kids[2]={0, 0}; // kids[0] == 0 => leaf, since the root can't be a child
+		bool is_leaf() const {return (kids[0] == 0);}
+	};
+	struct bin_t {
+		cube_t bc;
+		unsigned count=0;
+		bin_t() : bc(FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX) {} // inverted so that unions don't need to check for empty
+		void add(cube_t const &c) {bc.union_with_cube(c); ++count;}
+		void add(bin_t const &b) {bc.union_with_cube(b.bc); count += b.count;}
+		float get_area() const {return ((count > 0) ? bc.get_area() : 0.0f);}
+	};
+	struct range_bounds_t {
+		bin_t all; // bcube and count of all objects
+		cube_t cbounds; // bounds of object centers
+		void add(prim_t const &p) {
+			point const center(p.bc.get_cube_center());
+			if (all.count == 0) {cbounds.set_from_point(center);} else {cbounds.union_with_pt(center);}
+			all.add(p.bc);
+		}
+		void add(range_bounds_t const &b) {
+			if (b.all.count == 0) return;
+			if (all.count == 0) {cbounds = b.cbounds;} else {cbounds.union_with_cube(b.cbounds);}
+			all.add(b.all);
+		}
+	};
+	struct axis_bins_t {bin_t b[3][SAH_NUM_BINS];};
+
+	cobj_bvh_tree &tree;
+	bool full_sah, mt;
+	vector<prim_t> prims;
+	vector<bnode_t> bnodes;
+	std::atomic<unsigned> num_bnodes;
+
+	// small nodes use fewer bins, since the per-node cost of evaluating all bins dominates near the leaves
+	static unsigned get_num_bins(unsigned num) {return max(4U, min(SAH_NUM_BINS, num/2));}
+	static unsigned get_bin_ix(float center, float lo, float scale, unsigned nbins) {return min(nbins-1, unsigned(max(0.0f, (center - lo)*scale)));}
+	static float get_bin_scale(cube_t const &cbounds, unsigned dim, unsigned nbins) {
+		float const sz(cbounds.d[dim][1] - cbounds.d[dim][0]);
+		return ((sz > 0.0f) ? nbins/sz : 0.0f);
+	}
+	void calc_range_bounds(unsigned start, unsigned end, range_bounds_t &rb) const {
+		for (unsigned i = start; i < end; ++i) {rb.add(prims[i]);}
+	}
+	void bin_range(unsigned start, unsigned end, cube_t const &cbounds, unsigned nbins, axis_bins_t &bins) const {
+		float scale[3];
+		UNROLL_3X(scale[i_] = get_bin_scale(cbounds, i_, nbins);)
+
+		for (unsigned i = start; i < end; ++i) {
+			prim_t const &p(prims[i]);
+			UNROLL_3X(bins.b[i_][get_bin_ix(p.get_center(i_), cbounds.d[i_][0], scale[i_], nbins)].add(p.bc);) // dims with no extent are ignored later
+		}
+	}
+	void calc_node_bounds(unsigned start, unsigned end, range_bounds_t &rb) const {
+		unsigned const num(end - start);
+
+		if (!mt || num < SAH_PAR_BIN_MIN_OBJS) {calc_range_bounds(start, end, rb); return;}
+		range_bounds_t chunk_rbs[SAH_PAR_BIN_CHUNKS];
+
+		for (unsigned c = 0; c < SAH_PAR_BIN_CHUNKS; ++c) {
+#pragma omp task shared(chunk_rbs) firstprivate(c)
+			calc_range_bounds((start + c*num/SAH_PAR_BIN_CHUNKS), (start + (c+1)*num/SAH_PAR_BIN_CHUNKS), chunk_rbs[c]);
+		}
+#pragma omp taskwait
+		for (unsigned c = 0; c < SAH_PAR_BIN_CHUNKS; ++c) {rb.add(chunk_rbs[c]);} // merge in a fixed order
+	}
+	void calc_node_bins(unsigned start, unsigned end, cube_t const &cbounds, unsigned nbins, axis_bins_t &bins) const {
+		unsigned const num(end - start);
+
+		if (!mt || num < SAH_PAR_BIN_MIN_OBJS) {bin_range(start, end, cbounds, nbins, bins); return;}
+		vector<axis_bins_t> chunk_bins(SAH_PAR_BIN_CHUNKS);
+
+		for (unsigned c = 0; c < SAH_PAR_BIN_CHUNKS; ++c) {
+#pragma omp task shared(chunk_bins, cbounds) firstprivate(c)
+			bin_range((start + c*num/SAH_PAR_BIN_CHUNKS), (start + (c+1)*num/SAH_PAR_BIN_CHUNKS), cbounds, nbins, chunk_bins[c]);
+		}
+#pragma omp taskwait
+		for (unsigned c = 0; c < SAH_PAR_BIN_CHUNKS; ++c) { // merge in a fixed order
+			for (unsigned d = 0; d < 3; ++d) {
+				for (unsigned b = 0; b < nbins; ++b) {bins.b[d][b].add(chunk_bins[c].b[d][b]);}
+			}
+		}
+	}
+	// partitions [start, end) so that objects in bins below split_bin come first, and calculates the bounds of each side; returns the split position
+	unsigned partition_by_bin(unsigned start, unsigned end, unsigned dim, float lo, float scale, unsigned nbins, unsigned split_bin, range_bounds_t &left, range_bounds_t &right) {
+		unsigned i(start), j(end);
+
+		while (i < j) {
+			if (get_bin_ix(prims[i].get_center(dim), lo, scale, nbins) < split_bin) {left.add(prims[i]); ++i;}
+			else {--j; swap(prims[i], prims[j]); right.add(prims[j]);}
+		}
+		return i;
+	}
+	unsigned split_at_pos(unsigned start, unsigned end, unsigned pos, range_bounds_t &left, range_bounds_t &right) const {
+		calc_node_bounds(start, pos, left );
+		calc_node_bounds(pos,   end, right);
+		return pos;
+	}
+	// returns the split position and the bounds of each side, or end if this node should be a leaf
+	unsigned find_split_and_partition(bnode_t const &n, range_bounds_t const &rb, range_bounds_t &left, range_bounds_t &right) {
+		unsigned const num(n.end - n.start);
+		cube_t const &cb(rb.cbounds);
+		unsigned dim(0);
+		UNROLL_3X(if ((cb.d[i_][1] - cb.d[i_][0]) > (cb.d[dim][1] - cb.d[dim][0])) {dim = i_;})
+
+		if (cb.d[dim][1] == cb.d[dim][0]) { // all centers are the same; split in the middle if there are too many objects for a leaf
+			return ((num <= SAH_MAX_LEAF_SIZE) ? n.end : split_at_pos(n.start, n.end, (n.start + num/2), left, right));
+		}
+		if (!full_sah) { // object median of the largest axis
+			unsigned const mid(n.start + num/2);
+			std::nth_element(prims.begin()+n.start, prims.begin()+mid, prims.begin()+n.end,
+				[dim](prim_t const &a, prim_t const &b) {return (a.get_center(dim) < b.get_center(dim) || (a.get_center(dim) == b.get_center(dim) && a.cix < b.cix));});
+			return split_at_pos(n.start, n.end, mid, left, right);
+		}
+		unsigned const nbins(get_num_bins(num));
+		axis_bins_t bins;
+		calc_node_bins(n.start, n.end, cb, nbins, bins);
+		float const inv_parent_area(1.0f/max(rb.all.bc.get_area(), TOLERANCE));
+		float best_cost(SAH_INTERSECT_COST*num); // cost of making this a leaf
+		unsigned best_dim(3), best_split(0);
+
+		for (unsigned d = 0; d < 3; ++d) {
+			if (get_bin_scale(cb, d, nbins) == 0.0f) continue; // no extent in this dim
+			float right_area[SAH_NUM_BINS];
+			unsigned right_count[SAH_NUM_BINS];
+			bin_t acc;
+
+			for (unsigned b = nbins-1; b > 0; --b) { // sweep right to left: right side of split plane b contains bins [b, nbins)
+				acc.add(bins.b[d][b]);
+				right_count[b] = acc.count;
+				right_area [b] = acc.get_area();
+			}
+			acc = bin_t();
+
+			for (unsigned b = 1; b < nbins; ++b) { // sweep left to right
+				acc.add(bins.b[d][b-1]);
+				if (acc.count == 0 || right_count[b] == 0) continue; // not a real split
+				float const cost(SAH_TRAVERSAL_COST + SAH_INTERSECT_COST*inv_parent_area*(acc.count*acc.get_area() + right_count[b]*right_area[b]));
+				if (cost < best_cost) {best_cost = cost; best_dim = d; best_split = b;}
+			}
+		}
+		if (best_dim == 3) { // no split is better than a leaf
+			if (num <= SAH_MAX_LEAF_SIZE) return n.end;
+			// too many objects for a leaf; use the split that best balances the counts
+			unsigned best_imbalance(num);
+			best_dim = dim;
+
+			for (unsigned b = 1, left_count = 0; b < nbins; ++b) {
+				left_count += bins.b[dim][b-1].count;
+				if (left_count == 0 || left_count == num) continue;
+				unsigned const imbalance(abs(int(2*left_count) - int(num)));
+				if (imbalance < best_imbalance) {best_imbalance = imbalance; best_split = b;}
+			}
+			assert(best_split > 0); // must be valid since cbounds has nonzero extent in dim
+		}
+		return partition_by_bin(n.start, n.end, best_dim, cb.d[best_dim][0], get_bin_scale(cb, best_dim, nbins), nbins, best_split, left, right);
+	}
+	void build_node(unsigned bnix, range_bounds_t const &rb) { // rb = bounds of this node's objects
+		bnode_t &n(bnodes[bnix]);
+		unsigned const num(n.end - n.start);
+		assert(num > 0 && rb.all.count == num);
+		n.copy_from(rb.all.bc);
+		if (num <= MAX_LEAF_SIZE) return; // leaf
+		range_bounds_t left, right;
+		unsigned const split_pos(find_split_and_partition(n, rb, left, right));
+		if (split_pos == n.end) return; // leaf
+		assert(split_pos > n.start && split_pos < n.end);
+		unsigned const kid(num_bnodes.fetch_add(2));
+		assert(kid+1 < bnodes.size());
+		bnodes[kid  ].start = n.start;
+		bnodes[kid  ].end   = split_pos;
+		bnodes[kid+1].start = split_pos;
+		bnodes[kid+1].end   = n.end;
+		n.kids[0] = kid;
+		n.kids[1] = kid+1;
+
+		if (mt && (split_pos - n.start) >= SAH_TASK_MIN_OBJS) {
+#pragma omp task firstprivate(kid, left)
+			build_node(kid, left);
+		}
+		else {build_node(kid, left);}
+		build_node(kid+1, right);
+	}
+	void flatten() { // convert to depth-first order with skip links
+		unsigned const nbn(num_bnodes);
+		vector<unsigned> subtree_size(nbn, 1), out_pos(nbn, 0), depth(nbn, 0);
+
+		for (unsigned i = nbn; i-- > 0;) { // kids always have higher indices than their parents
+			bnode_t const &n(bnodes[i]);
+			if (!n.is_leaf()) {subtree_size[i] += subtree_size[n.kids[0]] + subtree_size[n.kids[1]];}
+		}
+		assert(subtree_size[0] == nbn);
+		vector<tree_node> &nodes(tree.nodes);
+		nodes.resize(nbn);
+		tree.max_depth = tree.max_leaf_count = tree.num_leaf_nodes = 0;
+
+		for (unsigned i = 0; i < nbn; ++i) {
+			bnode_t const &n(bnodes[i]);
+			unsigned const pos(out_pos[i]);
+			tree_node &tn(nodes[pos]);
+			tn.copy_from(n);
+			tn.next_node_id = pos + subtree_size[i];
+			max_eq(tree.max_depth, depth[i]);
+
+			if (n.is_leaf()) {
+				tn.start = n.start;
+				tn.end   = n.end;
+				tree.register_leaf(n.end - n.start);
+			}
+			else {
+				tn.start = tn.end = 0; // branch node has no leaves
+				out_pos[n.kids[0]] = pos + 1;
+				out_pos[n.kids[1]] = pos + 1 + subtree_size[n.kids[0]];
+				depth  [n.kids[0]] = depth[n.kids[1]] = depth[i] + 1;
+			}
+		}
+	}
+public:
+	sah_builder_t(cobj_bvh_tree &tree_, bool full_sah_, bool mt_) : tree(tree_), full_sah(full_sah_), mt(mt_), num_bnodes(1) {}
+
+	void build() {
+		vector<unsigned> &cixs(tree.cixs);
+		unsigned const num((unsigned)cixs.size());
+		if (num == 0) {tree.nodes.clear(); return;}
+		prims.resize(num);
+
+		for (unsigned i = 0; i < num; ++i) {
+			coll_obj const &c(tree.get_cobj(i));
+			assert(c.d[0][0] <= c.d[0][1] && c.d[1][0] <= c.d[1][1] && c.d[2][0] <= c.d[2][1]); // valid bcube
+			prims[i].bc  = c;
+			prims[i].cix = cixs[i];
+		}
+		bnodes.resize(2*num); // max nodes for a binary tree with at least one object per leaf is 2*num-1
+		bnodes[0].start = 0;
+		bnodes[0].end   = num;
+
+		range_bounds_t rb;
+
+		if (mt) {
+#pragma omp parallel
+#pragma omp single
+			{
+				calc_node_bounds(0, num, rb);
+				build_node(0, rb);
+			}
+		}
+		else {
+			calc_node_bounds(0, num, rb);
+			build_node(0, rb);
+		}
+		for (unsigned i = 0; i < num; ++i) {cixs[i] = prims[i].cix;}
+		flatten();
+	}
+};
+
+void cobj_bvh_tree::build_tree_sah(bool do_mt_build, bool full_sah) {
+	sah_builder_t builder(*this, full_sah, do_mt_build);
+	builder.build();
+}
+
 
 // is_static is_dynamic occluders_only cubes_only inc_voxel_cobjs
 cobj_bvh_tree cobj_tree_static (&coll_objects, 1, 0, 0, 0, 0); // does not include voxels
@@ -759,6 +1192,8 @@ void build_static_moving_cobj_tree() {
 
 void build_cobj_tree(bool dynamic, bool verbose) {
 	
+	invalidate_precip_coll_batch();
+
 	if (!dynamic) { // static
 		get_tree(0).add_cobjs(verbose);
 		cobj_tree_occlude.add_cobjs(verbose);
@@ -783,6 +1218,19 @@ bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, v
 	return ret;
 }
 
+// packet version of check_coll_line_exact_tree() for static cobjs, used with ray trace lighting; the static-moving tree and voxels are queried per-ray
+void check_coll_line_exact_tree_packet(coll_line_query_t *queries, unsigned num, int ignore_cobj, int test_alpha, bool include_voxels, bool no_stat_moving) {
+
+	for (unsigned r = 0; r < num; ++r) {queries[r].cindex = -1; queries[r].hit = 0;}
+	get_tree(0).check_coll_line_packet(queries, num, ignore_cobj, 1, test_alpha, 0, 0);
+
+	for (unsigned r = 0; r < num; ++r) {
+		coll_line_query_t &q(queries[r]);
+		if (!no_stat_moving) {q.hit |= cobj_tree_static_moving.check_coll_line(q.p1, (q.hit ? q.cpos : q.p2), q.cpos, q.cnorm, q.cindex, ignore_cobj, 1, test_alpha, 0, q.skip_init_colls, 0);}
+		if (include_voxels ) {q.hit |= check_voxel_coll_line(q.p1, (q.hit ? q.cpos : q.p2), q.cpos, q.cnorm, q.cindex, ignore_cobj, 1);}
+	}
+}
+
 // can use with snow shadows, grass shadows, tree leaf shadows
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic,
 	int test_alpha, bool skip_non_drawn, bool include_voxels, bool skip_init_colls, bool skip_movable)
@@ -5,6 +5,19 @@
 
 #include "physics_objects.h"
 
+unsigned const RAY_PACKET_SIZE = 8; // max rays per packet query; one AVX register or two SSE registers of floats
+
+
+struct coll_line_query_t { // one ray of a packet line query
+	point p1, p2, cpos;
+	vector3d cnorm;
+	int cindex;
+	bool skip_init_colls, hit;
+
+	coll_line_query_t() : cindex(-1), skip_init_colls(0), hit(0) {}
+	coll_line_query_t(point const &p1_, point const &p2_, bool sic) : p1(p1_), p2(p2_), cpos(p2_), cindex(-1), skip_init_colls(sic), hit(0) {}
+};
+
 
 class cobj_tree_base {
 
@@ -122,12 +135,18 @@ class cobj_bvh_tree : public cobj_tree_base {
 		void increment_node_ix() {assert(cur_nix >= start_nix); cur_nix++;}
 	};
 
+	class sah_builder_t; // binned SAH builder, defined in cobj_bsp_tree.cpp
+	friend class sah_builder_t;
+
 	void add_cobj(unsigned ix) {if (obj_ok((*cobjs)[ix])) {cixs.push_back(ix);}}
 	coll_obj const &get_cobj(unsigned ix) const {return (*cobjs)[cixs[ix]];}
 	bool create_cixs();
 	void calc_node_bbox(tree_node &n) const;
 	void build_tree_top_level_omp();
 	void build_tree(unsigned nix, unsigned skip_dims, unsigned depth, per_thread_data &ptd);
+	void build_tree_sah(bool do_mt_build, bool full_sah);
+
+	bool skip_line_cobj(unsigned i, point const &p1, int ignore_cobj, int test_alpha, float max_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const;
 
 	bool obj_ok(coll_obj const &c) const {
 		return (((is_static && c.status == COLL_STATIC) || (is_dynamic && c.status == COLL_DYNAMIC) || (!is_static && !is_dynamic)) &&
@@ -146,6 +165,7 @@ public:
 	void build_tree_from_cixs(bool do_mt_build);
 	bool check_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 		bool exact, int test_alpha, bool skip_non_drawn, bool skip_init_colls, bool skip_movable) const;
+	void check_coll_line_packet(coll_line_query_t *queries, unsigned num, int ignore_cobj, bool exact, int test_alpha, bool skip_non_drawn, bool skip_movable) const;
 	bool check_point_contained(point const &p, int &cindex) const;
 	void get_intersecting_cobjs(cube_t const &cube, vector<unsigned> &cobjs, int ignore_cobj, float toler, bool check_ccounter, int id_for_cobj_int) const;
 	bool is_cobj_contained(point const &viewer, point const *const pts, unsigned npts, int ignore_cobj, int &cobj) const;
@@ -5,6 +5,7 @@
 #include "3DWorld.h"
 #include "mesh.h"
 #include "physics_objects.h"
+#include "cobj_bsp_tree.h"
 
 
 int cobj_counter(0);
@@ -286,6 +287,17 @@ bool check_coll_line_exact(point pos1, point pos2, point &cpos, vector3d &cnorm,
 	return (cindex >= 0);
 }
 
+// packet version of check_coll_line_exact() with skip_dynamic=1 and no splashes; each query's hit is set to (cindex >= 0)
+void check_coll_line_exact_packet(coll_line_query_t *queries, unsigned num, int ignore_cobj, bool include_voxels, bool no_stat_moving) {
+
+	if (world_mode != WMODE_GROUND) {
+		for (unsigned r = 0; r < num; ++r) {queries[r].cindex = -1; queries[r].hit = 0;}
+		return;
+	}
+	check_coll_line_exact_tree_packet(queries, num, ignore_cobj, 0, include_voxels, no_stat_moving);
+	for (unsigned r = 0; r < num; ++r) {queries[r].hit = (queries[r].cindex >= 0);}
+}
+
 
 bool cobj_contained_ref(point const &pos1, const point *pts, unsigned npts, int cobj, int &last_cobj) {
 
@@ -724,6 +724,7 @@ int remove_coll_object(int index, bool reset_draw) {
 		return 0;
 	}
 	if (c.status == COLL_FREED) return 0;
+	precip_coll_batch_cobj_changed(c);
 	coll_objects.remove_index_from_ids(index);
 	if (reset_draw) {c.cp.draw = 0;}
 	c.status   = COLL_FREED;
@@ -851,6 +852,7 @@ void coll_obj_group::set_coll_obj_props(int index, int type, float radius, float
 	if (platform_id >= 0) {platform_ids.must_insert(index);}
 	if ((type == COLL_CUBE || type == COLL_SPHERE) && cparams.light_atten != 0.0) {has_lt_atten = 1;}
 	if (cparams.cobj_type == COBJ_TYPE_VOX_TERRAIN) {has_voxel_cobjs = 1;}
+	precip_coll_batch_cobj_changed(cobj);
 }
 
 
@@ -7,6 +7,7 @@
 #include "timetest.h"
 #include "physics_objects.h"
 #include "model3d.h"
+#include "profiler.h"
 #include <fstream>
 
 
@@ -333,6 +334,7 @@ void final_draw(float framerate) {
 
 
 void swap_buffers_and_redraw() {
+	frame_profiler_end_frame();
 	glutSwapBuffers();
 	if (animate) {post_window_redisplay();} // before glutSwapBuffers()?
 }
@@ -1307,9 +1309,10 @@ void display_inf_terrain() { // infinite terrain mode (Note: uses light params f
 	// however, only the headlight flares are drawn in the transparent pass, and it doesn't seem to be a problem, so we allow it
 	if (have_city_models()) {
 		//timer_t timer("City Update MT"); // 4.65ms
+		unsigned const prof_parent(frame_prof_get_cur_node());
 #pragma omp parallel num_threads(3)
 		if (omp_get_thread_num_3dw() == 0) {draw_tiled_terrain_and_transparent_geom(terrain_zmin, tt_reflection_tid, draw_water, camera_above_clouds);} // drawing must be on thread 0
-		else {next_city_frame(1);} // other threads (if threads enabled, else serial)
+		else {FRAME_PROF_PARENT(prof_parent); next_city_frame(1);} // other threads (if threads enabled, else serial)
 	}
 	else { // serial version
 		//timer_t timer("City Update"); // 10.0ms
@@ -63,10 +63,24 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 	e.x=r; e.y=d; \
 }
 
-#pragma omp parallel for schedule(dynamic,1)
-	for (int iter=0; iter < (int)num_iters; ++iter) {
+	// Droplets are binned by the tile containing their start position and only allowed to move within that tile plus a halo of HALO cells.
+	// Tiles are processed in four checkerboard phases; tiles in the same phase are two tiles apart, so the cells they read and write
+	// never overlap and can be simulated in parallel. Each tile runs its droplets in order, so the result doesn't depend on the thread count.
+	int const TILE_SZ(64), HALO(24); // Note: requires 2*HALO+3 <= TILE_SZ, to account for the erosion kernel
+	int const ntx((NX + TILE_SZ - 1)/TILE_SZ), nty((NY + TILE_SZ - 1)/TILE_SZ);
+	vector<vector<unsigned>> tile_droplets(ntx*nty);
+
+	auto seed_droplet = [](rand_gen_t &rgen, int iter) {rgen.set_state(iter+11, 79*iter+121);};
+
+	for (unsigned iter = 0; iter < num_iters; ++iter) {
+		rand_gen_t rgen;
+		seed_droplet(rgen, iter);
+		int const xi(PAD + (rgen.rand()%xsize)), zi(PAD + (rgen.rand()%ysize)); // must agree with run_droplet()
+		tile_droplets[(zi/TILE_SZ)*ntx + (xi/TILE_SZ)].push_back(iter);
+	}
+	auto run_droplet = [&](int iter, int wx1, int wy1, int wx2, int wy2) {
 		rand_gen_t rgen;
-		rgen.set_state(iter+11, 79*iter+121);
+		seed_droplet(rgen, iter);
 		int xi = PAD + (rgen.rand()%xsize);
 		int zi = PAD + (rgen.rand()%ysize);
 		float xp=xi, zp=zi, xf=0, zf=0, s=0, v=0, w=1, dx=0, dz=0;
@@ -91,6 +105,7 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 			float nxp=xp+dx, nzp=zp+dz;
 			// sample next height
 			int nxi=floor(nxp), nzi=floor(nzp);
+			if (nxi < wx1 || nzi < wy1 || nxi+1 >= wx2 || nzi+1 >= wy2) break; // leaving this tile's region, stop and ignore sediment
 			float nxf=nxp-nxi, nzf=nzp-nzi;
 			float nh00=HMAP(nxi, nzi), nh10=HMAP(nxi+1, nzi), nh01=HMAP(nxi, nzi+1), nh11=HMAP(nxi+1, nzi+1);
 			float nh=(nh00*(1-nxf)+nh10*nxf)*(1-nzf)+(nh01*(1-nxf)+nh11*nxf)*nzf;
@@ -152,7 +167,21 @@ void apply_erosion(float *heightmap, int xsize, int ysize, float min_zval, unsig
 			h=nh; h00=nh00; h10=nh10; h01=nh01; h11=nh11;
 		} // for numMoves
 		if (numMoves>=MAX_PATH_LEN) {cout << "droplet path is too long: " << iter << endl;}
-	} // for iter
+	};
+	for (unsigned phase = 0; phase < 4; ++phase) {
+		vector<int> phase_tiles;
+
+		for (int ty = (phase>>1); ty < nty; ty += 2) {
+			for (int tx = (phase&1); tx < ntx; tx += 2) {
+				if (!tile_droplets[ty*ntx + tx].empty()) {phase_tiles.push_back(ty*ntx + tx);}
+			}
+		}
+#pragma omp parallel for schedule(dynamic,1) if (phase_tiles.size() > 1)
+		for (int i = 0; i < (int)phase_tiles.size(); ++i) {
+			int const tix(phase_tiles[i]), x1((tix%ntx)*TILE_SZ - HALO), y1((tix/ntx)*TILE_SZ - HALO);
+			for (unsigned iter : tile_droplets[tix]) {run_droplet(iter, x1, y1, x1+TILE_SZ+2*HALO, y1+TILE_SZ+2*HALO);}
+		}
+	} // for phase
 
 	// remove padding and clamp to min_zval
 	for (int y = 0; y < ysize; ++y) {
@@ -9,6 +9,21 @@
 
 unsigned const FILE_BUF_SZ = (1U<<16); // 64k
 
+class mapped_file_t { // read-only memory mapped file; Windows reads the whole file into memory instead
+	char const *data=nullptr;
+	size_t size=0;
+#ifdef _WIN32
+	std::vector<char> buf;
+#else
+	void *map_ptr=nullptr;
+#endif
+public:
+	~mapped_file_t();
+	char const *get_data() const {return data;}
+	size_t      get_size() const {return size;}
+	bool open(std::string const &fn); // returns 0 if the file can't be opened or is empty
+};
+
 class base_file_reader {
 
 protected:
@@ -23,8 +38,6 @@ protected:
 	bool open_file(bool binary=0);
 	void close_file();
 	char get_next_char() {assert(fp); return get_char(fp);}
-	static bool fast_isspace(char c) {return (c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r');}
-	static bool fast_isdigit(char c) {return (c >= '0' && c <= '9');}
 
 	void unget_last_char(char c) {
 		if (c == EOF) return; // can't unget EOF
@@ -83,6 +96,9 @@ protected:
 	bool read_string(char *s, unsigned max_len);
 
 public:
+	static bool fast_isspace(char c) {return (c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r');}
+	static bool fast_isdigit(char c) {return (c >= '0' && c <= '9');}
+
 	base_file_reader(std::string const &fn) : filename(fn), fp(NULL), verbose(0), file_buf(new char [FILE_BUF_SZ]), file_buf_pos(0), file_buf_end(0) {assert(!fn.empty());}
 	~base_file_reader() {close_file(); delete [] file_buf;}
 };
@@ -0,0 +1,23 @@
+// 3D World - FNV-1a Hash Function
+// by Frank Gennari
+#pragma once
+
+#include <cstdint>
+#include <cstring> // for memcpy
+#include <cstddef>
+
+uint64_t const FNV_HASH_INIT = 0xcbf29ce484222325ULL;
+
+// FNV-1a over 8-byte words, then the remaining bytes; used for file checksums and cache keys; pass a previous result as hash to combine
+inline uint64_t calc_fnv_hash(void const *data, size_t size, uint64_t hash=FNV_HASH_INIT) {
+	unsigned char const *const ptr((unsigned char const *)data);
+	size_t const nwords(size/8);
+
+	for (size_t i = 0; i < nwords; ++i) {
+		uint64_t word;
+		memcpy(&word, (ptr + 8*i), 8);
+		hash = (hash ^ word)*0x100000001b3ULL;
+	}
+	for (size_t i = 8*nwords; i < size; ++i) {hash = (hash ^ ptr[i])*0x100000001b3ULL;}
+	return hash;
+}
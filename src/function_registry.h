@@ -6,6 +6,7 @@
 #include "3DWorld.h"
 
 struct xform_matrix;
+struct coll_line_query_t;
 class tree_cont_t;
 
 // glGetError wrappers
@@ -84,6 +85,8 @@ void process_platforms_falling_moving_and_light_triggers();
 bool check_player_proximity(point const &pos, float radius=0.0, bool use_bottom=0);
 void set_global_state();
 void process_groups();
+void precip_coll_batch_cobj_changed(cube_t const &bcube);
+void invalidate_precip_coll_batch();
 void gen_scene(int generate_mesh, int gen_trees, int keep_sin_table, int update_zvals, int rgt_only);
 void write_def_coll_objects_file();
 void init_models();
@@ -460,6 +463,7 @@ void build_static_moving_cobj_tree();
 void build_cobj_tree(bool dynamic=0, bool verbose=1);
 bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 	bool dynamic=0, int test_alpha=0, bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0, bool no_stat_moving=0);
+void check_coll_line_exact_tree_packet(coll_line_query_t *queries, unsigned num, int ignore_cobj, int test_alpha=0, bool include_voxels=1, bool no_stat_moving=0);
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic=0, int test_alpha=0,
 	bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0);
 bool cobj_contained_tree(point const &viewer, point const *const pts, unsigned npts, int ignore_cobj, int &cobj);
@@ -474,6 +478,7 @@ bool check_coll_line(point const &pos1, point const &pos2, int &cindex, int c_ob
 	bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0);
 bool check_coll_line_exact(point pos1, point pos2, point &cpos, vector3d &coll_norm, int &cindex, float splash_val=0.0, int ignore_cobj=-1,
 	bool fast=0, bool test_alpha=0, bool skip_dynamic=0, bool include_voxels=1, bool skip_init_colls=0, bool no_stat_moving=0);
+void check_coll_line_exact_packet(coll_line_query_t *queries, unsigned num, int ignore_cobj=-1, bool include_voxels=1, bool no_stat_moving=0);
 bool cobj_contained_ref(point const &pos1, const point *pts, unsigned npts, int cobj, int &last_cobj);
 bool cobj_contained(point const &pos1, const point *pts, unsigned npts, int cobj);
 colorRGBA get_cobj_color_at_point(int cindex, point const &pos, vector3d const &normal, bool fast);
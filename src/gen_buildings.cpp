@@ -37,7 +37,7 @@ building_t const *player_building(nullptr);
 extern bool start_in_inf_terrain, draw_building_interiors, flashlight_on, enable_use_temp_vbo, toggle_room_light;
 extern bool teleport_to_screenshot, enable_dlight_bcubes, can_do_building_action, mirror_in_ext_basement;
 extern unsigned room_mirror_ref_tid;
-extern int rand_gen_index, display_mode, window_width, window_height, camera_surf_collide, animate2, building_action_key, player_in_elevator;
+extern int rand_gen_index, display_mode, window_width, window_height, camera_surf_collide, animate2, building_action_key, player_in_elevator, frame_counter;
 extern float CAMERA_RADIUS, fticks, NEAR_CLIP, FAR_CLIP;
 extern colorRGB cur_ambient, cur_diffuse;
 extern point pre_smap_player_pos, actual_player_pos;
@@ -2642,6 +2642,39 @@ class building_creator_t {
 			if (expand_by_one && ixr[1][d]+1 < grid_sz) {++ixr[1][d];}
 		}
 	}
+	// assign buildings to generation waves: building A conflicts with building B if A's extended basement queries can read B, which happens when B was
+	// added to a grid that's in or adjacent to the range of A's home grid (the one containing A's center); see check_cube_coll() and get_grid_bcube_for_building();
+	// each building's wave is one more than the max wave of its conflicting lower index buildings, so the result is the same as generating them serially in index order
+	void calc_gen_geom_waves(bool ext_basements, vector<unsigned> &order, vector<unsigned> &wave_start) const {
+		unsigned const num(buildings.size());
+		vector<unsigned> wave(num, 0);
+		unsigned num_waves(num ? 1 : 0);
+
+		if (ext_basements) {
+			vector<unsigned> max_read_wave(grid.size(), 0), max_write_wave(grid.size(), 0); // stored as wave+1; 0 = no buildings yet
+
+			for (unsigned i = 0; i < num; ++i) {
+				building_t const &b(buildings[i]);
+				unsigned rd[2][2], wr[2][2], w(0);
+				get_grid_range(grid[get_grid_ix(b.bcube.get_cube_center())].bcube, rd, 1); // expand_by_one=1, matching check_cube_coll()
+				get_grid_range(b.bcube, wr); // matching add_to_grid()
+				for (unsigned y = rd[0][1]; y <= rd[1][1]; ++y) {for (unsigned x = rd[0][0]; x <= rd[1][0]; ++x) {max_eq(w, max_write_wave[y*grid_sz + x]);}} // we read them
+				for (unsigned y = wr[0][1]; y <= wr[1][1]; ++y) {for (unsigned x = wr[0][0]; x <= wr[1][0]; ++x) {max_eq(w, max_read_wave [y*grid_sz + x]);}} // they read us
+				wave[i] = w;
+				for (unsigned y = rd[0][1]; y <= rd[1][1]; ++y) {for (unsigned x = rd[0][0]; x <= rd[1][0]; ++x) {max_eq(max_read_wave [y*grid_sz + x], w+1);}}
+				for (unsigned y = wr[0][1]; y <= wr[1][1]; ++y) {for (unsigned x = wr[0][0]; x <= wr[1][0]; ++x) {max_eq(max_write_wave[y*grid_sz + x], w+1);}}
+				max_eq(num_waves, w+1);
+			} // for i
+		}
+		// counting sort by wave, keeping buildings in index order within each wave
+		wave_start.clear();
+		wave_start.resize(num_waves+1, 0);
+		for (unsigned i = 0; i < num; ++i) {++wave_start[wave[i]+1];}
+		for (unsigned w = 0; w < num_waves; ++w) {wave_start[w+1] += wave_start[w];}
+		vector<unsigned> next(wave_start.begin(), wave_start.end()-1);
+		order.resize(num);
+		for (unsigned i = 0; i < num; ++i) {order[next[wave[i]]++] = i;}
+	}
 	void add_to_grid(cube_t const &bcube, unsigned bix, bool is_road_seg) {
 		unsigned ixr[2][2];
 		get_grid_range(bcube, ixr);
@@ -3084,17 +3117,21 @@ public:
 			timer_t timer2("Gen Building Geometry", !is_tile); // 120ms/700ms => 160ms/900ms
 			bool const gen_interiors(global_building_params.gen_building_interiors);
 			bool const use_mt(!is_tile || gen_interiors); // only single threaded for tiles with no interiors, which is a fast case anyway
-			// house extended basement logic isn't thread safe because two houses being generated on different threads could have overlapping basement rooms;
-			// however, office buildings don't have extended basements, so it should be okay to process them in parallel to houses; this is just a bit slower
-#pragma omp parallel for schedule(static) num_threads(2) if (use_mt)
-			for (int is_house=0; is_house < 2; ++is_house) {
-				for (unsigned i = 0; i < buildings.size(); ++i) {
+			// extended basement placement isn't thread safe because two buildings being generated on different threads could have overlapping basement rooms;
+			// split buildings into waves where no two buildings in the same wave can see each other, and process each wave in parallel
+			vector<unsigned> gen_order, wave_start;
+			calc_gen_geom_waves((gen_interiors && global_building_params.max_ext_basement_room_depth > 0), gen_order, wave_start);
+
+			for (unsigned w = 0; w+1 < wave_start.size(); ++w) {
+				FRAME_PROF_ZONE("Gen Building Geometry Pass");
+#pragma omp parallel for schedule(dynamic) if (use_mt)
+				for (int n = wave_start[w]; n < (int)wave_start[w+1]; ++n) {
+					unsigned const i(gen_order[n]);
 					building_t &b(buildings[i]);
-					if (b.is_house != bool(is_house)) continue; // wrong pass
 					unsigned const rs_ix(city_prob.get(i).same_geom_per_mat[b.is_house] ? b.mat_ix : i); // same material, maybe from same block/city; could also use city_ix
 					b.gen_geometry(rs_ix, 1337*rs_ix+rseed);
 				}
-			} // for is_house
+			} // for w
 			if (city_only && gen_interiors && global_building_params.max_ext_basement_room_depth > 0) {try_join_house_ext_basements(buildings);}
 		} // close the scope
 		if (0 && non_city_only) { // perform room graph analysis
@@ -3390,6 +3427,49 @@ public:
 
 	// reflection_pass: 0 = not reflection pass, 1 = reflection for room with exterior wall,
 	// 2 = reflection for room no exterior wall (can't see outside windows), 3 = reflection from mirror in a house (windows and doors need to be drawn)
+	// predict where the camera will be room_geom_prefetch_frames from now based on its motion, and generate room geometry for the closest building
+	// within room geom draw distance of that point before it's needed; at most one building per frame, to avoid the hitch when it's first drawn;
+	// this counts against the same per-frame budget as room geom generated when drawn, so that a frame never generates more than the limit
+	static void prefetch_room_geom(vector<building_creator_t *> const &bcs, point const &camera_bs, float rgeom_draw_dist, float rgeom_clear_dist) {
+		static point last_camera_bs;
+		vector3d const move(camera_bs - last_camera_bs);
+		last_camera_bs = camera_bs;
+		unsigned const prefetch_frames(global_building_params.room_geom_prefetch_frames);
+		if (prefetch_frames == 0 || frame_counter < 100) return; // disabled, or the first 100 frames, where room geom gen is unlimited anyway
+		if (!room_geom_gen_budget_avail()) return; // already generated room geom this frame
+		float const move_len(move.mag());
+		if (move_len < TOLERANCE || move_len > 0.1*rgeom_draw_dist) return; // not moving, or teleported
+		point const pred_pos(camera_bs + (min(prefetch_frames*move_len, rgeom_draw_dist)/move_len)*move); // limit prediction distance
+		building_t *best_b(nullptr);
+		grid_elem_t *best_g(nullptr);
+		unsigned best_ix(0);
+		float best_dsq(0.0);
+
+		for (building_creator_t *bc : bcs) {
+			// use the same distance scales as the draw pass
+			float const ddist_scale(bc->building_draw_windows.empty() ? (camera_surf_collide ? 0.1 : 0.05) : 1.0);
+			float const draw_dist_sq((ddist_scale*rgeom_draw_dist)*(ddist_scale*rgeom_draw_dist)), clear_dist_sq((ddist_scale*rgeom_clear_dist)*(ddist_scale*rgeom_clear_dist));
+
+			for (grid_elem_t &g : bc->grid_by_tile) {
+				cube_t const &grid_bcube(g.get_vis_bcube());
+				if (p2p_dist_sq(camera_bs, grid_bcube.closest_pt(camera_bs)) > clear_dist_sq) continue; // would be cleared next frame
+				if (p2p_dist_sq(pred_pos,  grid_bcube.closest_pt(pred_pos )) > draw_dist_sq ) continue; // not reached
+
+				for (cube_with_ix_t const &bi : g.bc_ixs) {
+					building_t &b(bc->get_building(bi.ix));
+					if (!b.interior || b.has_room_geom()) continue;
+					float const dsq(p2p_dist_sq(pred_pos, b.bcube.closest_pt(pred_pos)));
+					if (dsq > draw_dist_sq || (best_b && dsq >= best_dsq)) continue;
+					best_b = &b; best_g = &g; best_ix = bi.ix; best_dsq = dsq;
+				}
+			} // for g
+		} // for bc
+		if (best_b == nullptr) return; // nothing to prefetch
+		best_b->prefetch_room_geom(best_ix);
+		register_room_geom_gen();
+		best_g->has_room_geom = 1; // so that it's cleared when the camera moves away
+	}
+
 	static void multi_draw(int shadow_only, int reflection_pass, vector3d const &xlate, vector<building_creator_t *> const &bcs) {
 		if (bcs.empty()) return;
 
@@ -3702,6 +3782,7 @@ public:
 			}
 			reset_interior_lighting_and_end_shader(s);
 			reflection_shader.clear();
+			if (!reflection_pass) {prefetch_room_geom(bcs, camera_bs, room_geom_draw_dist, room_geom_clear_dist);}
 
 			// update indir lighting using ray casting
 			if (indir_bcs_ix >= 0 && indir_bix >= 0) {indir_tex_mgr.create_for_building(bcs[indir_bcs_ix]->get_building(indir_bix), indir_bix, camera_bs);}
@@ -4379,7 +4460,7 @@ public:
 	}
 
 	// Note: we can get building_id by calling check_ped_coll() or get_building_bcube_at_pos(); p1 and p2 are in building space
-	bool check_line_coll_building(point const &p1, point const &p2, unsigned building_id) const { // Note: not thread safe due to static points
+	bool check_line_coll_building(point const &p1, point const &p2, unsigned building_id) const {
 		assert(building_id < buildings.size());
 		float t_new(1.0);
 		return buildings[building_id].check_line_coll(p1, p2, t_new, 0, 1, 1); // occlusion_only=0, ret_any_pt=1, no_coll_pt=1
@@ -4389,17 +4470,16 @@ public:
 		return buildings[building_id].check_sphere_coll(pos, radius, xy_only);
 	}
 	bool check_building_point_or_cylin_contained(point const &pos, float radius, bool inc_details, unsigned building_id) const {
-		static vector<point> points; // reused across calls
+		static thread_local vector<point> points; // reused across calls; called by peds in different cities in parallel
 		assert(building_id < buildings.size());
 		return buildings[building_id].check_point_or_cylin_contained(pos, radius, points, 0, 0, 0, inc_details); // attic=0, extb=0, roof=0
 	}
 
-	int get_building_bcube_contains_pos(point const &pos) { // Note: not thread safe due to static points
+	int get_building_bcube_contains_pos(point const &pos) const {
 		if (empty()) return -1;
 		unsigned const gix(get_grid_ix(pos));
 		grid_elem_t const &ge(grid[gix]);
 		if (ge.bc_ixs.empty() || !ge.bcube.contains_pt(pos)) return -1; // skip empty or non-containing grid
-		static vector<point> points; // reused across calls
 
 		for (auto b = ge.bc_ixs.begin(); b != ge.bc_ixs.end(); ++b) {
 			if (b->contains_pt(pos)) {return b->ix;} // found
@@ -4411,7 +4491,6 @@ public:
 		return grid[get_grid_ix(b.bcube.get_cube_center())].bcube;
 	}
 
-	// Note: not thread safe due to static points
 	// return value: 0=no cont, 1=part, 2=attic, 3=ext basement, 4=roof access, 5=detail
 	int check_ped_coll(point const &pos, float bcube_radius, float detail_radius, unsigned plot_id, unsigned &building_id, cube_t *coll_cube) const {
 		if (empty()) return 0;
@@ -4419,7 +4498,7 @@ public:
 		vector<unsigned> const &bixes(bix_by_plot[plot_id]); // should be populated in gen()
 		if (bixes.empty()) return 0;
 		cube_t bcube; bcube.set_from_sphere(pos, bcube_radius);
-		static vector<point> points; // reused across calls
+		static thread_local vector<point> points; // reused across calls; called by peds in different cities in parallel
 
 		// Note: assumes buildings are separated so that only one ped collision can occur
 		for (auto b = bixes.begin(); b != bixes.end(); ++b) {
@@ -8,6 +8,7 @@
 #include "file_utils.h"
 #include "sinf.h"
 #include "mesh.h"
+#include "fnv_hash.h"
 
 using namespace std;
 
@@ -134,10 +135,7 @@ void heightmap_t::proc_gen() {
 
 	// run this using GPU compute?
 #pragma omp parallel for schedule(static,1)
-	for (int i = 0; i < height; ++i) {
-		int const off(width*i);
-		for (int j = 0; j < width; ++j) {vals[off + j] = height_gen.eval_index(j, i);}
-	}
+	for (int i = 0; i < height; ++i) {height_gen.eval_row(i, &vals[width*i]);}
 	run_erosion (vals);
 	run_city_gen(vals);
 	float min_z(0), max_z(0);
@@ -360,6 +358,7 @@ void terrain_hmap_manager_t::proc_gen_heightmap(unsigned size) {
 }
 
 void terrain_hmap_manager_t::post_load() {
+	data_hash = 0; // contents changed
 	if (!hmap_out_fn.empty()) {write_png(hmap_out_fn);}
 }
 
@@ -422,9 +421,15 @@ bool terrain_hmap_manager_t::read_and_apply_mod(string const &fn) {
 	if (!tex_mod_map_manager_t::read_mod(fn)) return 0;
 	apply_cur_mod_map();
 	apply_cur_brushes();
+	data_hash = 0; // contents changed
 	return 1;
 }
 
+uint64_t terrain_hmap_manager_t::get_data_hash() const {
+	if (data_hash == 0 && hmap.is_allocated()) {data_hash = calc_fnv_hash(hmap.get_data(), hmap.num_bytes());} // computed once per load
+	return data_hash;
+}
+
 void terrain_hmap_manager_t::apply_cur_mod_map() {
 	for (tex_mod_map_t::const_iterator i = mod_map.begin(); i != mod_map.end(); ++i) { // apply the mod to the current texture
 		assert(i->first.x < hmap.width && i->first.y < hmap.height); // ensure the mod values fit within the texture
@@ -111,6 +111,7 @@ public:
 class terrain_hmap_manager_t : public tex_mod_map_manager_t {
 
 	heightmap_t hmap;
+	mutable uint64_t data_hash=0; // 0 = not yet computed
 
 public:
 	void load(char const *const fn, bool invert_y=0);
@@ -139,6 +140,7 @@ public:
 	void apply_cur_mod_map();
 	void apply_cur_brushes();
 	bool enabled() const {return hmap.is_allocated();}
+	uint64_t get_data_hash() const; // includes load time mods, but not later brush edits
 	~terrain_hmap_manager_t() {hmap.free_data();}
 };
 
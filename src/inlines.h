@@ -758,6 +758,22 @@ template<typename T> void sort_and_unique(T &v) {
 	unique_cont(v);
 }
 
+// for containers that are nearly sorted from the previous call: insertion sort, falling back to std::sort if too many elements are out of order
+template<typename T, typename C> void adaptive_sort(T &v, C const &comp, unsigned max_moves_per_elem=4) {
+	size_t const max_moves(max_moves_per_elem*v.size() + 64);
+	size_t num_moves(0);
+
+	for (size_t i = 1; i < v.size(); ++i) {
+		if (!comp(v[i], v[i-1])) continue; // already in order
+		auto val(std::move(v[i]));
+		size_t j(i);
+		for (; j > 0 && comp(val, v[j-1]); --j) {v[j] = std::move(v[j-1]);}
+		v[j] = std::move(val);
+		num_moves += (i - j);
+		if (num_moves > max_moves) {std::sort(v.begin(), v.end(), comp); return;} // too many changes, do a full sort
+	}
+}
+
 template<typename T> void set_bit_flag_to(T &flags, unsigned mask, bool val) {
 	if (val) {flags |= mask;} else {flags &= ~mask;}
 }
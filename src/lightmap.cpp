@@ -9,6 +9,7 @@
 #include "binary_file_io.h"
 #include "profiler.h"
 #include <functional>
+#include <cfloat>
 
 using std::cerr;
 
@@ -206,20 +207,28 @@ void lmcell::set_outside_colors() {
 
 
 inline bool is_inside_lmap(int x, int y, int z) {return (z >= 0 && z < MESH_SIZE[2] && !point_outside_mesh(x, y));}
-bool lmap_manager_t::is_valid_cell(int x, int y, int z) const {return (is_inside_lmap(x, y, z) && vlmap[y][x] != NULL);}
+
+bool lmap_manager_t::is_valid_cell(int x, int y, int z) const {
+	if (!is_inside_lmap(x, y, z)) return 0;
+	return (is_compact() ? compact_data.has_column(x, y) : (vlmap[y][x] != NULL));
+}
 
 // Note: only intended to work in ground mode where sizes are MESH_X_SIZE and MESH_Y_SIZE
 lmcell *lmap_manager_t::get_lmcell_round_down(point const &p) { // round down
+	assert(!is_compact());
 	int const x(get_xpos_round_down(p.x)), y(get_ypos_round_down(p.y)), z(get_zpos(p.z));
 	return (is_valid_cell(x, y, z) ? &vlmap[y][x][z] : NULL);
 }
 lmcell *lmap_manager_t::get_lmcell(point const &p) { // round to center
+	assert(!is_compact());
 	int const x(get_xpos(p.x)), y(get_ypos(p.y)), z(get_zpos(p.z));
 	return (is_valid_cell(x, y, z) ? &vlmap[y][x][z] : NULL);
 }
 
 void lmap_manager_t::reset_all(lmcell const &init_lmcell) {
+	if (is_compact()) {expand(1);} // discard_values=1
 	for (auto i = vldata_alloc.begin(); i != vldata_alloc.end(); ++i) {*i = init_lmcell;}
+	for (unsigned i = 0; i < NUM_LIGHTING_TYPES; ++i) {partial_load[i] = 0;}
 }
 
 template<typename T> void lmap_manager_t::alloc(unsigned nbins, unsigned xsize, unsigned ysize, unsigned zsize, T **nonempty_bins, lmcell const &init_lmcell) {
@@ -251,6 +260,7 @@ void lmap_manager_t::init_from(lmap_manager_t const &src) {
 
 	//assert(!is_allocated());
 	//clear_cells(); // probably unnecessary
+	assert(!src.is_compact());
 	alloc(src.vldata_alloc.size(), src.lm_xsize, src.lm_ysize, src.lm_zsize, src.vlmap, lmcell());
 	copy_data(src);
 }
@@ -260,6 +270,7 @@ void lmap_manager_t::init_from(lmap_manager_t const &src) {
 void lmap_manager_t::copy_data(lmap_manager_t const &src, float blend_weight) {
 
 	assert(vlmap && src.vlmap);
+	assert(!is_compact() && !src.is_compact());
 	assert(src.lm_xsize == lm_xsize && src.lm_ysize == lm_ysize && src.lm_zsize == lm_zsize);
 	assert(src.vldata_alloc.size() == vldata_alloc.size());
 	assert(blend_weight >= 0.0);
@@ -282,6 +293,212 @@ void lmap_manager_t::copy_data(lmap_manager_t const &src, float blend_weight) {
 }
 
 
+// converts to compact storage; lighting can still be read through the const API, but must be expanded before it's modified;
+// this reduces memory between updates only: the dense array is freed here and fully reallocated by expand()
+void lmap_manager_t::compact() {
+
+	if (is_compact() || !is_allocated()) return;
+	compact_data.encode(vlmap, lm_xsize, lm_ysize, lm_zsize);
+	for (unsigned y = 0; y < lm_ysize; ++y) {for (unsigned x = 0; x < lm_xsize; ++x) {vlmap[y][x] = NULL;}} // no longer valid
+	vector<lmcell>().swap(vldata_alloc); // free the memory
+}
+
+// converts back to dense storage; if discard_values=1, the cells are default initialized rather than decoded
+void lmap_manager_t::expand(bool discard_values) {
+
+	if (!is_compact()) return;
+	unsigned nbins(0);
+
+	for (unsigned y = 0; y < lm_ysize; ++y) {
+		for (unsigned x = 0; x < lm_xsize; ++x) {nbins += (compact_data.has_column(x, y) ? lm_zsize : 0);}
+	}
+	vldata_alloc.resize(max(nbins, 1U));
+	unsigned cur_v(0);
+
+	for (unsigned y = 0; y < lm_ysize; ++y) {
+		for (unsigned x = 0; x < lm_xsize; ++x) {
+			if (!compact_data.has_column(x, y)) continue; // vlmap is already NULL
+			vlmap[y][x] = &vldata_alloc[cur_v];
+			if (!discard_values) {compact_data.decode_column(x, y, vlmap[y][x]);}
+			cur_v += lm_zsize;
+		}
+	}
+	assert(cur_v == nbins);
+	compact_data.clear();
+}
+
+lmcell const *lmap_manager_t::get_compact_column(int x, int y) const {
+	if (!compact_data.has_column(x, y)) return NULL;
+	static thread_local vector<lmcell> col;
+	col.resize(lm_zsize);
+	compact_data.decode_column(x, y, col.data());
+	return col.data();
+}
+
+
+// bfloat16: round to nearest even on the upper 16 bits of the float; lighting values are finite
+inline uint16_t float_to_bf16(float v) {
+	uint32_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	return uint16_t((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+}
+inline float bf16_to_float(uint16_t v) {
+	uint32_t const bits(uint32_t(v) << 16);
+	float ret;
+	memcpy(&ret, &bits, sizeof(ret));
+	return ret;
+}
+
+void lmap_brick_store_t::packed_cell_t::encode(lmcell const &c) {
+	float const *const fv(c.sc); // sc, sv, gc, gv, lc, smoke are contiguous floats
+	for (unsigned i = 0; i < 12; ++i) {vals[i] = float_to_bf16(fv[i]);}
+	UNROLL_3X(pflow[i_] = c.pflow[i_];)
+}
+bool lmap_brick_store_t::packed_cell_t::operator==(packed_cell_t const &c) const {
+	return (memcmp(this, &c, sizeof(packed_cell_t)) == 0); // pad is always 0
+}
+void lmap_brick_store_t::packed_cell_t::decode(lmcell &c) const {
+	float *const fv(c.sc);
+	for (unsigned i = 0; i < 12; ++i) {fv[i] = bf16_to_float(vals[i]);}
+	UNROLL_3X(c.pflow[i_] = pflow[i_];)
+}
+
+void lmap_brick_store_t::encode(lmcell const *const *const *vlmap, unsigned xsize_, unsigned ysize_, unsigned zsize_) {
+
+	static_assert(offsetof(lmcell, smoke) == 11*sizeof(float), "lmcell float layout");
+	clear();
+	xsize = xsize_; ysize = ysize_; zsize = zsize_;
+	nbx = (xsize + BSZ - 1)/BSZ; nby = (ysize + BSZ - 1)/BSZ; nbz = (zsize + BSZ - 1)/BSZ;
+	bricks.resize(nbx*nby*nbz, 0);
+	col_present.resize(xsize*ysize, 0);
+	packed_cell_t brick[BRICK_CELLS];
+
+	for (unsigned by = 0; by < nby; ++by) {
+		for (unsigned bx = 0; bx < nbx; ++bx) {
+			bool any_present(0);
+
+			for (unsigned y = by*BSZ; y < min(ysize, (by+1)*BSZ); ++y) {
+				for (unsigned x = bx*BSZ; x < min(xsize, (bx+1)*BSZ); ++x) {
+					col_present[y*xsize + x] = (vlmap[y][x] != NULL);
+					any_present |= (vlmap[y][x] != NULL);
+				}
+			}
+			if (!any_present) continue; // no data for this column of bricks
+			
+			for (unsigned bz = 0; bz < nbz; ++bz) {
+				bool first(1), uniform(1);
+
+				for (unsigned n = 0; n < BRICK_CELLS; ++n) {
+					unsigned const x(bx*BSZ + n%BSZ), y(by*BSZ + (n/BSZ)%BSZ), z(bz*BSZ + n/(BSZ*BSZ));
+					if (x >= xsize || y >= ysize || z >= zsize || vlmap[y][x] == NULL) continue; // unused cell, leave as default
+					brick[n].encode(vlmap[y][x][z]);
+					
+					if (first) {brick[0] = brick[n]; first = 0;} // copy to the first cell for the uniform test
+					else if (uniform) {uniform = (brick[n] == brick[0]);}
+				}
+				if (first) continue; // no cells
+				bricks[get_brick_ix(bx, by, bz)] = (cells.size() + 1) | (uniform ? UNIFORM_BIT : 0);
+				cells.insert(cells.end(), brick, (brick + (uniform ? 1 : BRICK_CELLS)));
+			} // for bz
+		} // for bx
+	} // for by
+	cells.shrink_to_fit();
+}
+
+void lmap_brick_store_t::decode_column(unsigned x, unsigned y, lmcell *col) const {
+
+	assert(x < xsize && y < ysize && col != nullptr);
+	unsigned const bx(x/BSZ), by(y/BSZ), cell_off((y%BSZ)*BSZ + x%BSZ);
+
+	for (unsigned bz = 0; bz < nbz; ++bz) {
+		unsigned const bval(bricks[get_brick_ix(bx, by, bz)]), z1(bz*BSZ), z2(min(zsize, z1+BSZ));
+		assert(bval != 0); // must be present if the column is present
+		unsigned const cix((bval & ~UNIFORM_BIT) - 1);
+
+		if (bval & UNIFORM_BIT) {
+			cells[cix].decode(col[z1]);
+			for (unsigned z = z1+1; z < z2; ++z) {col[z] = col[z1];}
+		}
+		else {
+			for (unsigned z = z1; z < z2; ++z) {cells[cix + (z - z1)*BSZ*BSZ + cell_off].decode(col[z]);}
+		}
+	}
+}
+
+void lmap_brick_store_t::clear() {
+	xsize = ysize = zsize = nbx = nby = nbz = 0;
+	bricks.clear();
+	cells.clear();
+	col_present.clear();
+}
+
+
+double const LMAP_ACCUM_FIXED_SCALE = double(1ULL << 36); // ~1.5E-11 resolution, +/-1.3E8 range
+thread_local lmap_accum_t *lmap_accum_t::cur_accum(nullptr);
+
+void lmap_accum_t::begin(lmap_manager_t *lmgr_) { // sets this as the accumulator for the current thread
+	assert(lmgr_ && lmgr_->is_allocated());
+	assert(cur_accum == nullptr); // no nesting
+	if (lmgr != lmgr_) {clear(); lmgr = lmgr_;}
+	cur_accum = this;
+}
+
+lmap_accum_t::tile_t &lmap_accum_t::get_tile(unsigned cell_ix, int ltype) {
+	assert(ltype >= 0 && ltype < LIGHTING_DYNAMIC);
+	vector<unsigned> &ixs(tile_ixs[ltype]);
+	if (ixs.empty()) {ixs.resize((lmgr->size() + TILE_CELLS - 1)/TILE_CELLS, 0);} // only the index is dense
+	unsigned const tix(cell_ix/TILE_CELLS);
+	assert(tix < ixs.size());
+	
+	if (ixs[tix] == 0) { // first contribution to this tile
+		tiles.emplace_back(tix*TILE_CELLS, ltype);
+		ixs[tix] = tiles.size();
+	}
+	return tiles[ixs[tix]-1];
+}
+
+void lmap_accum_t::add(lmcell const &lmc, int ltype, colorRGBA const &cw, float weight) {
+	unsigned const cell_ix(lmgr->get_cell_ix(&lmc));
+	int64_t *vals(get_tile(cell_ix, ltype).vals[cell_ix % TILE_CELLS]);
+	UNROLL_3X(vals[i_] += llrint(double(cw[i_])*LMAP_ACCUM_FIXED_SCALE);)
+	if (ltype != LIGHTING_LOCAL) {vals[3] += llrint(double(weight)*LMAP_ACCUM_FIXED_SCALE);} // same as add_path_to_lmcs()
+}
+
+void lmap_accum_t::merge(lmap_accum_t const &a) {
+	if (a.tiles.empty()) return;
+	assert(lmgr == nullptr || lmgr == a.lmgr);
+	lmgr = a.lmgr;
+
+	for (tile_t const &t : a.tiles) {
+		tile_t &dest(get_tile(t.start_cell, t.ltype));
+		for (unsigned n = 0; n < TILE_CELLS; ++n) {UNROLL_4X(dest.vals[n][i_] += t.vals[n][i_];)}
+	}
+}
+
+void lmap_accum_t::apply_and_clear() { // each cell is modified once per tile with the final sum, so the result is independent of tile order
+	if (tiles.empty()) return;
+	assert(lmgr);
+
+	for (tile_t const &t : tiles) {
+		unsigned const num(min(TILE_CELLS, unsigned(lmgr->size() - t.start_cell))), dsz(lmcell::get_dsz(t.ltype));
+
+		for (unsigned n = 0; n < num; ++n) {
+			int64_t const *vals(t.vals[n]);
+			if (vals[0] == 0 && vals[1] == 0 && vals[2] == 0 && vals[3] == 0) continue; // not touched
+			float *color(lmgr->get_cell_by_ix(t.start_cell + n).get_offset(t.ltype));
+			for (unsigned d = 0; d < dsz; ++d) {color[d] += float(vals[d]/LMAP_ACCUM_FIXED_SCALE);}
+		}
+	}
+	lmgr->was_updated = 1;
+	clear();
+}
+
+void lmap_accum_t::clear() {
+	for (unsigned i = 0; i < LIGHTING_DYNAMIC; ++i) {tile_ixs[i].clear();}
+	tiles.clear();
+}
+
+
 // *this = val*lmc + (1.0 - val)*(*this)
 void lmcell::mix_lighting_with(lmcell const &lmc, float val) {
 
@@ -309,15 +526,72 @@ void light_volume_local::allocate() {
 }
 
 void light_volume_local::add_color(point const &p, colorRGBA const &color) { // inlined in the header?
+	add_color(get_xpos_round_down(p.x), get_ypos_round_down(p.y), get_zpos(p.z), color);
+}
+
+void light_volume_local::add_color(int x, int y, int z, colorRGBA const &color) {
 
 	assert(!compressed); // compressed is read only
-	int const ix(check_lmap_get_grid_index(p));
-	if (ix < 0) return; // if the global lightmap doesn't have this cell, the local lmap shouldn't need it
-	assert((unsigned)ix < data.size());
+	if (!lmap_manager.is_valid_cell(x, y, z)) return; // if the global lightmap doesn't have this cell, the local lmap shouldn't need it
+	unsigned const ix(get_ix(x, y, z));
+	assert(ix < data.size());
 	UNROLL_3X(data[ix].lc[i_] += color[i_]*color.alpha;)
 	changed = 1;
 }
 
+
+// exact 3D DDA traversal of the lightmap grid (ground mode sizes): appends each cell crossed by the line p1 => p2 once, in order, with the length inside it;
+// the line is first clipped to the grid bounds so that long sky rays don't walk through empty space
+void get_lmap_grid_segs(point const &p1, point const &p2, vector<lmap_grid_seg_t> &segs) {
+
+	segs.clear();
+	float const dist(p2p_dist(p1, p2));
+	if (dist == 0.0) return; // zero length, no contribution
+	float const scale[3] = {DX_VAL_INV, DY_VAL_INV, DZ_VAL_INV2}, offset[3] = {X_SCENE_SIZE, Y_SCENE_SIZE, -czmin};
+	int const gsz[3] = {MESH_X_SIZE, MESH_Y_SIZE, MESH_SIZE[2]};
+	float a[3], delta[3], t0(0.0), t1(1.0);
+
+	for (unsigned d = 0; d < 3; ++d) { // transform to grid space and clip to the grid bounds
+		a[d] = (p1[d] + offset[d])*scale[d];
+		delta[d] = (p2[d] + offset[d])*scale[d] - a[d];
+
+		if (delta[d] == 0.0) {
+			if (a[d] < 0.0 || a[d] >= gsz[d]) return; // parallel to and outside the grid
+			continue;
+		}
+		float const inv_delta(1.0/delta[d]);
+		float ta(-a[d]*inv_delta), tb((gsz[d] - a[d])*inv_delta);
+		if (ta > tb) {swap(ta, tb);}
+		max_eq(t0, ta);
+		min_eq(t1, tb);
+	}
+	if (t0 >= t1) return; // outside the grid
+	int cell[3], step[3];
+	float tmax[3], tdelta[3];
+
+	for (unsigned d = 0; d < 3; ++d) {
+		float const start(a[d] + t0*delta[d]);
+		cell[d] = max(0, min(gsz[d]-1, int(floor(start)))); // clamp in case of FP error at the boundary
+
+		if (delta[d] == 0.0) {step[d] = 0; tmax[d] = tdelta[d] = FLT_MAX; continue;}
+		step  [d] = ((delta[d] > 0.0) ? 1 : -1);
+		tdelta[d] = fabs(1.0/delta[d]);
+		tmax  [d] = t0 + ((delta[d] > 0.0) ? (cell[d] + 1 - start) : (start - cell[d]))*tdelta[d];
+	}
+	float t(t0);
+
+	while (1) {
+		unsigned const d((tmax[0] < tmax[1]) ? ((tmax[0] < tmax[2]) ? 0 : 2) : ((tmax[1] < tmax[2]) ? 1 : 2)); // closest cell boundary
+		float const tn(min(tmax[d], t1));
+		if (tn > t) {segs.emplace_back(cell[0], cell[1], cell[2], (tn - t)*dist);}
+		if (tn >= t1) break; // reached the end of the clipped segment
+		t        = tn;
+		cell[d] += step[d];
+		if (cell[d] < 0 || cell[d] >= gsz[d]) break; // exited the grid (FP error)
+		tmax[d] += tdelta[d];
+	}
+}
+
 void light_volume_local::add_lighting(colorRGB &color, int x, int y, int z) const {
 
 	//if (!is_active()) return; // not yet allocated - caller should check this
@@ -44,36 +44,110 @@ struct lmcell { // size = 52
 };
 
 
+// read-only compact lmcell storage: sparse 4x4x4 bricks of 16-bit floats (bfloat16: float32 range, 8 bit mantissa, enough for 8-bit lighting textures)
+// with a single cell for uniform bricks; bricks where all columns are empty aren't stored;
+// Note: this only reduces memory while the data isn't being modified; it's used for the building indir lighting volume once its lights are stable,
+// which must be expanded back to dense storage before more lights are traced, so peak memory is unchanged; the global scene lightmap is always dense
+class lmap_brick_store_t {
+	static unsigned const BSZ = 4, BRICK_CELLS = BSZ*BSZ*BSZ, UNIFORM_BIT = (1U << 31);
+
+	struct packed_cell_t { // size = 28
+		uint16_t vals[12]; // sc[3], sv, gc[3], gv, lc[3], smoke
+		unsigned char pflow[3], pad=0;
+		void encode(lmcell const &c);
+		void decode(lmcell &c) const;
+		bool operator==(packed_cell_t const &c) const;
+	};
+	unsigned xsize=0, ysize=0, zsize=0, nbx=0, nby=0, nbz=0;
+	vector<unsigned> bricks; // per brick: 0 = no data, else (cells index + 1) | UNIFORM_BIT if uniform
+	vector<packed_cell_t> cells;
+	vector<uint8_t> col_present; // per column, matches NULL columns of the source
+
+	unsigned get_brick_ix(unsigned bx, unsigned by, unsigned bz) const {return ((by*nbx + bx)*nbz + bz);}
+public:
+	bool empty() const {return col_present.empty();}
+	size_t get_mem_usage() const {return (bricks.size()*sizeof(unsigned) + cells.size()*sizeof(packed_cell_t) + col_present.size());}
+	bool has_column(unsigned x, unsigned y) const {return col_present[y*xsize + x];}
+	void encode(lmcell const *const *const *vlmap, unsigned xsize_, unsigned ysize_, unsigned zsize_);
+	void decode_column(unsigned x, unsigned y, lmcell *col) const;
+	void clear();
+};
+
+
+struct binary_file_reader;
+
 class lmap_manager_t {
 
 	vector<lmcell> vldata_alloc;
 	unsigned lm_xsize, lm_ysize, lm_zsize;
 	lmcell ***vlmap; // y, x, z (size is determined by {MESH_Y_SIZE, MESH_X_SIZE, MESH_Z_SIZE}
+	lmap_brick_store_t compact_data; // used in place of vldata_alloc when compacted
+	bool partial_load[NUM_LIGHTING_TYPES]={}; // set when only part of the file was read for this ltype; writing this ltype is then disallowed
 
 	lmap_manager_t(lmap_manager_t const &) = delete; // forbidden
 	void operator=(lmap_manager_t const &) = delete; // forbidden
+	bool read_chunked_data(binary_file_reader &reader, char const *const fn, int ltype, cube_t const *const load_bounds);
+	bool write_chunked_data(char const *const fn, int ltype) const;
 
 public:
 	bool was_updated;
 	cube_t update_bcube;
 
 	lmap_manager_t() : lm_xsize(0), lm_ysize(0), lm_zsize(0), vlmap(NULL), was_updated(0) {update_bcube.set_to_zeros();}
-	void clear_cells() {vldata_alloc.clear();} // vlmap matrix headers are not cleared
-	bool is_allocated() const {return (vlmap != NULL && !vldata_alloc.empty());}
+	void clear_cells() {vldata_alloc.clear(); compact_data.clear();} // vlmap matrix headers are not cleared
+	bool is_allocated() const {return (vlmap != NULL && (!vldata_alloc.empty() || is_compact()));}
+	bool is_compact  () const {return !compact_data.empty();}
 	size_t size() const {return vldata_alloc.size();}
-	bool read_data_from_file(char const *const fn, int ltype);
+	bool read_data_from_file(char const *const fn, int ltype, cube_t const *const load_bounds=nullptr); // load_bounds is in scene coords
 	bool write_data_to_file(char const *const fn, int ltype) const;
 	void clear_lighting_values(int ltype);
 	bool is_valid_cell(int x, int y, int z) const;
-	lmcell const *get_column(int x, int y) const {return vlmap[y][x];} // Note: no bounds checking
-	lmcell *get_column(int x, int y) {return vlmap[y][x];} // Note: no bounds checking
+	// Note: when compacted, the const version returns a decoded copy that's valid until the next call on this thread
+	lmcell const *get_column(int x, int y) const {return (is_compact() ? get_compact_column(x, y) : vlmap[y][x]);} // Note: no bounds checking
+	lmcell *get_column(int x, int y) {assert(!is_compact()); return vlmap[y][x];} // Note: no bounds checking
 	lmcell &get_lmcell(int x, int y, int z) {return get_column(x, y)[z];} // Note: no bounds checking
+	lmcell const *get_compact_column(int x, int y) const;
 	lmcell *get_lmcell_round_down(point const &p);
 	lmcell *get_lmcell(point const &p);
+	lmcell *get_lmcell_checked(int x, int y, int z) {assert(!is_compact()); return (is_valid_cell(x, y, z) ? &vlmap[y][x][z] : NULL);}
+	unsigned get_cell_ix(lmcell const *lmc) const {assert(lmc >= vldata_alloc.data() && lmc < vldata_alloc.data()+vldata_alloc.size()); return unsigned(lmc - vldata_alloc.data());}
+	lmcell &get_cell_by_ix(unsigned ix) {assert(ix < vldata_alloc.size()); return vldata_alloc[ix];}
 	void reset_all(lmcell const &init_lmcell=lmcell());
 	template<typename T> void alloc(unsigned nbins, unsigned xsize, unsigned ysize, unsigned zsize, T **nonempty_bins, lmcell const &init_lmcell);
 	void init_from(lmap_manager_t const &src);
 	void copy_data(lmap_manager_t const &src, float blend_weight=1.0);
+	void compact();
+	void expand(bool discard_values=0);
+};
+
+
+// per-thread accumulation of ray lighting contributions into sparse tiles of fixed point values, which are reduced into the lmap_manager_t
+// at the end of a job; integer adds are associative, so results don't depend on scheduling or reduction order, and there are no lost updates;
+// Note: results are only deterministic for a fixed thread count, since launch_threaded_job() seeds each thread's rgen by thread index and splits rays by thread
+class lmap_accum_t {
+	static unsigned const TILE_CELLS = 64; // consecutive lmcells in lmap_manager_t storage
+	struct tile_t {
+		unsigned start_cell;
+		int ltype;
+		int64_t vals[TILE_CELLS][4]; // RGB + weight
+		tile_t(unsigned sc, int lt) : start_cell(sc), ltype(lt), vals{} {}
+	};
+	lmap_manager_t *lmgr=nullptr;
+	vector<unsigned> tile_ixs[LIGHTING_DYNAMIC]; // per ltype: tile index+1 per group of TILE_CELLS cells, or 0 if not touched
+	vector<tile_t> tiles;
+	static thread_local lmap_accum_t *cur_accum;
+
+	tile_t &get_tile(unsigned cell_ix, int ltype);
+public:
+	void begin(lmap_manager_t *lmgr_);
+	void end() {assert(cur_accum == this); cur_accum = nullptr;}
+	void add(lmcell const &lmc, int ltype, colorRGBA const &cw, float weight);
+	void merge(lmap_accum_t const &a);
+	void apply_and_clear();
+	void clear();
+	bool empty() const {return tiles.empty();}
+	// returns the accumulator for the current thread if it's accumulating into this lmgr, otherwise nullptr
+	static lmap_accum_t *get_cur_for(lmap_manager_t const *lmgr_) {return ((cur_accum && cur_accum->lmgr == lmgr_) ? cur_accum : nullptr);}
 };
 
 
@@ -118,6 +192,7 @@ public:
 	bool check_xy_bounds(int x, int y) const {return (x >= bounds[0][0] && x < bounds[0][1] && y >= bounds[1][0] && y < bounds[1][1]);}
 	void add_lighting(colorRGB &color, int x, int y, int z) const;
 	void add_color(point const &p, colorRGBA const &color);
+	void add_color(int x, int y, int z, colorRGBA const &color);
 };
 
 typedef vector<std::unique_ptr<light_volume_local>> llv_vect;
@@ -331,11 +406,19 @@ public:
 };
 
 
+struct lmap_grid_seg_t { // one lightmap cell crossed by a line segment
+	int x, y, z;
+	float len; // length of the part of the segment inside this cell
+	lmap_grid_seg_t(int x_, int y_, int z_, float len_) : x(x_), y(y_), z(z_), len(len_) {}
+};
+
+
 // from ray_trace.cpp
 void check_for_lighting_finished();
 void compute_ray_trace_lighting(unsigned ltype, bool verbose);
 unsigned add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point const &p2, float weight, colorRGBA const &color, int ltype, bool first_pt);
 // from lightmap.cpp
+void get_lmap_grid_segs(point const &p1, point const &p2, vector<lmap_grid_seg_t> &segs);
 void update_indir_light_tex_range(lmap_manager_t const &lmap, vector<unsigned char> &tex_data,
 	unsigned xsize, unsigned y1, unsigned y2, unsigned zsize, float lighting_exponent=1.0, bool local_only=0, bool mt=0);
 void indir_light_tex_from_lmap(unsigned &tid, lmap_manager_t const &lmap, vector<unsigned char> &tex_data,
@@ -21,7 +21,7 @@ class compute_shader_comp_t;
 
 class mesh_xy_grid_cache_t {
 
-	vector<float> xyterms, sine_mag_terms, cached_vals;
+	vector<float> xyterms, xterms_by_freq, sine_mag_terms, cached_vals; // xterms_by_freq is {freq, x} order for row evaluation
 	unsigned cur_nx, cur_ny, yterms_start, tid;
 	float mx0, my0, mdx, mdy, sine_offset;
 	int gen_mode, gen_shape;
@@ -34,6 +34,7 @@ class mesh_xy_grid_cache_t {
 
 	void run_gpu_simplex();
 	void cache_gpu_simplex_vals();
+	void apply_glaciate_terms(float &zval, unsigned x, unsigned y) const;
 
 public:
 	mesh_xy_grid_cache_t() : cur_nx(0), cur_ny(0), yterms_start(0), tid(0), mx0(0.0), my0(0.0), mdx(0.0), mdy(0.0), sine_offset(0.0),
@@ -42,6 +43,7 @@ public:
 	bool build_arrays(float x0, float y0, float dx, float dy, unsigned nx, unsigned ny, bool cache_values=0, bool force_sine_mode=0, bool no_wait=0);
 	void enable_glaciate();
 	float eval_index(unsigned x, unsigned y, int min_start_sin=0, bool use_cache=1) const;
+	void eval_row(unsigned y, float *zvals, int min_start_sin=0, bool use_cache=1) const; // fills in cur_nx values; matches eval_index()
 	void clear_context();
 	void free_cshader();
 };
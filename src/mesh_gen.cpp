@@ -10,6 +10,9 @@
 #include "shaders.h"
 #include "gl_ext_arb.h"
 #include <glm/gtc/noise.hpp>
+#if defined(__AVX__) || defined(__SSE4_1__)
+#include <immintrin.h> // for batched simplex noise
+#endif
 
 
 int      const NUM_FREQ_COMP      = 9;
@@ -205,9 +208,7 @@ void gen_mesh_sine_table(float **matrix, int x_offset, int y_offset, int xsize,
 	mesh_xy_grid_cache_t height_gen;
 	height_gen.build_arrays(float(x_offset - xsize/2)*DX_VAL, float(y_offset - ysize/2)*DY_VAL, DX_VAL, DY_VAL, xsize, ysize);
 
-	for (int i = 0; i < ysize; ++i) {
-		for (int j = 0; j < xsize; ++j) {matrix[i][j] = height_gen.eval_index(j, i);}
-	}
+	for (int i = 0; i < ysize; ++i) {height_gen.eval_row(i, matrix[i]);}
 }
 
 
@@ -607,18 +608,19 @@ bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 	}
 	yterms_start = nx*F_TABLE_SIZE;
 	xyterms.resize((nx + ny)*F_TABLE_SIZE, 0.0);
+	xterms_by_freq.resize(nx*F_TABLE_SIZE, 0.0);
 	float const msx(mesh_scale*DX_VAL_INV), msy(mesh_scale*DY_VAL_INV), ms2(0.5*mesh_scale);
 
 	for (int k = start_eval_sin; k < F_TABLE_SIZE; ++k) {
 		float const x_mult(msx*sinTable[k][4]), y_mult(msy*sinTable[k][3]), y_scale(mesh_scale_z_inv*sinTable[k][0]);
 		float const x_const(ms2*sinTable[k][4] + sinTable[k][2] + x_mult*x0), y_const(ms2*sinTable[k][3] + sinTable[k][1] + y_mult*y0);
 		float const xmdx(x_mult*dx), ymdy(y_mult*dy);
-		float *x_ptr(xyterms.data() + k), *y_ptr(x_ptr + yterms_start);
+		float *x_ptr(xyterms.data() + k), *y_ptr(x_ptr + yterms_start), *xf_ptr(xterms_by_freq.data() + k*nx);
 
 		for (unsigned i = 0; i < nx; ++i) {
 			float sin_val(SINF(xmdx*i + x_const));
 			//apply_noise_shape_per_term(sin_val, gen_shape);
-			x_ptr[i*F_TABLE_SIZE] = sin_val;
+			x_ptr[i*F_TABLE_SIZE] = xf_ptr[i] = sin_val;
 		}
 		for (unsigned i = 0; i < ny; ++i) {
 			float sin_val(SINF(ymdy*i + y_const));
@@ -631,9 +633,7 @@ bool mesh_xy_grid_cache_t::build_arrays(float x0, float y0, float dx, float dy,
 		
 #pragma omp parallel for schedule(static,1)
 		for (int y = 0; y < (int)cur_ny; ++y) {
-			for (unsigned x = 0; x < cur_nx; ++x) {
-				cached_vals[y*cur_nx + x] = eval_index(x, y, 0, 0); // Note: no glaciate, min_start_sin=0, use_cache=0
-			}
+			eval_row(y, &cached_vals[y*cur_nx], 0, 0); // Note: no glaciate, min_start_sin=0, use_cache=0
 		}
 	}
 	return 1; // results are available
@@ -754,6 +754,146 @@ float get_noise_zval(float xval, float yval, int mode, int shape) {
 }
 
 
+// SIMD version of glm::simplex(vec2) for W points at once; uses the same operations in the same order,
+// so results are bit identical unless the compiler contracts the scalar version into FMAs
+#if defined(__AVX__)
+struct simd_ops_avx {
+	typedef __m256 vt;
+	static unsigned const W = 8;
+	static vt set1 (float v)             {return _mm256_set1_ps(v);}
+	static vt load (float const *p)      {return _mm256_loadu_ps(p);}
+	static void store(float *p, vt v)    {_mm256_storeu_ps(p, v);}
+	static vt add  (vt a, vt b)          {return _mm256_add_ps(a, b);}
+	static vt sub  (vt a, vt b)          {return _mm256_sub_ps(a, b);}
+	static vt mul  (vt a, vt b)          {return _mm256_mul_ps(a, b);}
+	static vt div  (vt a, vt b)          {return _mm256_div_ps(a, b);}
+	static vt floor(vt a)                {return _mm256_floor_ps(a);}
+	static vt max  (vt a, vt b)          {return _mm256_max_ps(a, b);}
+	static vt abs  (vt a)                {return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);}
+	static vt select_gt(vt a, vt b, vt t, vt f) {return _mm256_blendv_ps(f, t, _mm256_cmp_ps(a, b, _CMP_GT_OQ));} // (a > b) ? t : f
+};
+#endif
+#if defined(__SSE4_1__)
+struct simd_ops_sse4 {
+	typedef __m128 vt;
+	static unsigned const W = 4;
+	static vt set1 (float v)             {return _mm_set1_ps(v);}
+	static vt load (float const *p)      {return _mm_loadu_ps(p);}
+	static void store(float *p, vt v)    {_mm_storeu_ps(p, v);}
+	static vt add  (vt a, vt b)          {return _mm_add_ps(a, b);}
+	static vt sub  (vt a, vt b)          {return _mm_sub_ps(a, b);}
+	static vt mul  (vt a, vt b)          {return _mm_mul_ps(a, b);}
+	static vt div  (vt a, vt b)          {return _mm_div_ps(a, b);}
+	static vt floor(vt a)                {return _mm_floor_ps(a);}
+	static vt max  (vt a, vt b)          {return _mm_max_ps(a, b);}
+	static vt abs  (vt a)                {return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);}
+	static vt select_gt(vt a, vt b, vt t, vt f) {return _mm_blendv_ps(f, t, _mm_cmpgt_ps(a, b));} // (a > b) ? t : f
+};
+#endif
+
+template<typename S> void simplex_noise_2d_simd(float const *px, float const *py, float *out) {
+
+	typedef typename S::vt vt;
+	vt const C0(S::set1(0.211324865405187f)), C1(S::set1(0.366025403784439f)), C2(S::set1(-0.577350269189626f)), C3(S::set1(0.024390243902439f));
+	vt const zero(S::set1(0.0f)), half(S::set1(0.5f)), one(S::set1(1.0f)), two(S::set1(2.0f)), v34(S::set1(34.0f)), v289(S::set1(289.0f)), inv289(S::set1(1.0f/289.0f));
+	vt const x(S::load(px)), y(S::load(py));
+	// first corner
+	vt const s(S::add(S::mul(x, C1), S::mul(y, C1)));
+	vt const ix(S::floor(S::add(x, s))), iy(S::floor(S::add(y, s)));
+	vt const t(S::add(S::mul(ix, C0), S::mul(iy, C0)));
+	vt const x0x(S::add(S::sub(x, ix), t)), x0y(S::add(S::sub(y, iy), t));
+	// other corners
+	vt const i1x(S::select_gt(x0x, x0y, one, zero)), i1y(S::sub(one, i1x));
+	vt const x1x(S::sub(S::add(x0x, C0), i1x)), x1y(S::sub(S::add(x0y, C0), i1y)), x2x(S::add(x0x, C2)), x2y(S::add(x0y, C2));
+	// permutations
+	vt const imx(S::sub(ix, S::mul(v289, S::floor(S::div(ix, v289))))), imy(S::sub(iy, S::mul(v289, S::floor(S::div(iy, v289)))));
+	auto permute = [&](vt v) {vt const a(S::mul(S::add(S::mul(v, v34), one), v)); return S::sub(a, S::mul(S::floor(S::mul(a, inv289)), v289));};
+	auto corner  = [&](vt i1x_, vt i1y_, vt xx, vt xy) { // returns the contribution of one corner
+		vt const p(permute(S::add(S::add(permute(S::add(imy, i1y_)), imx), i1x_)));
+		vt m(S::max(S::sub(half, S::add(S::mul(xx, xx), S::mul(xy, xy))), zero));
+		m = S::mul(m, m);
+		m = S::mul(m, m);
+		vt const pc(S::mul(p, C3)), gx(S::sub(S::mul(two, S::sub(pc, S::floor(pc))), one));
+		vt const h(S::sub(S::abs(gx), half)), a0(S::sub(gx, S::floor(S::add(gx, half))));
+		m = S::mul(m, S::sub(S::set1(1.79284291400159f), S::mul(S::set1(0.85373472095314f), S::add(S::mul(a0, a0), S::mul(h, h)))));
+		return S::mul(m, S::add(S::mul(a0, xx), S::mul(h, xy)));
+	};
+	vt const n0(corner(zero, zero, x0x, x0y)), n1(corner(i1x, i1y, x1x, x1y)), n2(corner(one, one, x2x, x2y));
+	S::store(out, S::mul(S::set1(130.0f), S::add(S::add(n0, n1), n2)));
+}
+
+void simplex_noise_2d_batch(float const *px, float const *py, unsigned num, float *out) {
+
+	unsigned i(0);
+#if defined(__AVX__)
+	for (; i + simd_ops_avx::W <= num; i += simd_ops_avx::W) {simplex_noise_2d_simd<simd_ops_avx>(px+i, py+i, out+i);}
+#endif
+#if defined(__SSE4_1__)
+	for (; i + simd_ops_sse4::W <= num; i += simd_ops_sse4::W) {simplex_noise_2d_simd<simd_ops_sse4>(px+i, py+i, out+i);}
+#endif
+	for (; i < num; ++i) {out[i] = glm::simplex(glm::vec2(px[i], py[i]));} // scalar reference/remainder
+}
+
+// batched version of gen_noise() for num points; rx/ry are computed once rather than per point
+void gen_noise_batch(float const *xv, float const *yv, unsigned num, float *zvals, int mode, int shape) {
+
+	float mag(1.0), freq(1.0), rx, ry;
+	unsigned const end_octave(NUM_FREQ_COMP - start_eval_sin/N_RAND_SIN2);
+	float const lacunarity(1.92), gain(0.5);
+	bool const is_simplex(mode == MGEN_SIMPLEX || mode == MGEN_SIMPLEX_GPU || mode == MGEN_DWARP_GPU);
+	gen_rx_ry(rx, ry);
+	vector<float> px(num), py(num), noise(num);
+	for (unsigned n = 0; n < num; ++n) {zvals[n] = 0.0;}
+
+	for (unsigned i = 0; i < end_octave; ++i) {
+		for (unsigned n = 0; n < num; ++n) {px[n] = (freq*xv[n] + rx); py[n] = (freq*yv[n] + ry);}
+
+		if (is_simplex) {simplex_noise_2d_batch(px.data(), py.data(), num, noise.data());}
+		else {
+			for (unsigned n = 0; n < num; ++n) {noise[n] = glm::perlin(glm::vec2(px[n], py[n]));}
+		}
+		switch (shape) {
+		case 0: break; // linear - do nothing
+		case 1: for (unsigned n = 0; n < num; ++n) {noise[n] = fabs(noise[n]) - 0.40;} break; // billowy
+		case 2: for (unsigned n = 0; n < num; ++n) {noise[n] = 0.45 - fabs(noise[n]);} break; // ridged
+		}
+		for (unsigned n = 0; n < num; ++n) {zvals[n] += mag*noise[n];}
+		mag  *= gain;
+		freq *= lacunarity;
+		rx   *= 1.5;
+		ry   *= 1.5;
+	}
+}
+
+// batched version of get_noise_zval() for num points
+void get_noise_zvals(float const *xvals, float const *yvals, unsigned num, float *zvals, int mode, int shape) {
+
+	assert(mode != MGEN_SINE); // mode 0 not supported by this function
+	float const xy_scale(MESH_SCALE_FACTOR*mesh_scale), zscale(get_hmap_scale(mode));
+	vector<float> xv(num), yv(num);
+	for (unsigned n = 0; n < num; ++n) {xv[n] = xy_scale*xvals[n]; yv[n] = xy_scale*yvals[n];}
+
+	if (mode == MGEN_DWARP_GPU) { // domain warping
+		float const scale(0.2);
+		vector<float> dx1(num), dy1(num), dx2(num), dy2(num), wx(num), wy(num);
+		gen_noise_batch(xv.data(), yv.data(), num, dx1.data(), mode, shape); // xv+0.0, yv+0.0
+		for (unsigned n = 0; n < num; ++n) {wx[n] = xv[n]+5.2; wy[n] = yv[n]+1.3;}
+		gen_noise_batch(wx.data(), wy.data(), num, dy1.data(), mode, shape);
+		for (unsigned n = 0; n < num; ++n) {wx[n] = (xv[n] + scale*dx1[n] + 1.7); wy[n] = (yv[n] + scale*dy1[n] + 9.2);}
+		gen_noise_batch(wx.data(), wy.data(), num, dx2.data(), mode, shape);
+		for (unsigned n = 0; n < num; ++n) {wx[n] = (xv[n] + scale*dx1[n] + 8.3); wy[n] = (yv[n] + scale*dy1[n] + 2.8);}
+		gen_noise_batch(wx.data(), wy.data(), num, dy2.data(), mode, shape);
+		for (unsigned n = 0; n < num; ++n) {xv[n] += scale*dx2[n]; yv[n] += scale*dy2[n];}
+	}
+	gen_noise_batch(xv.data(), yv.data(), num, zvals, mode, shape);
+
+	for (unsigned n = 0; n < num; ++n) {
+		postproc_noise_zval(zvals[n]);
+		zvals[n] *= zscale;
+	}
+}
+
+
 float mesh_xy_grid_cache_t::eval_index(unsigned x, unsigned y, int min_start_sin, bool use_cache) const {
 
 	assert(x < cur_nx && y < cur_ny);
@@ -782,16 +922,49 @@ float mesh_xy_grid_cache_t::eval_index(unsigned x, unsigned y, int min_start_sin
 		}
 		apply_noise_shape_final(zval, gen_shape);
 	}
-	if (do_glaciate) {
-		apply_glaciate(zval);
-		
-		if (hmap_params.sine_mag > 0.0) {
-			assert(cur_nx + y < sine_mag_terms.size());
-			zval += sine_mag_terms[x]*sine_mag_terms[cur_nx + y] + sine_offset;
-			if (hmap_params.volcano_width > 0.0 && hmap_params.volcano_height > 0.0) {zval += get_volcano_height((x*mdx + mx0)*DX_VAL_INV, (y*mdy + my0)*DY_VAL_INV);}
+	if (do_glaciate) {apply_glaciate_terms(zval, x, y);}
+	return zval;
+}
+
+// evaluates an entire row of cur_nx values, using batched noise or a loop over x per sine term that the compiler can vectorize
+void mesh_xy_grid_cache_t::eval_row(unsigned y, float *zvals, int min_start_sin, bool use_cache) const {
+
+	assert(y < cur_ny);
+	assert(zvals != nullptr);
+
+	if ((use_cache || gen_mode >= MGEN_SIMPLEX_GPU) && !cached_vals.empty()) {
+		for (unsigned x = 0; x < cur_nx; ++x) {zvals[x] = cached_vals[y*cur_nx + x];}
+	}
+	else if (gen_mode != MGEN_SINE) { // perlin/simplex
+		vector<float> xvals(cur_nx), yvals(cur_nx, (y*mdy + my0)*DY_VAL_INV);
+		for (unsigned x = 0; x < cur_nx; ++x) {xvals[x] = (x*mdx + mx0)*DX_VAL_INV;}
+		get_noise_zvals(xvals.data(), yvals.data(), cur_nx, zvals, gen_mode, gen_shape);
+	}
+	else { // sine tables
+		float const *const yptr(xyterms.data() + yterms_start + y*F_TABLE_SIZE);
+		int const start_ix(max(start_eval_sin, min_start_sin));
+		for (unsigned x = 0; x < cur_nx; ++x) {zvals[x] = 0.0;}
+
+		// performance critical; each zval sums its terms in the same order as eval_index()
+		for (int i = start_ix; i < F_TABLE_SIZE; ++i) {
+			float const *const xptr(xterms_by_freq.data() + i*cur_nx);
+			float const yterm(yptr[i]);
+			for (unsigned x = 0; x < cur_nx; ++x) {zvals[x] += xptr[x]*yterm;}
 		}
+		for (unsigned x = 0; x < cur_nx; ++x) {apply_noise_shape_final(zvals[x], gen_shape);}
 	}
-	return zval;
+	if (do_glaciate) {
+		for (unsigned x = 0; x < cur_nx; ++x) {apply_glaciate_terms(zvals[x], x, y);}
+	}
+}
+
+void mesh_xy_grid_cache_t::apply_glaciate_terms(float &zval, unsigned x, unsigned y) const {
+
+	apply_glaciate(zval);
+	if (hmap_params.sine_mag <= 0.0) return;
+	assert(cur_nx + y < sine_mag_terms.size());
+	zval += sine_mag_terms[x]*sine_mag_terms[cur_nx + y] + sine_offset;
+	if (hmap_params.volcano_width > 0.0 && hmap_params.volcano_height > 0.0) {zval += get_volcano_height((x*mdx + mx0)*DX_VAL_INV, (y*mdy + my0)*DY_VAL_INV);}
 }
 
 
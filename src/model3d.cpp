@@ -10,10 +10,14 @@
 #include "voxels.h" // for get_cur_model_edges_as_cubes
 #include "csg.h" // for clip_polygon_to_cube
 #include "lightmap.h" // for lmap_manager_t
+#include "file_reader.h" // for mapped_file_t
 #include <fstream>
+#include <sstream>
 #include <queue>
+#include <sys/stat.h>
 #include "meshoptimizer.h"
 #include "profiler.h"
+#include "fnv_hash.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -23,7 +27,10 @@ bool const ENABLE_INTER_REFLECTIONS = 1;
 bool const SHOW_MODEL_BCUBE_CENTER  = 0;
 bool const ENABLE_ANIMATION_SHADOWS = 1;
 bool const USE_ANIM_MODEL_TANGENTS  = 1;
-unsigned const MAGIC_NUMBER  = 42987143; // arbitrary file signature
+unsigned const MAGIC_NUMBER  = 42987143; // arbitrary file signature; original unversioned format, read only
+unsigned const MAGIC_NUMBER_V2 = 42987144; // versioned format with a header, aligned arrays, and a material offset table
+unsigned const MODEL3D_FILE_VERSION = 2;
+unsigned const MODEL3D_ALIGN = 16; // alignment of arrays in versioned model3d files, relative to the start of the file
 unsigned const BLOCK_SIZE    = 32768; // in vertex indices
 unsigned const BONE_IDS_LOC     = 4;
 unsigned const BONE_WEIGHTS_LOC = 5;
@@ -151,8 +158,13 @@ void texture_manager::add_work_item(int tid, bool is_nm) {
 void texture_manager::load_work_items_mt() {
 	if (to_load.empty()) return; // nothing to do
 	sort_and_unique(to_load);
+	unsigned const prof_parent(frame_prof_get_cur_node());
 #pragma omp parallel for schedule(dynamic)
-	for (int i = 0; i < (int)to_load.size(); ++i) {ensure_texture_loaded(to_load[i].tid, to_load[i].is_nm);}
+	for (int i = 0; i < (int)to_load.size(); ++i) {
+		FRAME_PROF_PARENT(prof_parent);
+		FRAME_PROF_ZONE("Load Model Texture");
+		ensure_texture_loaded(to_load[i].tid, to_load[i].is_nm);
+	}
 	to_load.clear();
 }
 
@@ -185,6 +197,40 @@ unsigned texture_manager::get_gpu_mem() const {
 
 // ************ read/write code ************
 
+struct model3d_file_header_t { // versioned model3d file header; size must be a multiple of MODEL3D_ALIGN
+	unsigned magic=MAGIC_NUMBER_V2, version=MODEL3D_FILE_VERSION, header_size=sizeof(model3d_file_header_t);
+	unsigned mat_params_size=sizeof(material_params_t); // files written with a different material_params_t layout are rejected
+	uint64_t payload_size=0, checksum=0;
+	uint64_t source_mtime=0, source_params_hash=0; // for model3d files used as a cache of an object file
+};
+
+uint64_t get_file_mod_time(string const &fn) { // returns 0 if the file doesn't exist
+	struct stat st;
+	if (stat(fn.c_str(), &st) != 0) return 0;
+	return (uint64_t)st.st_mtime;
+}
+
+class model3d_mem_reader_t { // reads from a memory mapped versioned model3d file; pos is relative to the start of the file
+	char const *data;
+	size_t size, pos;
+	bool error=0;
+public:
+	model3d_mem_reader_t(char const *data_, size_t size_, size_t pos_) : data(data_), size(size_), pos(pos_) {}
+	bool good() const {return !error;}
+	void align() {pos = min(size, ((pos + MODEL3D_ALIGN - 1) & ~size_t(MODEL3D_ALIGN - 1)));}
+
+	char const *get_bytes(size_t num) { // returns nullptr and sets the error flag if reading past the end of the file
+		if (error || num > size - pos) {error = 1; return nullptr;}
+		char const *const ret(data + pos);
+		pos += num;
+		return ret;
+	}
+	void read(char *dest, size_t num) {
+		char const *const src(get_bytes(num));
+		if (src) {memcpy(dest, src, num);} else {memset(dest, 0, num);}
+	}
+};
+
 void write_uint(ostream &out, unsigned val) {
 	out.write((const char *)&val, sizeof(unsigned));
 }
@@ -194,17 +240,36 @@ unsigned read_uint(istream &in) {
 	in.read((char *)&val, sizeof(unsigned));
 	return val;
 }
+unsigned read_uint(model3d_mem_reader_t &in) {
+	unsigned val(0);
+	in.read((char *)&val, sizeof(unsigned));
+	return val;
+}
+
+void write_align_pad(ostream &out) { // Note: out must start at a multiple of MODEL3D_ALIGN within the file
+	char const zeros[MODEL3D_ALIGN] = {};
+	out.write(zeros, (MODEL3D_ALIGN - unsigned(out.tellp() % MODEL3D_ALIGN)) % MODEL3D_ALIGN);
+}
 
 template<typename V> void write_vector(ostream &out, V const &v) {
 	write_uint(out, (unsigned)v.size());
+	write_align_pad(out);
 	out.write((const char *)&v.front(), (std::streamsize)v.size()*sizeof(typename V::value_type));
 }
 
-template<typename V> void read_vector(istream &in, V &v) {
+template<typename V> void read_vector(istream &in, V &v) { // original unaligned format
 	v.clear();
 	v.resize(read_uint(in));
 	in.read((char *)&v.front(), (std::streamsize)v.size()*sizeof(typename V::value_type));
 }
+template<typename V> void read_vector(model3d_mem_reader_t &in, V &v) { // aligned format; a single copy out of the mapped file
+	typedef typename V::value_type T;
+	v.clear();
+	unsigned const num(read_uint(in));
+	in.align();
+	T const *const src((T const *)in.get_bytes(size_t(num)*sizeof(T)));
+	if (src) {v.assign(src, src+num);}
+}
 
 
 // ************ vntc_vect_t/indexed_vntc_vect_t ************
@@ -586,7 +651,7 @@ template<typename T> void vntc_vect_t<T>::write(ostream &out) const {
 	write_vector(out, *this);
 }
 
-template<typename T> void vntc_vect_t<T>::read(istream &in) {
+template<typename T> template<typename S> void vntc_vect_t<T>::read(S &in) {
 	// Note: it would be nice to write/read without the tangent vectors and recalculate them later,
 	// but knowing which materials require tangents requires loading the material file first, but that requires the model,
 	// so we would have to read the model3d material headers, then read the material file, then read the polygon data into the correct geometry type,
@@ -968,7 +1033,7 @@ template<typename T> void indexed_vntc_vect_t<T>::write(ostream &out) const {
 	write_vector(out, indices);
 }
 
-template<typename T> void indexed_vntc_vect_t<T>::read(istream &in, unsigned npts) {
+template<typename T> template<typename S> void indexed_vntc_vect_t<T>::read(S &in, unsigned npts) {
 	vntc_vect_t<T>::read(in);
 	read_vector(in, indices);
 	finalize_lod_blocks(npts);
@@ -1151,7 +1216,7 @@ template<typename T> bool vntc_vect_block_t<T>::write(ostream &out) const {
 	return 1;
 }
 
-template<typename T> bool vntc_vect_block_t<T>::read(istream &in, unsigned npts) {
+template<typename T> template<typename S> bool vntc_vect_block_t<T>::read(S &in, unsigned npts) {
 	this->clear();
 	this->resize(read_uint(in));
 	for (auto i = begin(); i != end(); ++i) {i->read(in, npts);}
@@ -1491,7 +1556,7 @@ bool material_t::write(ostream &out) const {
 	return (geom.write(out) && geom_tan.write(out));
 }
 
-bool material_t::read(istream &in) {
+template<typename S> bool material_t::read(S &in) {
 	in.read((char *)this, sizeof(material_params_t));
 	read_vector(in, name);
 	read_vector(in, filename);
@@ -1855,8 +1920,13 @@ void model3d::mark_mat_as_used(int mat_id) {
 
 void model3d::finalize() {
 
+	unsigned const prof_parent(frame_prof_get_cur_node());
 #pragma omp parallel for schedule(dynamic)
-	for (int i = 0; i < (int)materials.size(); ++i) {materials[i].finalize();}
+	for (int i = 0; i < (int)materials.size(); ++i) {
+		FRAME_PROF_PARENT(prof_parent);
+		FRAME_PROF_ZONE("Finalize Model Material");
+		materials[i].finalize();
+	}
 	unbound_geom.finalize();
 }
 
@@ -2548,8 +2618,37 @@ void model3d::show_stats() const {
 }
 
 
-bool model3d::write_to_disk(string const &fn) const { // as model3d file; Note: transforms not written
+// source_fn and source_params_hash are optional, and are used when this file is a cache of an object file; see is_model3d_file_up_to_date()
+bool model3d::write_to_disk(string const &fn, string const &source_fn, uint64_t source_params_hash) const { // as model3d file; Note: transforms not written
 
+	// write the payload to memory first so that we can fill in the material offsets and checksum
+	ostringstream payload(ios::out | ios::binary);
+	payload.write((char const *)&bcube, sizeof(cube_t));
+	if (!unbound_geom.write(payload)) return 0;
+	write_uint(payload, (unsigned)materials.size());
+	write_align_pad(payload);
+	streampos const mat_table_pos(payload.tellp());
+	vector<uint64_t> mat_offsets(materials.size(), 0); // relative to the start of the payload
+	payload.write((char const *)mat_offsets.data(), mat_offsets.size()*sizeof(uint64_t)); // placeholder, written below
+	
+	for (deque<material_t>::const_iterator m = materials.begin(); m != materials.end(); ++m) {
+		write_align_pad(payload);
+		mat_offsets[m - materials.begin()] = (uint64_t)payload.tellp();
+
+		if (!m->write(payload)) {
+			cerr << "Error writing material " << m->name << endl;
+			return 0;
+		}
+	}
+	payload.seekp(mat_table_pos);
+	payload.write((char const *)mat_offsets.data(), mat_offsets.size()*sizeof(uint64_t));
+	if (!payload.good()) return 0;
+	string const data(payload.str());
+	model3d_file_header_t header;
+	header.payload_size       = data.size();
+	header.checksum           = calc_fnv_hash(data.data(), data.size());
+	header.source_mtime       = (source_fn.empty() ? 0 : get_file_mod_time(source_fn));
+	header.source_params_hash = source_params_hash;
 	ofstream out(fn, ios::out | ios::binary);
 	
 	if (!out.good()) {
@@ -2557,51 +2656,97 @@ bool model3d::write_to_disk(string const &fn) const { // as model3d file; Note:
 		return 0;
 	}
 	cout << "Writing model3d file " << fn << endl;
-	write_uint(out, MAGIC_NUMBER);
-	out.write((char const *)&bcube, sizeof(cube_t));
-	if (!unbound_geom.write(out)) return 0;
-	write_uint(out, (unsigned)materials.size());
-	
-	for (deque<material_t>::const_iterator m = materials.begin(); m != materials.end(); ++m) {
-		if (!m->write(out)) {
-			cerr << "Error writing material " << m->name << endl;
-			return 0;
-		}
-	}
+	out.write((char const *)&header, sizeof(model3d_file_header_t));
+	out.write(data.data(), data.size());
 	return out.good();
 }
 
 
 bool model3d::read_from_disk(string const &fn) { // as model3d file; Note: transforms not read
 
-	ifstream in(fn, ios::in | ios::binary);
+	mapped_file_t file;
 	
-	if (!in.good()) {
+	if (!file.open(fn)) {
 		cerr << "Error opening model3d file for read: " << fn << endl;
 		return 0;
 	}
 	clear(); // may not be needed
-	unsigned const magic_number_comp(read_uint(in));
-
-	if (magic_number_comp != MAGIC_NUMBER) {
+	unsigned magic_number_comp(0);
+	if (file.get_size() >= sizeof(unsigned)) {memcpy(&magic_number_comp, file.get_data(), sizeof(unsigned));}
+
+	if (magic_number_comp == MAGIC_NUMBER) { // original unversioned format, read through a stream
+		ifstream in(fn, ios::in | ios::binary);
+		read_uint(in); // skip magic number
+		cout << "Reading model3d file " << fn << endl;
+		from_model3d_file = 1;
+		in.read((char *)&bcube, sizeof(cube_t));
+		if (!unbound_geom.read(in)) return 0;
+		materials.resize(read_uint(in));
+	
+		for (deque<material_t>::iterator m = materials.begin(); m != materials.end(); ++m) {
+			if (!m->read(in)) {
+				cerr << "Error reading material" << endl;
+				return 0;
+			}
+			mat_map[m->name] = (m - materials.begin());
+		}
+		return in.good();
+	}
+	if (magic_number_comp != MAGIC_NUMBER_V2 || file.get_size() < sizeof(model3d_file_header_t)) {
 		cerr << "Error reading model3d file " << fn << ": Invalid file format (magic number check failed)." << endl;
 		return 0;
 	}
+	model3d_file_header_t header;
+	memcpy(&header, file.get_data(), sizeof(model3d_file_header_t));
+
+	if (header.version != MODEL3D_FILE_VERSION || header.header_size != sizeof(model3d_file_header_t) || header.mat_params_size != sizeof(material_params_t)) {
+		cerr << "Error reading model3d file " << fn << ": Unsupported file version " << header.version << " or material format" << endl;
+		return 0;
+	}
+	char const *const payload(file.get_data() + header.header_size);
+
+	if (header.payload_size != file.get_size() - header.header_size || calc_fnv_hash(payload, header.payload_size) != header.checksum) {
+		cerr << "Error reading model3d file " << fn << ": File is truncated or corrupt (checksum failed)" << endl;
+		return 0;
+	}
 	cout << "Reading model3d file " << fn << endl;
 	from_model3d_file = 1;
+	model3d_mem_reader_t in(file.get_data(), file.get_size(), header.header_size);
 	in.read((char *)&bcube, sizeof(cube_t));
 	if (!unbound_geom.read(in)) return 0;
 	materials.resize(read_uint(in));
-	
-	for (deque<material_t>::iterator m = materials.begin(); m != materials.end(); ++m) {
-		if (!m->read(in)) {
-			cerr << "Error reading material" << endl;
-			return 0;
-		}
-		mat_map[m->name] = (m - materials.begin());
+	in.align();
+	vector<uint64_t> mat_offsets(materials.size(), 0);
+	in.read((char *)mat_offsets.data(), mat_offsets.size()*sizeof(uint64_t));
+	if (!in.good()) return 0;
+	int num_errors(0);
+
+	// materials are independent and their offsets are known, so they can be read in parallel
+#pragma omp parallel for schedule(dynamic) reduction(+:num_errors)
+	for (int i = 0; i < (int)materials.size(); ++i) {
+		if (mat_offsets[i] >= header.payload_size) {++num_errors; continue;}
+		model3d_mem_reader_t mat_in(file.get_data(), file.get_size(), (header.header_size + mat_offsets[i]));
+		if (!materials[i].read(mat_in) || !mat_in.good()) {++num_errors;}
+	}
+	if (num_errors > 0) {
+		cerr << "Error reading material" << endl;
+		return 0;
 	}
+	for (deque<material_t>::iterator m = materials.begin(); m != materials.end(); ++m) {mat_map[m->name] = (m - materials.begin());}
 	//simplify_indices(0.1); // TESTING
-	return in.good();
+	return 1;
+}
+
+// returns true if fn is a versioned model3d file written from source_fn with the same params, and source_fn hasn't been modified since
+bool model3d::is_model3d_file_up_to_date(string const &fn, string const &source_fn, uint64_t source_params_hash) {
+	ifstream in(fn, ios::in | ios::binary);
+	if (!in.good()) return 0;
+	model3d_file_header_t header;
+	if (!in.read((char *)&header, sizeof(model3d_file_header_t))) return 0;
+	if (header.magic != MAGIC_NUMBER_V2 || header.version != MODEL3D_FILE_VERSION || header.mat_params_size != sizeof(material_params_t)) return 0;
+	if (header.source_params_hash != source_params_hash) return 0;
+	uint64_t const source_mtime(get_file_mod_time(source_fn));
+	return (source_mtime != 0 && header.source_mtime == source_mtime);
 }
 
 bool model3d::write_as_obj_file(string const &fn) {
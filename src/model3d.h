@@ -17,6 +17,7 @@
 using namespace std;
 
 typedef map<string, unsigned> string_map_t;
+class model3d_mem_reader_t; // reads from a memory-mapped model3d file; see model3d.cpp
 
 unsigned const MAX_VMAP_SIZE     = (1 << 18); // 256K
 unsigned const BUILTIN_TID_START = (1 << 16); // 65K
@@ -298,7 +299,7 @@ public:
 	void optimize(unsigned npts) {remove_excess_cap();}
 	void remove_excess_cap() {if (20*vector<T>::size() < 19*vector<T>::capacity()) {vector<T>::shrink_to_fit();}}
 	void write(ostream &out) const;
-	void read(istream &in);
+	template<typename S> void read(S &in); // S is istream or model3d_mem_reader_t
 };
 
 
@@ -372,7 +373,7 @@ public:
 	unsigned get_gpu_mem() const {return (vntc_vect_t<T>::get_gpu_mem() + (this->ivbo_valid() ? indices.size()*sizeof(unsigned) : 0));}
 	void invert_tcy();
 	void write(ostream &out) const;
-	void read(istream &in, unsigned npts);
+	template<typename S> void read(S &in, unsigned npts);
 	void write_to_obj_file(ostream &out, unsigned &cur_vert_ix, unsigned npts) const;
 	bool indexing_enabled() const {return !indices.empty();}
 	void mark_need_normalize() {need_normalize = 1;}
@@ -400,7 +401,7 @@ template<typename T> struct vntc_vect_block_t : public deque<indexed_vntc_vect_t
 	void reverse_winding_order(unsigned npts);
 	void merge_into_single_vector();
 	bool write(ostream &out) const;
-	bool read(istream &in, unsigned npts);
+	template<typename S> bool read(S &in, unsigned npts);
 	bool write_to_obj_file(ostream &out, unsigned &cur_vert_ix, unsigned npts) const;
 };
 
@@ -429,7 +430,7 @@ template<typename T> struct geometry_t {
 	void simplify_indices(float reduce_target);
 	void reverse_winding_order();
 	bool write(ostream &out) const {return (triangles.write(out)  && quads.write(out)) ;}
-	bool read(istream &in)         {return (triangles.read(in, 3) && quads.read(in, 4));}
+	template<typename S> bool read(S &in) {return (triangles.read(in, 3) && quads.read(in, 4));}
 	bool write_to_obj_file(ostream &out, unsigned &cur_vert_ix) const {return (triangles.write_to_obj_file(out, cur_vert_ix, 3) && quads.write_to_obj_file(out, cur_vert_ix, 4));}
 };
 
@@ -521,7 +522,7 @@ struct material_t : public material_params_t {
 	colorRGBA get_ad_color() const;
 	colorRGBA get_avg_color(texture_manager const &tmgr, int default_tid=-1) const;
 	bool write(ostream &out) const;
-	bool read(istream &in);
+	template<typename S> bool read(S &in);
 	bool write_to_obj_file(ostream &out, unsigned &cur_vert_ix) const;
 	void write_mtllib_entry(ostream &out, texture_manager const &tmgr) const;
 };
@@ -668,8 +669,9 @@ public:
 	void get_stats(model3d_stats_t &stats) const;
 	void show_stats() const;
 	void get_all_mat_lib_fns(set<std::string> &mat_lib_fns) const;
-	bool write_to_disk (string const &fn) const;
+	bool write_to_disk (string const &fn, string const &source_fn="", uint64_t source_params_hash=0) const;
 	bool read_from_disk(string const &fn);
+	static bool is_model3d_file_up_to_date(string const &fn, string const &source_fn, uint64_t source_params_hash);
 	bool write_as_obj_file(string const &fn);
 	static void proc_model_normals(vector<counted_normal> &cn, int recalc_normals, float nmag_thresh=0.7);
 	static void proc_model_normals(vector<weighted_normal> &wn, int recalc_normals, float nmag_thresh=0.7);
@@ -42,7 +42,7 @@ struct interval {
 
 
 struct comp_co_fast_x {
-	bool operator()(cached_obj const &o1, cached_obj const &o2) {
+	bool operator()(cached_obj const &o1, cached_obj const &o2) const {
 		return (o1.pos.x < o2.pos.x);
 	}
 };
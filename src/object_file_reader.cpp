@@ -6,9 +6,17 @@
 #include "3DWorld.h"
 #include "model3d.h"
 #include "file_reader.h"
+#include "fnv_hash.h"
 #include <stdint.h>
 #include <algorithm> // for transform()
 #include <cctype> // for tolower()
+#include <climits> // for INT_MIN
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "fast_atof.h"
 
 
@@ -77,6 +85,256 @@ bool base_file_reader::read_string(char *s, unsigned max_len) {
 	return 1;
 }
 
+mapped_file_t::~mapped_file_t() {
+#ifndef _WIN32
+	if (map_ptr) {munmap(map_ptr, size);}
+#endif
+}
+
+bool mapped_file_t::open(string const &fn) {
+#ifdef _WIN32
+	ifstream in(fn, ios::in | ios::binary | ios::ate);
+	if (!in.good()) return 0;
+	buf.resize((size_t)in.tellg());
+	if (buf.empty()) return 0;
+	in.seekg(0);
+	if (!in.read(buf.data(), buf.size())) return 0;
+	data = buf.data();
+	size = buf.size();
+#else
+	int const fd(::open(fn.c_str(), O_RDONLY));
+	if (fd < 0) return 0;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {::close(fd); return 0;}
+	size    = (size_t)st.st_size;
+	map_ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping stays valid after the file is closed
+	if (map_ptr == MAP_FAILED) {map_ptr = nullptr; size = 0; return 0;}
+	madvise(map_ptr, size, MADV_WILLNEED); // the entire file is always read, so prefetch everything
+	data = (char const *)map_ptr;
+#endif
+	return 1;
+}
+
+
+// ************************************************
+// Multithreaded object file parsing: the file is split into line aligned chunks that are parsed in parallel,
+// then the parsed commands are processed serially in file order so that results match a serial read of the file
+
+size_t   const OBJ_CHUNK_SZ    = (1U<<20); // 1MB
+unsigned const OBJ_CHUNK_BATCH = 64; // number of chunks parsed in parallel before processing; limits memory usage for large files
+int      const OBJ_IX_NONE     = INT_MIN; // tex coord or normal index not specified
+
+enum {OBJ_CMD_V=0, OBJ_CMD_VT, OBJ_CMD_VN, OBJ_CMD_F, OBJ_CMD_O, OBJ_CMD_G, OBJ_CMD_S, OBJ_CMD_USEMTL, OBJ_CMD_MTLLIB, OBJ_CMD_UNDEF};
+
+struct obj_cmd_t {
+	uint8_t type=OBJ_CMD_UNDEF, color_ret=0; // color_ret is the read_optional_color_RGB() return value for vertices
+	bool error=0; // error parsing the values of v, vt, vn, or s
+	unsigned line; // line number within the chunk, starting from 1
+	unsigned ix=0, num=0; // v/vt/vn: index into pts; f: range of face_verts; s: smoothing group; o/g/usemtl/mtllib/undefined: range of text
+	obj_cmd_t(uint8_t type_, unsigned line_) : type(type_), line(line_) {}
+};
+
+struct obj_face_vert_t {
+	int vix, tix, nix; // unnormalized; tix and nix may be OBJ_IX_NONE
+	obj_face_vert_t(int vix_, int tix_, int nix_) : vix(vix_), tix(tix_), nix(nix_) {}
+};
+
+class obj_line_parser_t { // parses values from a single line with the same rules as base_file_reader and object_file_reader
+	char const *pos, *end; // the char at end must be readable whitespace so that fast_atof() stops there
+public:
+	obj_line_parser_t(char const *pos_, char const *end_) : pos(pos_), end(end_) {}
+	char const *get_pos() const {return pos;}
+	void skip_ws() {while (pos < end && base_file_reader::fast_isspace(*pos)) {++pos;}}
+
+	bool read_token(char const *&token, unsigned &len) {
+		skip_ws();
+		token = pos;
+		while (pos < end && !base_file_reader::fast_isspace(*pos)) {++pos;}
+		len = unsigned(pos - token);
+		return (len > 0);
+	}
+	bool read_char(char c) { // reads c if it's the next character
+		if (pos == end || *pos != c) return 0;
+		++pos;
+		return 1;
+	}
+	bool read_int(int &v) {
+		skip_ws();
+		bool const is_neg(read_char('-'));
+		char const *const digits_start(pos);
+		v = 0;
+		for (; pos < end && base_file_reader::fast_isdigit(*pos); ++pos) {v = 10*v + int(*pos - '0');}
+		if (pos == digits_start) return 0; // no digits were read (a lone '-' is not an integer)
+		if (is_neg) {v = -v;}
+		return 1;
+	}
+	bool read_uint(unsigned &v) {
+		int temp(-1);
+		if (!read_int(temp) || temp < 0) return 0;
+		v = temp; // cast to unsigned
+		return 1;
+	}
+	bool read_float(float &val) {
+		skip_ws();
+		if (pos == end || (!base_file_reader::fast_isdigit(*pos) && *pos != '.' && *pos != '-')) return 0; // not a fp number
+		val = Assimp::fast_atof(pos);
+		while (pos < end && !base_file_reader::fast_isspace(*pos)) {++pos;} // skip the rest of the token
+		return 1;
+	}
+	bool read_point(point &p, unsigned req_num=3) {
+		for (unsigned i = 0; i < 3; ++i) {
+			if (!read_float(p[i])) {return ((i >= req_num) ? 1 : 0);} // success if we read enough values
+		}
+		return 1;
+	}
+	int read_optional_color_RGB(colorRGB &c) { // return value: 0=no color read, 1=color read, 2=error
+		float val(0.0);
+		if (!read_float(val)) return 0; // no more numbers to read
+		c.R = val;
+		return ((read_float(c.G) && read_float(c.B)) ? 1 : 2); // success or error
+	}
+};
+
+struct obj_chunk_t {
+	char const *start=nullptr, *end=nullptr; // range of the mapped file
+	unsigned num_lines=0;
+	vector<obj_cmd_t> cmds;
+	vector<point> pts; // values for v (followed by the color if color_ret == 1), vt, and vn
+	vector<obj_face_vert_t> face_verts;
+	string text; // strings for o, g, usemtl, mtllib, and undefined commands
+
+	string get_text(obj_cmd_t const &cmd) const {assert(cmd.ix + cmd.num <= text.size()); return text.substr(cmd.ix, cmd.num);}
+
+	void add_text(obj_cmd_t &cmd, char const *str, char const *str_end) { // strips leading and trailing whitespace, same as read_str_to_newline()
+		while (str < str_end && base_file_reader::fast_isspace(*str)) {++str;}
+		while (str_end > str && base_file_reader::fast_isspace(str_end[-1])) {--str_end;}
+		cmd.ix  = (unsigned)text.size();
+		cmd.num = unsigned(str_end - str);
+		text.append(str, str_end);
+	}
+	bool parse_line(char const *line, char const *line_end) { // returns 1 if the line is ignored and continues to the next line
+		obj_line_parser_t lp(line, line_end);
+		char const *kw(nullptr);
+		unsigned kw_len(0);
+		if (!lp.read_token(kw, kw_len)) return 0; // empty line
+		if (kw[0] == '#') {return (line_end[-1] == '\\');} // comment
+		auto is_kw = [kw, kw_len](char const *s) {return (strlen(s) == kw_len && strncmp(kw, s, kw_len) == 0);};
+
+		if (is_kw("f")) { // face
+			cmds.emplace_back(OBJ_CMD_F, num_lines);
+			obj_cmd_t &cmd(cmds.back());
+			cmd.ix = (unsigned)face_verts.size();
+			int vix(0);
+
+			while (lp.read_int(vix)) { // read vertex index
+				int tix(OBJ_IX_NONE), nix(OBJ_IX_NONE);
+
+				if (lp.read_char('/')) {
+					if (!lp.read_int(tix)) {tix = OBJ_IX_NONE;} // text coord index, ok to fail
+					if (lp.read_char('/') && !lp.read_int(nix)) {nix = OBJ_IX_NONE;} // normal index, ok to fail
+				}
+				face_verts.emplace_back(vix, tix, nix);
+			}
+			cmd.num = (unsigned)face_verts.size() - cmd.ix;
+		}
+		else if (is_kw("v")) { // vertex
+			cmds.emplace_back(OBJ_CMD_V, num_lines);
+			obj_cmd_t &cmd(cmds.back());
+			point p;
+			colorRGB color;
+			cmd.ix    = (unsigned)pts.size();
+			cmd.error = !lp.read_point(p);
+			pts.push_back(p);
+			if (!cmd.error) {cmd.color_ret = lp.read_optional_color_RGB(color);}
+			if (cmd.color_ret == 1) {pts.emplace_back(color.R, color.G, color.B);}
+		}
+		else if (is_kw("vt") || is_kw("vn")) { // tex coord or normal
+			bool const is_tc(kw[1] == 't');
+			cmds.emplace_back((is_tc ? OBJ_CMD_VT : OBJ_CMD_VN), num_lines);
+			obj_cmd_t &cmd(cmds.back());
+			point p;
+			cmd.ix    = (unsigned)pts.size();
+			cmd.error = !lp.read_point(p, (is_tc ? 2 : 3));
+			pts.push_back(p);
+		}
+		else if (is_kw("s")) { // smoothing/shading (off/on or 0/1)
+			cmds.emplace_back(OBJ_CMD_S, num_lines);
+			obj_cmd_t &cmd(cmds.back());
+
+			if (!lp.read_uint(cmd.ix)) {
+				char const *val(nullptr);
+				unsigned len(0);
+				cmd.error = (!lp.read_token(val, len) || len != 3 || strncmp(val, "off", 3) != 0);
+				cmd.ix    = 0;
+			}
+		}
+		else if (is_kw("l")) {return (line_end[-1] == '\\');} // line - ignore
+		else if (is_kw("o") || is_kw("g") || is_kw("usemtl") || is_kw("mtllib")) {
+			uint8_t const type(is_kw("o") ? OBJ_CMD_O : (is_kw("g") ? OBJ_CMD_G : (is_kw("usemtl") ? OBJ_CMD_USEMTL : OBJ_CMD_MTLLIB)));
+			cmds.emplace_back(type, num_lines);
+			add_text(cmds.back(), lp.get_pos(), line_end);
+		}
+		else { // undefined - ignore the line, but record the entry for the error message
+			cmds.emplace_back(OBJ_CMD_UNDEF, num_lines);
+			add_text(cmds.back(), kw, kw+kw_len);
+			return (line_end[-1] == '\\');
+		}
+		return 0;
+	}
+	void parse() {
+		bool skip_line(0); // set when the previous line was ignored and ended with an escaped newline
+
+		for (char const *pos = start; pos < end;) {
+			char const *line_end((char const *)memchr(pos, '\n', end - pos));
+			string last_line;
+			++num_lines;
+
+			if (line_end == nullptr) { // last line of the file with no newline; copy it so that it's followed by whitespace
+				last_line.assign(pos, end);
+				last_line.push_back('\n');
+				pos      = last_line.data();
+				line_end = pos + last_line.size() - 1;
+			}
+			if (skip_line) {skip_line = (line_end > pos && line_end[-1] == '\\');}
+			else           {skip_line = parse_line(pos, line_end);}
+			if (!last_line.empty()) break; // done
+			pos = line_end + 1;
+		}
+	}
+	void clear() { // free memory once processed
+		clear_cont(cmds);
+		clear_cont(pts);
+		clear_cont(face_verts);
+		clear_cont(text);
+	}
+};
+
+void split_obj_file_chunks(char const *data, size_t size, vector<obj_chunk_t> &chunks) {
+	char const *const data_end(data + size);
+	size_t const num_chunks(max((size_t)1, size/OBJ_CHUNK_SZ)), target_sz(size/num_chunks);
+	chunks.resize(num_chunks);
+	char const *pos(data);
+
+	for (size_t i = 0; i < num_chunks; ++i) {
+		obj_chunk_t &chunk(chunks[i]);
+		chunk.start = pos;
+
+		if (i+1 == num_chunks) {pos = data_end;}
+		else {
+			pos = max(pos, data + (i+1)*target_sz);
+
+			while (pos < data_end) { // advance to the start of the next line that doesn't follow an escaped newline
+				char const *const nl((char const *)memchr(pos, '\n', data_end - pos));
+				if (nl == nullptr) {pos = data_end; break;}
+				pos = nl + 1;
+				if (nl == data || nl[-1] != '\\') break;
+			}
+		}
+		chunk.end = pos;
+	}
+}
+
 
 class object_file_reader : public base_file_reader {
 
@@ -105,87 +363,64 @@ protected:
 		if ((unsigned)ix >= vect_sz) {cout << TXT(input_ix) << TXT(ix) << TXT(vect_sz) << endl;}
 		assert((unsigned)ix < vect_sz);
 	}
-	bool read_float(float &val) {
-		unsigned ix(0);
-
-		while (1) {
-			if (ix+1 >= MAX_CHARS) return 0; // buffer overrun
-			char const c(get_char(fp));
-			if (c == EOF) break;
-			if (fast_isspace(c)) {if (ix == 0) continue; else break;} // leading/trailing whitespace
-
-			if (ix == 0 && !fast_isdigit(c) && c != '.' && c != '-') { // not a fp number
-				unget_last_char(c);
-				return 0;
+	// parses the file in parallel, then calls proc_cmd(chunk, cmd, line) for each command in file order; stops and returns 0 if proc_cmd returns 0
+	template<typename F> bool read_file_chunks(F proc_cmd) {
+		mapped_file_t file;
+		if (!file.open(filename)) {cerr << "Error: Could not open object file " << filename << endl; return 0;}
+		vector<obj_chunk_t> chunks;
+		split_obj_file_chunks(file.get_data(), file.get_size(), chunks);
+		unsigned line_offset(0);
+
+		for (unsigned b = 0; b < chunks.size(); b += OBJ_CHUNK_BATCH) {
+			unsigned const b_end(min(b+OBJ_CHUNK_BATCH, (unsigned)chunks.size()));
+#pragma omp parallel for schedule(dynamic,1)
+			for (int c = b; c < (int)b_end; ++c) {chunks[c].parse();}
+
+			for (unsigned c = b; c < b_end; ++c) {
+				obj_chunk_t &chunk(chunks[c]);
+
+				for (obj_cmd_t const &cmd : chunk.cmds) {
+					if (!proc_cmd(chunk, cmd, line_offset + cmd.line)) return 0;
+				}
+				line_offset += chunk.num_lines;
+				chunk.clear();
 			}
-			buffer[ix++] = c;
-		}
-		buffer[ix] = 0; // add null terminator
-		val = Assimp::fast_atof(buffer);
+		} // for b
 		return 1;
 	}
-	bool read_point(point &p, unsigned req_num=3) {
-		//return (fscanf(fp, "%f%f%f", &p.x, &p.y, &p.z) >= (int)req_num);
-		for (unsigned i = 0; i < 3; ++i) {
-			if (!read_float(p[i])) {return ((i >= req_num) ? 1 : 0);} // success if we read enough values
-		}
-		return 1;
-	}
-	int read_optional_color_RGB(colorRGB &c) { // return value: 0=no color read, 1=color read, 2=error
-		float val(0.0);
-		if (!read_float(val)) return 0; // no more numbers to read
-		c.R = val;
-		return ((read_float(c.G) && read_float(c.B)) ? 1 : 2); // success or error
-	}
 
 public:
 	object_file_reader(string const &fn) : base_file_reader(fn), invalid_index_warned(0) {}
 
 	bool read(vector<coll_tquad> *ppts, geom_xform_t const &xf, bool verbose) {
 		RESET_TIME;
-		if (!open_file(1)) return 0; // binary mode is faster
 		cout << "Reading object file " << filename << endl;
 		vector<point> v; // vertices
-		char s[MAX_CHARS];
 		polygon_t poly;
 
-		while (read_string(s, MAX_CHARS)) {
-			if (s[0] == '#') { // comment
-				read_to_newline(fp); // ignore
-			}
-			else if (strcmp(s, "v") == 0) { // vertex
-				v.push_back(point());
-			
-				if (!read_point(v.back())) {
+		auto proc_cmd = [&](obj_chunk_t const &chunk, obj_cmd_t const &cmd, unsigned) {
+			if (cmd.type == OBJ_CMD_V) { // vertex
+				if (cmd.error) {
 					cerr << "Error reading vertex from object file " << filename << endl;
 					return 0;
 				}
+				v.push_back(chunk.pts[cmd.ix]);
 				xf.xform_pos(v.back());
 			}
-			else if (strcmp(s, "f") == 0) { // face
+			else if (cmd.type == OBJ_CMD_F) { // face
 				poly.resize(0);
-				int ix(0);
 
-				while (read_int(ix)) { // read vertex index
+				for (unsigned i = cmd.ix; i < cmd.ix + cmd.num; ++i) { // tex coord and normal indices are unused
+					int ix(chunk.face_verts[i].vix);
 					normalize_index(ix, (unsigned)v.size());
 					// only fill in the vertex (norm and tc will be unused)
 					if (ppts) {poly.emplace_back(v[ix], zero_vector, 0.0, 0.0);}
-					int const c(get_next_char());
-
-					if (c == '/') {
-						read_int(ix); // text coord index, ok to fail
-						int const c2(get_next_char());
-						if (c2 == '/') {read_int(ix);} // normal index, ok to fail
-						else {unget_last_char(c2);}
-					}
-					else {unget_last_char(c);}
 				}
 				if (ppts) {split_polygon(poly, *ppts, POLY_COPLANAR_THRESH);}
 			}
-			else {
-				read_to_newline(fp); // ignore everything else
-			}
-		} // while
+			return 1; // ignore everything else
+		};
+		if (!read_file_chunks(proc_cmd)) return 0;
 		PRINT_TIME("Polygons Load");
 		if (verbose) cout << "v: " << v.size() << ", f: " << (ppts ? ppts->size() : 0) << endl;
 		return 1;
@@ -494,7 +729,6 @@ public:
 	}
 
 	bool read(geom_xform_t const &xf, int recalc_normals, bool verbose) {
-		if (!open_file(1)) return 0; // binary mode is faster
 		cout << "Reading object file " << filename << endl;
 		RESET_TIME;
 		unsigned const block_size = (1 << 18); // 256K
@@ -508,24 +742,13 @@ public:
 		vector<colorRGB> colors; // vertex colors
 		deque<poly_data_block> pblocks;
 		set<string> loaded_mat_libs;
-		char s[MAX_CHARS];
 		string material_name, mat_lib, group_name, object_name;
 		tc.push_back(point2d<float>(0.0, 0.0)); // default tex coords
 		n.push_back(zero_vector); // default normal
-		unsigned approx_line(0);
 		bool is_textured(0), had_npts_error(0);
 
-		while (read_string(s, MAX_CHARS)) {
-			++approx_line;
-
-			if (s[0] == 0) {
-				cout << "empty/unparseable line?" << endl;
-				continue;
-			}
-			else if (s[0] == '#') { // comment
-				read_to_newline(fp); // ignore
-			}
-			else if (strcmp(s, "f") == 0) { // face
+		auto proc_cmd = [&](obj_chunk_t const &chunk, obj_cmd_t const &cmd, unsigned line) {
+			if (cmd.type == OBJ_CMD_F) { // face
 				model.mark_mat_as_used(cur_mat_id);
 
 				if (pblocks.empty() || pblocks.back().pts.size() >= block_size || smoothing_group != prev_smoothing_group) { // create a new block
@@ -540,37 +763,29 @@ public:
 				pb.polys.push_back(poly_header_t(cur_mat_id, obj_group_id));
 				unsigned &npts(pb.polys.back().npts);
 				unsigned const pix((unsigned)pb.pts.size()), pts_start(pb.pts.size());
-				int vix(0), tix(0), nix(0);
 
-				while (read_int(vix)) { // read vertex index
+				for (unsigned i = cmd.ix; i < cmd.ix + cmd.num; ++i) { // read vertex indices
+					obj_face_vert_t const &fv(chunk.face_verts[i]);
+					int vix(fv.vix), tix(fv.tix), nix(fv.nix);
 					normalize_index(vix, (unsigned)v.size());
 					vntc_ix_t vntc_ix(vix, 0, 0);
-					int const c(get_next_char());
 
-					if (c == '/') {
-						if (read_int(tix)) { // read text coord index
-							normalize_index(tix, (unsigned)tc.size()-1); // account for tc[0]
-							vntc_ix.tix = tix+1; // account for tc[0]
-						}
-						int const c2(get_next_char());
-
-						if (c2 == '/') {
-							if (read_int(nix) && !recalc_normals) { // read normal index
-								normalize_index(nix, (unsigned)n.size()-1); // account for n[0]
-								vntc_ix.nix = nix+1; // account for n[0]
-							} // else the normal will be recalculated later
-						}
-						else {unget_last_char(c2);}
+					if (tix != OBJ_IX_NONE) { // text coord index
+						normalize_index(tix, (unsigned)tc.size()-1); // account for tc[0]
+						vntc_ix.tix = tix+1; // account for tc[0]
 					}
-					else {unget_last_char(c);}
+					if (nix != OBJ_IX_NONE && !recalc_normals) { // normal index
+						normalize_index(nix, (unsigned)n.size()-1); // account for n[0]
+						vntc_ix.nix = nix+1; // account for n[0]
+					} // else the normal will be recalculated later
 					pb.pts.push_back(vntc_ix);
 					++npts;
-				} // end while vertex
+				} // for i
 				if (npts < 3) {
-					if (!had_npts_error) {cerr << "Error near line " << approx_line << ": face has only " << npts << " vertices." << endl; had_npts_error = 1;}
+					if (!had_npts_error) {cerr << "Error near line " << line << ": face has only " << npts << " vertices." << endl; had_npts_error = 1;}
 					pb.pts.resize(pts_start);
 					pb.polys.pop_back(); // remove pts and polygon
-					continue; // skip it
+					return 1; // skip it
 				}
 				vector3d &normal(pb.polys.back().n);
 				
@@ -603,72 +818,63 @@ public:
 					}
 				}
 			}
-			else if (strcmp(s, "v") == 0) { // vertex
-				v.push_back(point());
-				if (recalc_normals) {vn.push_back(counted_normal());} // vertex normal
-			
-				if (!read_point(v.back())) {
-					cerr << "Error reading vertex from object file " << filename << " near line " << approx_line << endl;
+			else if (cmd.type == OBJ_CMD_V) { // vertex
+				if (cmd.error) {
+					cerr << "Error reading vertex from object file " << filename << " near line " << line << endl;
 					return 0;
 				}
-				colorRGB color;
-				int const color_ret(read_optional_color_RGB(color));
-				if (color_ret == 2) {cerr << "Error reading vertex color from object file " << filename << " near line " << approx_line << endl; return 0;}
-				else if (color_ret == 1) {
+				v.push_back(chunk.pts[cmd.ix]);
+				if (recalc_normals) {vn.push_back(counted_normal());} // vertex normal
+				if (cmd.color_ret == 2) {cerr << "Error reading vertex color from object file " << filename << " near line " << line << endl; return 0;}
+				else if (cmd.color_ret == 1) {
+					point const &c(chunk.pts[cmd.ix+1]); // color is stored after the vertex
 					if (colors.empty()) {colors.resize(v.size()-1, WHITE);} // pad colors up to this point with white
-					colors.push_back(color);
+					colors.emplace_back(c.x, c.y, c.z);
 				}
 				else if (!colors.empty()) {colors.push_back(WHITE);} // color not specified, and in colors mode, pad with white
 				xf.xform_pos(v.back());
 			}
-			else if (strcmp(s, "vt") == 0) { // tex coord
-				point tc3d;
-			
-				if (!read_point(tc3d, 2)) {
-					cerr << "Error reading texture coord from object file " << filename << " near line " << approx_line << endl;
+			else if (cmd.type == OBJ_CMD_VT) { // tex coord
+				if (cmd.error) {
+					cerr << "Error reading texture coord from object file " << filename << " near line " << line << endl;
 					return 0;
 				}
+				point const &tc3d(chunk.pts[cmd.ix]);
 				tc.push_back(point2d<float>(tc3d.x, tc3d.y)); // discard tc3d.z
 			}
-			else if (strcmp(s, "vn") == 0) { // normal
-				vector3d normal;
-			
-				if (!read_point(normal)) {
-					cerr << "Error reading normal from object file " << filename << " near line " << approx_line << endl;
+			else if (cmd.type == OBJ_CMD_VN) { // normal
+				if (cmd.error) {
+					cerr << "Error reading normal from object file " << filename << " near line " << line << endl;
 					return 0;
 				}
 				if (!recalc_normals) {
+					vector3d normal(chunk.pts[cmd.ix]);
 					xf.xform_pos_rm(normal);
 					n.push_back(normal);
 				}
 			}
-			else if (strcmp(s, "l") == 0) { // line
-				read_to_newline(fp); // ignore
-			}
-			else if (strcmp(s, "o") == 0) { // object definition
-				read_str_to_newline(fp, object_name); // can be empty?
+			else if (cmd.type == OBJ_CMD_O) { // object definition
+				object_name = chunk.get_text(cmd); // can be empty?
 				++num_objects;
 				++obj_group_id;
 			}
-			else if (strcmp(s, "g") == 0) { // group
-				read_str_to_newline(fp, group_name); // can be empty
+			else if (cmd.type == OBJ_CMD_G) { // group
+				group_name = chunk.get_text(cmd); // can be empty
 				++num_groups;
 				++obj_group_id;
 			}
-			else if (strcmp(s, "s") == 0) { // smoothing/shading (off/on or 0/1)
-				if (!read_uint(smoothing_group)) {
-					if (!read_string(s, MAX_CHARS) || strcmp(s, "off") != 0) {
-						cerr << "Error reading smoothing group from object file " << filename << " near line " << approx_line << endl;
-						return 0;
-					}
-					smoothing_group = 0;
+			else if (cmd.type == OBJ_CMD_S) { // smoothing/shading (off/on or 0/1)
+				if (cmd.error) {
+					cerr << "Error reading smoothing group from object file " << filename << " near line " << line << endl;
+					return 0;
 				}
+				smoothing_group = cmd.ix;
 			}
-			else if (strcmp(s, "usemtl") == 0) { // use material
-				read_str_to_newline(fp, material_name);
+			else if (cmd.type == OBJ_CMD_USEMTL) { // use material
+				material_name = chunk.get_text(cmd);
 
 				if (material_name.empty()) {
-					if (!had_empty_mat_error) {cerr << "Error reading material from object file " << filename << " near line " << approx_line << endl;}
+					if (!had_empty_mat_error) {cerr << "Error reading material from object file " << filename << " near line " << line << endl;}
 					had_empty_mat_error = 1;
 					return 0;
 				}
@@ -679,23 +885,25 @@ public:
 					is_textured = (tid >= 0 && model.tmgr.get_tex_avg_color(tid) != WHITE); // no texture, or all white texture
 				}
 			}
-			else if (strcmp(s, "mtllib") == 0) { // material library
-				read_str_to_newline(fp, mat_lib);
+			else if (cmd.type == OBJ_CMD_MTLLIB) { // material library
+				mat_lib = chunk.get_text(cmd);
 
 				if (mat_lib.empty()) {
-					cerr << "Error reading material library from object file " << filename << " near line " << approx_line << endl;
+					cerr << "Error reading material library from object file " << filename << " near line " << line << endl;
 					return 0;
 				}
-				if (!try_load_mat_lib(mat_lib, loaded_mat_libs, approx_line)) {
+				if (!try_load_mat_lib(mat_lib, loaded_mat_libs, line)) {
 					//return 0; // nonfatal
 				}
 			}
 			else {
-				cerr << "Error: Undefined entry '" << s << "' in object file " << filename << " near line " << approx_line << endl;
-				read_to_newline(fp); // ignore this line
+				assert(cmd.type == OBJ_CMD_UNDEF);
+				cerr << "Error: Undefined entry '" << chunk.get_text(cmd) << "' in object file " << filename << " near line " << line << endl;
 				//return 0;
 			}
-		} // while
+			return 1;
+		};
+		if (!read_file_chunks(proc_cmd)) return 0;
 		remove_excess_cap(v);
 		remove_excess_cap(n);
 		remove_excess_cap(tc);
@@ -768,15 +976,23 @@ void check_obj_file_ext(string const &filename, string const &ext) {
 }
 
 
-bool write_model3d_file(string const &base_fn, model3d &cur_model) {
-
-	RESET_TIME;
+string get_model3d_fn_for_obj(string const &base_fn) {
 	assert(base_fn.size() > 4);
 	string out_fn(base_fn.begin(), base_fn.end()-4); // strip off the '.obj'
-	out_fn += ".model3d";
+	return out_fn + ".model3d";
+}
+uint64_t get_obj_model3d_params_hash(geom_xform_t const &xf, int recalc_normals) { // everything that affects the geometry written to the model3d file
+	int const params[2] = {recalc_normals, int(model_calc_tan_vect)};
+	return calc_fnv_hash(params, sizeof(params), calc_fnv_hash(&xf, sizeof(geom_xform_t)));
+}
+
+bool write_model3d_file(string const &base_fn, model3d &cur_model, uint64_t source_params_hash) {
+
+	RESET_TIME;
+	string const out_fn(get_model3d_fn_for_obj(base_fn));
 	if (model_calc_tan_vect) {cur_model.calc_tangent_vectors();} // tangent vectors are needed for writing
 				
-	if (!cur_model.write_to_disk(out_fn)) {
+	if (!cur_model.write_to_disk(out_fn, base_fn, source_params_hash)) {
 		cerr << "Error writing model3d file " << out_fn << endl;
 		return 0;
 	}
@@ -802,7 +1018,7 @@ bool load_model_file(string const &filename, model3ds &models, geom_xform_t cons
 
 	if (!ALWAYS_USE_ASSIMP && ext == "3ds") {
 		if (!read_3ds_file_model(filename, cur_model, xf, recalc_normals, verbose)) {models.pop_back(); return 0;} // recalc_normals is always true
-		//if (write_file && !write_model3d_file(filename, cur_model)) return 0; // Note: doesn't work because there's no mtllib file
+		//if (write_file && !write_model3d_file(filename, cur_model, 0)) return 0; // Note: doesn't work because there's no mtllib file
 	}
 	else if (ext == "model3d") {
 		//assert(xf == geom_xform_t()); // xf is ignored, assumed to be already applied; use transforms with loaded model3d files
@@ -810,9 +1026,18 @@ bool load_model_file(string const &filename, model3ds &models, geom_xform_t cons
 	}
 	else if (!ALWAYS_USE_ASSIMP && ext == "obj") {
 		check_obj_file_ext(filename, ext);
-		//test_other_obj_loader(filename); // placeholder for testing other object file loaders (tinyobjloader, assimp, etc.)
-		if (!object_file_reader_model(filename, cur_model).read(xf, recalc_normals, verbose)) {models.pop_back(); return 0;}
-		if (write_file && !write_model3d_file(filename, cur_model)) return 0; // don't need to pop the model
+		uint64_t const params_hash(get_obj_model3d_params_hash(xf, recalc_normals));
+		string const model3d_fn(write_file ? get_model3d_fn_for_obj(filename) : "");
+
+		// if we're writing a model3d file, treat it as a cache of this object file and read it instead when the object file and params haven't changed
+		if (write_file && model3d::is_model3d_file_up_to_date(model3d_fn, filename, params_hash)) {
+			if (!object_file_reader_model(model3d_fn, cur_model).load_from_model3d_file(verbose)) {models.pop_back(); return 0;}
+		}
+		else {
+			//test_other_obj_loader(filename); // placeholder for testing other object file loaders (tinyobjloader, assimp, etc.)
+			if (!object_file_reader_model(filename, cur_model).read(xf, recalc_normals, verbose)) {models.pop_back(); return 0;}
+			if (write_file && !write_model3d_file(filename, cur_model, params_hash)) return 0; // don't need to pop the model
+		}
 	}
 	else { // not a built-in supported format, try using assimp if compiled in
 		if (!read_assimp_model(filename, cur_model, xf, anim_name, recalc_normals, verbose)) {models.pop_back(); return 0;}
@@ -6,6 +6,8 @@
 #include "nav_grid.h"
 #include "profiler.h"
 #include <fstream>
+#include "worker_pool.h"
+#include <atomic>
 
 float const CROSS_SPEED_MULT     = 1.8; // extra speed multiplier when crossing the road
 float const CROSS_WAIT_TIME      = 60.0; // in seconds
@@ -17,6 +19,7 @@ bool  const AVOID_RES_PRIV_PROP  = 1; // avoid private property in residential p
 bool some_person_has_idle_animation(0);
 
 extern bool tt_fire_button_down, camera_in_building;
+extern unsigned NUM_THREADS;
 extern int display_mode, game_mode, camera_mode, animate2, frame_counter, camera_surf_collide;
 extern float fticks, FAR_CLIP;
 extern double camera_zh;
@@ -222,7 +225,7 @@ public:
 		// assume the plot blocker is first and at least half the area of the plot
 		bool const has_blocked_interior(!blockers.empty() && blockers.front().get_area_xy() > 0.5*plot_bcube.get_area_xy());
 		vector<city_cube_nav_grid> &grids(plot_grids[has_blocked_interior][is_female]);
-		if (grids.empty()) {grids.resize(num_plots);}
+		if (grids.empty()) {grids.resize(num_plots);} // Note: not thread safe; call init() before updating cities in parallel
 		assert(grids.size() == num_plots);
 		city_cube_nav_grid &grid(grids[plot_ix]);
 		grid.check_if_valid(blockers);
@@ -230,7 +233,7 @@ public:
 		if (s != nullptr) {grid.debug_draw(*s);} // debug visualization
 		point plot_dest(p2);
 		plot_bcube.clamp_pt_xy(plot_dest); // closest point to our destination within the current plot
-		ai_path_t &path(ped_mgr.grid_path);
+		ai_path_t &path(ped_mgr.get_grid_path());
 		path.clear();
 		path.push_back(p1); // add the starting point
 		bool const ret(grid.find_path(p1, plot_dest, path, dest_building));
@@ -239,6 +242,12 @@ public:
 		path.erase(path.begin()); // remove the starting point, which is no longer needed
 		return ret;
 	}
+	void init(unsigned num_plots) {
+		for (unsigned g = 0; g < 4; ++g) {
+			vector<city_cube_nav_grid> &grids(plot_grids[g>>1][g&1]);
+			if (grids.empty()) {grids.resize(num_plots);}
+		}
+	}
 	void invalidate_nav_grid(unsigned plot_ix) { // not needed, because cars entering or leaving driveways will trigger invalidate() when blocker count changes?
 		for (unsigned g = 0; g < 4; ++g) { // check all 4 grids
 			vector<city_cube_nav_grid> &grids(plot_grids[g>>1][g&1]);
@@ -249,6 +258,7 @@ public:
 
 ped_manager_t::ped_manager_t(city_road_gen_t const &road_gen_, car_manager_t const &car_manager_) : road_gen(road_gen_), car_manager(car_manager_) {}
 ped_manager_t::~ped_manager_t() {} // required for city_cube_nav_grid_manager
+thread_local ped_manager_t::city_update_t *ped_manager_t::cur_city_update(nullptr);
 
 city_cube_nav_grid_manager &ped_manager_t::get_nav_grid_mgr() {
 	if (!nav_grid_mgr) {nav_grid_mgr.reset(new city_cube_nav_grid_manager);}
@@ -882,7 +892,7 @@ void pedestrian_t::get_avoid_cubes(ped_manager_t const &ped_mgr, vect_cube_t con
 	bool const is_home_plot(plot == dest_plot); // plot contains our destination
 	if (is_home_plot && !follow_player) {assert(plot_bcube == next_plot_bcube);} // doesn't hold when following the player?
 	cube_t const region(get_plot_coll_region(cur_plot));
-	static vect_cube_t car_bcubes; // reused across calls
+	static thread_local vect_cube_t car_bcubes; // reused across calls; peds in different cities are updated in parallel
 	car_bcubes.clear();
 	if (!in_the_road) {ped_mgr.get_parked_car_bcubes_for_plot(plot_bcube, city, car_bcubes);} // get collider bcubes for cars parked in house driveways
 	bool keep_cur_dest(0);
@@ -988,7 +998,7 @@ void pedestrian_t::get_avoid_cubes(ped_manager_t const &ped_mgr, vect_cube_t con
 bool pedestrian_t::check_path_blocked(ped_manager_t &ped_mgr, point const &dest, bool check_buildings) { // Note: ped_mgr is non-const due to avoid
 	float const height(get_height()), expand(0.1*radius); // almost no expand
 	cube_t const check_area(pos, dest); // area between pos and dest
-	vect_cube_t &avoid(ped_mgr.path_finder.get_avoid_vector());
+	vect_cube_t &avoid(ped_mgr.get_path_finder().get_avoid_vector());
 	avoid.clear();
 	if (check_buildings) {get_building_bcubes(check_area, avoid);}
 	road_plot_t const &cur_plot(ped_mgr.get_city_plot_for_peds(city, plot));
@@ -1093,7 +1103,7 @@ void pedestrian_t::move(ped_manager_t const &ped_mgr, cube_t const &plot_bcube,
 
 void pedestrian_t::run_path_finding(ped_manager_t &ped_mgr, cube_t const &plot_bcube, cube_t const &next_plot_bcube, vect_cube_t const &colliders, vector3d &dest_pos) {
 	bool in_illegal_area(0), avoid_entire_plot(0), found_path(0), full_path(0);
-	vect_cube_t &avoid(ped_mgr.path_finder.get_avoid_vector());
+	vect_cube_t &avoid(ped_mgr.get_path_finder().get_avoid_vector());
 	get_avoid_cubes(ped_mgr, colliders, plot_bcube, next_plot_bcube, dest_pos, avoid, in_illegal_area, avoid_entire_plot);
 
 	for (unsigned attempt = 0; attempt < 2; ++attempt) { // make two attempts using two different path finding algorithms
@@ -1101,15 +1111,15 @@ void pedestrian_t::run_path_finding(ped_manager_t &ped_mgr, cube_t const &plot_b
 			int const bix(has_dest_bldg ? (int)dest_bldg : -1);
 			city_cube_nav_grid_manager &nav_grid_mgr(ped_mgr.get_nav_grid_mgr());
 			found_path = full_path = nav_grid_mgr.find_path(plot_bcube, avoid, radius, is_female, plot, pos, dest_pos, ped_mgr, bix);
-			if (found_path) {assert(!ped_mgr.grid_path.empty()); dest_pos = ped_mgr.grid_path.front();}
+			if (found_path) {assert(!ped_mgr.get_grid_path().empty()); dest_pos = ped_mgr.get_grid_path().front();}
 		}
 		else { // run path finding between pos and dest_pos using avoid cubes
 			cube_t union_plot_bcube(plot_bcube);
 			union_plot_bcube.union_with_cube(next_plot_bcube); // this is the area the ped is constrained to (both plots + road in between)
 			// return values: 0=failed, 1=valid path, 2=init contained, 3=straight path (no collisions)
-			unsigned const ret(ped_mgr.path_finder.run(pos, dest_pos, target_pos, union_plot_bcube, PATH_GAP_FACTOR*radius, dest_pos));
+			unsigned const ret(ped_mgr.get_path_finder().run(pos, dest_pos, target_pos, union_plot_bcube, PATH_GAP_FACTOR*radius, dest_pos));
 			found_path = (ret > 0);
-			full_path  = (ret == 3 || ped_mgr.path_finder.found_complete_path());
+			full_path  = (ret == 3 || ped_mgr.get_path_finder().found_complete_path());
 		}
 		if (full_path) break; // success
 		if (attempt == 0) {using_nav_grid ^= 1;} // switch path finding algorithm and try again
@@ -1577,6 +1587,7 @@ void ped_manager_t::remove_destroyed_peds() {
 }
 
 void ped_manager_t::register_ped_new_plot(pedestrian_t const &ped) {
+	if (cur_city_update) {cur_city_update->new_plot = 1; return;} // applied later in apply_city_updates()
 	if (!need_to_sort_city.empty()) {need_to_sort_city[ped.city] = 1;}
 	need_to_sort_peds = 1;
 }
@@ -1586,6 +1597,20 @@ void ped_manager_t::move_ped_to_next_plot(pedestrian_t &ped) {
 	register_ped_new_plot(ped);
 }
 
+void ped_manager_t::update_peds_in_city(unsigned city, float delta_dir) {
+	assert(city < city_updates.size());
+	unsigned const ped_start(by_city[city].ped_ix), ped_end(by_city[city+1].ped_ix);
+	assert(ped_start <= ped_end && ped_end <= peds.size());
+	city_update_t &cu(city_updates[city]);
+	assert(cur_city_update == nullptr);
+	cur_city_update = &cu;
+
+	for (auto i = peds.begin()+ped_start; i != peds.begin()+ped_end; ++i) {
+		i->next_frame(*this, peds, (i - peds.begin()), cu.rgen, delta_dir);
+	}
+	cur_city_update = nullptr;
+}
+
 void ped_manager_t::next_frame() {
 	if (!animate2) return; // nothing to do (only applies to moving peds)
 	float const delta_dir(1.2*(1.0 - pow(0.7f, fticks))); // controls pedestrian turning rate
@@ -1608,15 +1633,36 @@ void ped_manager_t::next_frame() {
 		if (first_frame) { // choose initial ped destinations (must be after building setup, etc.)
 			for (auto i = peds.begin(); i != peds.end(); ++i) {choose_dest_building_or_parked_car(*i);}
 		}
+		// peds only interact with peds in the same city, so cities can be updated in parallel; cities near the player are updated serially
+		// on this thread because peds may interact with the player there (zombie sounds and attacks)
+		float const player_interact_dist(4.0*city_params.road_spacing);
+		vector<unsigned> par_cities, serial_cities;
+		unsigned num_par_peds(0);
+
 		for (unsigned city = 0; city+1 < by_city.size(); ++city) {
-			if (!get_expanded_city_bcube_for_peds(city).closest_dist_less_than(camera_bs, enable_ai_dist)) continue; // too far from the player
-			unsigned const ped_start(by_city[city].ped_ix), ped_end(by_city[city+1].ped_ix);
-			assert(ped_start <= ped_end && ped_end <= peds.size());
-				
-			for (auto i = peds.begin()+ped_start; i != peds.begin()+ped_end; ++i) {
-				i->next_frame(*this, peds, (i - peds.begin()), rgen, delta_dir);
-			}
+			cube_t const city_bcube(get_expanded_city_bcube_for_peds(city));
+			if (!city_bcube.closest_dist_less_than(camera_bs, enable_ai_dist)) continue; // too far from the player
+			if (city_bcube.closest_dist_less_than(camera_bs, player_interact_dist)) {serial_cities.push_back(city); continue;}
+			par_cities.push_back(city);
+			num_par_peds += (by_city[city+1].ped_ix - by_city[city].ped_ix);
 		} // for city
+		if (city_updates.size() + 1 != by_city.size()) { // first frame, or cities have changed
+			city_updates.clear();
+			city_updates.resize(by_city.size() - 1);
+			for (unsigned city = 0; city < city_updates.size(); ++city) {city_updates[city].rgen.set_state(city+1, 123);} // deterministic per-city seed
+		}
+		unsigned const num_threads(min((unsigned)par_cities.size(), max(1U, NUM_THREADS-min(NUM_THREADS, 2U)))); // leave threads for drawing and cars
+
+		if (num_threads > 1 && num_par_peds >= 4096) { // only use threads when there's enough work
+			get_nav_grid_mgr().init(tot_num_plots); // allocate nav grids so that this isn't done by multiple threads
+			if (!update_pool) {update_pool.reset(new worker_pool_t);}
+			std::atomic<unsigned> next_city(0);
+			update_pool->run(num_threads, [&]() {for (unsigned n = next_city++; n < par_cities.size(); n = next_city++) {update_peds_in_city(par_cities[n], delta_dir);}});
+		}
+		else {vector_add_to(par_cities, serial_cities);} // update them all serially
+		for (unsigned city : serial_cities) {update_peds_in_city(city, delta_dir);}
+		apply_city_updates();
+
 		if (need_to_sort_peds) {
 #pragma omp critical(access_pedestrian_data)
 			sort_by_city_and_plot();
@@ -1804,7 +1850,7 @@ void ped_manager_t::get_parked_car_bcubes_for_plot(cube_t const &plot, unsigned
 bool ped_manager_t::choose_dest_parked_car(unsigned city_id, unsigned &plot_id, unsigned &car_ix, point &car_center) {
 	car_city_vect_t const &cv(get_cars_for_city(city_id));
 	if (cv.parked_car_bcubes.empty()) return 0; // no parked cars; excludes sleeping cars in driveways
-	car_ix     = rgen.rand() % cv.parked_car_bcubes.size(); // Note: car_ix is stored in ped dest_bldg and doesn't get used after that
+	car_ix     = get_rgen().rand() % cv.parked_car_bcubes.size(); // Note: car_ix is stored in ped dest_bldg and doesn't get used after that
 	plot_id    = cv.parked_car_bcubes[car_ix].ix;
 	car_center = cv.parked_car_bcubes[car_ix].get_cube_center();
 	return 1;
@@ -4,12 +4,147 @@
 
 #include "3DWorld.h"
 #include "profiler.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <fstream>
+#include <cstring>
 
 using std::string;
 
+bool trace_capture_active(0);
+unsigned trace_capture_max_events(1<<20), trace_capture_frames(0); // trace_capture_frames > 0 starts a capture at init and writes it after this many frames
+string trace_capture_fn("trace.json");
+
+extern int frame_counter;
+
 void maybe_update_loading_screen(const char *str);
 int omp_get_thread_num_3dw();
 
+inline unsigned long long get_frame_prof_time_ns() {return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();}
+
+
+// bounded in-memory buffer of complete ("X") events and frame markers, written as Chrome trace-event JSON (chrome://tracing or ui.perfetto.dev)
+class trace_capture_t {
+	struct event_t {
+		char name[48]; // truncated copy, since timer names may be temporary strings
+		unsigned long long start_ns, dur_ns;
+		unsigned tid;
+		int frame;
+		bool is_frame_marker;
+	};
+	vector<event_t> events;
+	std::atomic<unsigned> num_events, num_dropped, num_writers, next_tid;
+	unsigned long long capture_start_ns=0;
+	int start_frame=0;
+	unsigned frames_to_capture=0, num_frames_captured=0; // frames_to_capture=0 => capture until stopped
+
+	unsigned get_thread_id() {
+		static thread_local unsigned tid(0); // 0 = unassigned
+		if (tid == 0) {tid = ++next_tid;}
+		return tid;
+	}
+	void add_event(char const *const name, unsigned long long start_ns, unsigned long long dur_ns, bool is_frame_marker) {
+		++num_writers; // must be incremented before checking trace_capture_active so that stop() can wait for us
+
+		if (trace_capture_active) {
+			unsigned const ix(num_events.fetch_add(1, std::memory_order_relaxed));
+
+			if (ix < events.size()) {
+				event_t &e(events[ix]);
+				strncpy(e.name, name, sizeof(e.name)-1);
+				e.name[sizeof(e.name)-1] = 0;
+				e.start_ns = start_ns;
+				e.dur_ns   = dur_ns;
+				e.tid      = get_thread_id();
+				e.frame    = frame_counter;
+				e.is_frame_marker = is_frame_marker;
+			}
+			else {++num_dropped;}
+		}
+		--num_writers;
+	}
+	static void write_json_str(std::ostream &out, char const *str) {
+		out << '"';
+
+		for (char const *c = str; *c; ++c) {
+			if      (*c == '"' || *c == '\\') {out << '\\' << *c;}
+			else if ((unsigned char)*c < 32) {out << ' ';}
+			else    {out << *c;}
+		}
+		out << '"';
+	}
+public:
+	trace_capture_t() : num_events(0), num_dropped(0), num_writers(0), next_tid(0) {}
+
+	void start(unsigned max_events, unsigned num_frames) { // main thread only
+		if (trace_capture_active) return;
+		while (num_writers > 0) {std::this_thread::yield();} // wait for late writers from a previous capture
+		events.resize(max(max_events, 1U));
+		num_events  = 0;
+		num_dropped = 0;
+		capture_start_ns = get_frame_prof_time_ns();
+		start_frame      = frame_counter;
+		frames_to_capture   = num_frames;
+		num_frames_captured = 0;
+		trace_capture_active = 1;
+		cout << "Started trace capture of up to " << events.size() << " events" << endl;
+	}
+	void add(char const *const name, unsigned long long start_ns, unsigned long long dur_ns) {add_event(name, start_ns, dur_ns, 0);}
+	void add_frame_marker() {add_event("Frame", get_frame_prof_time_ns(), 0, 1);}
+	bool end_frame() { // main thread only; returns 1 if this capture has covered all of its frames
+		add_frame_marker();
+		return (frames_to_capture > 0 && ++num_frames_captured >= frames_to_capture);
+	}
+
+	bool stop_and_write(string const &fn) { // main thread only
+		if (!trace_capture_active) return 0;
+		trace_capture_active = 0;
+		std::atomic_thread_fence(std::memory_order_seq_cst); // make sure writers see the flag change before we wait on them
+		while (num_writers > 0) {std::this_thread::yield();}
+		unsigned const num(min((unsigned)num_events, (unsigned)events.size()));
+		std::ofstream out(fn);
+
+		if (!out.good()) {
+			std::cerr << "Error: Failed to open trace capture file '" << fn << "' for writing" << endl;
+			return 0;
+		}
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		out << std::fixed;
+		out.precision(3); // times are in us
+		unsigned max_tid(0);
+
+		for (unsigned i = 0; i < num; ++i) {
+			event_t const &e(events[i]);
+			double const ts_us(0.001*(double(e.start_ns) - double(capture_start_ns))); // relative to capture start; may be negative for scopes that began earlier
+			out << "{\"name\":";
+			write_json_str(out, e.name);
+			if (e.is_frame_marker) {out << ",\"ph\":\"i\",\"s\":\"g\"";}
+			else {out << ",\"ph\":\"X\",\"dur\":" << 0.001*e.dur_ns;}
+			out << ",\"ts\":" << ts_us << ",\"pid\":1,\"tid\":" << e.tid << ",\"args\":{\"frame\":" << e.frame << "}},\n";
+			max_tid = max(max_tid, e.tid);
+		}
+		for (unsigned t = 1; t <= max_tid; ++t) { // thread name metadata; also ends the list without a trailing comma
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"name\":\"thread " << t << "\"}}" << ((t == max_tid) ? "\n" : ",\n");
+		}
+		if (max_tid == 0) {out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"3DWorld\"}}\n";}
+		out << "]}" << endl;
+		cout << "Wrote " << num << " trace events for frames " << start_frame << " to " << frame_counter << " to " << fn;
+		if (num_dropped > 0) {cout << " (" << num_dropped << " events dropped; increase trace_capture_max_events)";}
+		cout << endl;
+		return 1;
+	}
+};
+
+trace_capture_t trace_capture;
+
+void start_trace_capture(unsigned num_frames) {trace_capture.start(trace_capture_max_events, num_frames);}
+void stop_trace_capture_and_write() {trace_capture.stop_and_write(trace_capture_fn);}
+void toggle_trace_capture() { // user captures run until toggled off
+	if (trace_capture_active) {stop_trace_capture_and_write();} else {start_trace_capture(0);}
+}
+
 
 template <typename T> class timing_profiler {
 
@@ -27,7 +162,8 @@ public:
 	timing_profiler() : enabled(0) {}
 	void clear() {entries.clear();}
 
-	void register_time(const char *str, T delta_time, bool no_loading_screen) {
+	void register_time(const char *str, T delta_time, bool no_loading_screen, unsigned long long delta_ns) {
+		if (trace_capture_active) {unsigned long long const end_ns(get_frame_prof_time_ns()); trace_capture.add(str, end_ns - delta_ns, delta_ns);}
 #pragma omp critical(timer_update)
 		{
 			if (enabled) {entries[str].add(delta_time);}
@@ -53,19 +189,223 @@ timing_profiler<int> global_profiler;
 timing_profiler<float> global_highres_profiler;
 
 void toggle_timing_profiler() {global_profiler.enabled ^= 1; global_highres_profiler.enabled ^= 1;}
-void register_timing_value(const char *str, int delta_time, bool no_loading_screen) {global_profiler.register_time(str, delta_time, no_loading_screen);}
+void register_timing_value(const char *str, int delta_time, bool no_loading_screen) {global_profiler.register_time(str, delta_time, no_loading_screen, 1000000ULL*max(delta_time, 0));}
 
 void timing_profiler_stats() {
 	global_profiler.stats();
 	global_profiler.clear();
 	global_highres_profiler.stats();
 	global_highres_profiler.clear();
+	frame_profiler_stats();
 }
 
 void highres_timer_t::end() {
+	if (prof_token.valid()) {frame_prof_end(prof_token); prof_token = frame_prof_token_t();}
 	if (!enabled || name.empty()) return;
 	float const elapsed(duration_cast<duration<float>>(clock.now() - timer1).count());
-	global_highres_profiler.register_time(name.c_str(), 1000.0f*elapsed, no_loading_screen); // print in ms
+	global_highres_profiler.register_time(name.c_str(), 1000.0f*elapsed, no_loading_screen, (unsigned long long)(1.0E9*elapsed)); // print in ms
 	name.clear(); // make sure we don't double count this
 }
 
+
+
+// lock-free hierarchical frame profiler
+// Zones are registered once by name and get a static ID. Each thread accumulates time and counts for its (parent node, zone) nodes into
+// its own block of atomics, which only that thread adds to; the main thread drains all blocks once per frame in frame_profiler_end_frame()
+// and stores per-node frame times in a ring buffer used for percentile reporting. Locks are only taken when a thread or node is first seen.
+// Worker threads have no parent zone, so their zones report as top-level zones unless the caller propagates a parent with FRAME_PROF_PARENT;
+// this is done for the OpenMP regions that contain zones, while zones on long-lived std::thread workers (tile generation) stay top-level.
+
+bool frame_profiler_enabled(0);
+
+unsigned const FRAME_PROF_MAX_NODES  = 2048;
+unsigned const FRAME_PROF_HIST_SIZE  = 256; // frames of history kept per node
+unsigned const FRAME_PROF_ROOT_NODE  = 0;
+unsigned const FRAME_PROF_OVERFLOW_ZONE = 1; // zones registered after the zone limit is reached share this zone
+
+class frame_profiler_t {
+
+	struct prof_node_t {
+		unsigned parent, zone;
+		prof_node_t(unsigned p, unsigned z) : parent(p), zone(z) {}
+	};
+	struct thread_data_t {
+		std::atomic<unsigned long long> time_ns[FRAME_PROF_MAX_NODES];
+		std::atomic<unsigned> count[FRAME_PROF_MAX_NODES];
+		unsigned cur_node=FRAME_PROF_ROOT_NODE;
+		std::unordered_map<unsigned long long, unsigned> child_cache; // {parent node, zone} => node; owned by this thread
+
+		thread_data_t() {
+			for (unsigned i = 0; i < FRAME_PROF_MAX_NODES; ++i) {time_ns[i] = 0; count[i] = 0;}
+		}
+	};
+	struct node_hist_t {
+		float time_ms[FRAME_PROF_HIST_SIZE]={}; // ring buffer of per-frame total times
+		unsigned calls[FRAME_PROF_HIST_SIZE]={};
+	};
+	std::mutex reg_mutex, threads_mutex;
+	deque<string> zone_names; // deque so that zone_name_ptrs remain valid
+	char const *zone_name_ptrs[FRAME_PROF_MAX_NODES]={}; // written once under reg_mutex before the zone ID is returned, so can be read without a lock
+	map<string, unsigned> zone_name_to_id;
+	vector<prof_node_t> nodes;
+	map<pair<unsigned, unsigned>, unsigned> node_map;
+	std::atomic<unsigned> num_nodes;
+	vector<std::unique_ptr<thread_data_t>> threads; // never freed, since threads (including OpenMP workers) may still reference their data
+	vector<node_hist_t> hist; // main thread only
+	unsigned num_frames=0;
+	unsigned long long last_frame_ns=0;
+
+	thread_data_t &get_thread_data() {
+		static thread_local thread_data_t *tdata(nullptr);
+		if (tdata) return *tdata;
+		std::lock_guard<std::mutex> lock(threads_mutex);
+		threads.emplace_back(new thread_data_t);
+		tdata = threads.back().get();
+		return *tdata;
+	}
+	unsigned get_child_node(thread_data_t &tdata, unsigned zone) {
+		unsigned long long const key((((unsigned long long)tdata.cur_node) << 32) + zone);
+		auto it(tdata.child_cache.find(key));
+		if (it != tdata.child_cache.end()) return it->second;
+		unsigned node(FRAME_PROF_INVALID);
+		{
+			std::lock_guard<std::mutex> lock(reg_mutex);
+			auto const ret(node_map.insert(make_pair(make_pair(tdata.cur_node, zone), (unsigned)nodes.size())));
+
+			if (!ret.second) {node = ret.first->second;} // another thread created it
+			else if (nodes.size() < FRAME_PROF_MAX_NODES) {
+				node = (unsigned)nodes.size();
+				nodes.emplace_back(tdata.cur_node, zone);
+				num_nodes.store((unsigned)nodes.size(), std::memory_order_release);
+			}
+			else {node_map.erase(ret.first);} // out of nodes; this zone won't be recorded
+		}
+		tdata.child_cache[key] = node;
+		return node;
+	}
+public:
+	frame_profiler_t() : num_nodes(1) {
+		zone_names.push_back("Frame");
+		zone_name_ptrs[FRAME_PROF_ROOT_NODE] = zone_names.back().c_str();
+		zone_names.push_back("Zone Overflow");
+		zone_name_ptrs[FRAME_PROF_OVERFLOW_ZONE] = zone_names.back().c_str();
+		nodes.emplace_back(FRAME_PROF_INVALID, FRAME_PROF_ROOT_NODE); // root
+	}
+	unsigned register_zone(char const *const name) {
+		std::lock_guard<std::mutex> lock(reg_mutex);
+		if (zone_names.size() >= FRAME_PROF_MAX_NODES) return FRAME_PROF_OVERFLOW_ZONE; // too many zones; will be merged into the overflow zone
+		auto const ret(zone_name_to_id.insert(make_pair(string(name), (unsigned)zone_names.size())));
+
+		if (ret.second) {
+			zone_names.push_back(name);
+			zone_name_ptrs[ret.first->second] = zone_names.back().c_str();
+		}
+		return ret.first->second;
+	}
+	frame_prof_token_t begin(unsigned zone) {
+		thread_data_t &tdata(get_thread_data());
+		frame_prof_token_t token;
+		token.node = get_child_node(tdata, zone);
+		if (!token.valid()) return token;
+		token.parent   = tdata.cur_node;
+		token.zone     = zone;
+		token.start_ns = get_frame_prof_time_ns();
+		tdata.cur_node = token.node;
+		return token;
+	}
+	unsigned get_cur_node() {return get_thread_data().cur_node;}
+	unsigned set_cur_node(unsigned node) { // node must be a valid node, which was created by any thread
+		thread_data_t &tdata(get_thread_data());
+		unsigned const prev(tdata.cur_node);
+		tdata.cur_node = node;
+		return prev;
+	}
+	void end(frame_prof_token_t const &token) {
+		unsigned long long const delta(get_frame_prof_time_ns() - token.start_ns);
+		thread_data_t &tdata(get_thread_data());
+		tdata.time_ns[token.node].fetch_add(delta, std::memory_order_relaxed);
+		tdata.count  [token.node].fetch_add(1,     std::memory_order_relaxed);
+		tdata.cur_node = token.parent;
+		if (trace_capture_active) {trace_capture.add(zone_name_ptrs[token.zone], token.start_ns, delta);}
+	}
+	void end_frame() { // called on the main thread
+		unsigned long long const cur_ns(get_frame_prof_time_ns());
+		unsigned const nn(num_nodes.load(std::memory_order_acquire)), slot(num_frames % FRAME_PROF_HIST_SIZE);
+		if (hist.size() < nn) {hist.resize(nn);}
+		for (unsigned n = 0; n < nn; ++n) {hist[n].time_ms[slot] = 0.0; hist[n].calls[slot] = 0;}
+		{
+			std::lock_guard<std::mutex> lock(threads_mutex); // only contends with newly created threads
+
+			for (auto const &t : threads) {
+				for (unsigned n = 1; n < nn; ++n) { // skip root
+					unsigned const calls(t->count[n].exchange(0, std::memory_order_relaxed));
+					if (calls == 0) continue; // Note: time may be added in the next frame for zones that were ending during this drain
+					hist[n].time_ms[slot] += 1.0E-6f*t->time_ns[n].exchange(0, std::memory_order_relaxed);
+					hist[n].calls  [slot] += calls;
+				}
+			}
+		}
+		if (last_frame_ns > 0) {hist[FRAME_PROF_ROOT_NODE].time_ms[slot] = 1.0E-6f*(cur_ns - last_frame_ns); hist[FRAME_PROF_ROOT_NODE].calls[slot] = 1;}
+		last_frame_ns = cur_ns;
+		++num_frames;
+	}
+	void stats() {
+		if (num_frames == 0) return;
+		unsigned const nframes(min(num_frames, FRAME_PROF_HIST_SIZE));
+		vector<vector<unsigned>> children;
+		vector<string> names;
+		{
+			std::lock_guard<std::mutex> lock(reg_mutex);
+			children.resize(min((unsigned)nodes.size(), (unsigned)hist.size()));
+			for (unsigned n = 1; n < children.size(); ++n) {children[nodes[n].parent].push_back(n);}
+			names.assign(zone_names.begin(), zone_names.end());
+			for (auto &c : children) {sort(c.begin(), c.end(), [&](unsigned a, unsigned b) {return (names[nodes[a].zone] < names[nodes[b].zone]);});}
+		}
+		cout << "frame profiler over " << nframes << " frames (ms per frame): name calls average p50 p95 p99 max" << endl;
+		vector<float> vals(nframes);
+		vector<pair<unsigned, unsigned>> stack; // {node, depth}
+		stack.emplace_back(FRAME_PROF_ROOT_NODE, 0);
+
+		while (!stack.empty()) {
+			unsigned const n(stack.back().first), depth(stack.back().second);
+			stack.pop_back();
+			node_hist_t const &h(hist[n]);
+			unsigned calls(0);
+			float total(0.0), tmax(0.0);
+
+			for (unsigned f = 0; f < nframes; ++f) {
+				vals[f] = h.time_ms[f];
+				calls  += h.calls  [f];
+				total  += vals[f];
+				tmax    = max(tmax, vals[f]);
+			}
+			if (calls > 0) {
+				sort(vals.begin(), vals.end());
+				auto const pct([&](float p) {return vals[min(nframes-1, unsigned(p*nframes))];});
+				cout << string(2*depth, ' ') << names[nodes[n].zone] << ": " << float(calls)/nframes << "\t" << total/nframes << "\t"
+					 << pct(0.5) << "\t" << pct(0.95) << "\t" << pct(0.99) << "\t" << tmax << endl;
+			}
+			if (n >= children.size()) continue;
+			for (auto c = children[n].rbegin(); c != children[n].rend(); ++c) {stack.emplace_back(*c, depth+1);}
+		}
+	}
+};
+
+frame_profiler_t &get_frame_profiler() {
+	static frame_profiler_t frame_profiler; // constructed on first use, since zones may be registered during static init
+	return frame_profiler;
+}
+
+frame_prof_zone_t::frame_prof_zone_t(char const *const name) : id(get_frame_profiler().register_zone(name)) {}
+frame_prof_token_t frame_prof_begin_enabled(unsigned zone_id) {return get_frame_profiler().begin(zone_id);}
+void frame_prof_end_valid(frame_prof_token_t const &token) {get_frame_profiler().end(token);}
+unsigned frame_prof_get_cur_node() {return ((frame_profiler_enabled || trace_capture_active) ? get_frame_profiler().get_cur_node() : FRAME_PROF_INVALID);}
+unsigned frame_prof_set_cur_node(unsigned node) {return ((node == FRAME_PROF_INVALID) ? FRAME_PROF_INVALID : get_frame_profiler().set_cur_node(node));}
+
+void frame_profiler_end_frame() {
+	if (frame_profiler_enabled || trace_capture_active) {get_frame_profiler().end_frame();} // drain thread data even if only capturing traces
+	if (trace_capture_active && trace_capture.end_frame()) {stop_trace_capture_and_write();} // fixed length capture is done
+}
+void frame_profiler_stats() {
+	if (frame_profiler_enabled) {get_frame_profiler().stats();}
+}
@@ -8,15 +8,44 @@
 
 using namespace std::chrono;
 
+// Note: frame_prof_zone_t, frame_prof_token_t, frame_prof_begin(), and frame_prof_end() are declared in 3DWorld.h so that timer_t can use them
+
 class highres_timer_t { // should this share a base class with timer_t?
 	std::string name;
 	bool enabled, no_loading_screen;
+	frame_prof_token_t prof_token; // used when constructed from a frame profiler zone rather than a name
 	high_resolution_clock::time_point timer1;
 	high_resolution_clock clock;
 public:
 	highres_timer_t(char const *const name_,  bool enabled_=1, bool nls=0) : name(name_), enabled(enabled_), no_loading_screen(nls), timer1(clock.now()) {}
 	highres_timer_t(std::string const &name_, bool enabled_=1, bool nls=0) : name(name_), enabled(enabled_), no_loading_screen(nls), timer1(clock.now()) {}
+	// opt into the lock-free frame profiler; no string is constructed and nothing is printed or registered with the global profiler
+	highres_timer_t(frame_prof_zone_t const &zone, bool enabled_=1) : enabled(enabled_), no_loading_screen(1) {if (enabled) {prof_token = frame_prof_begin(zone.id);}}
 	~highres_timer_t() {end();}
 	void end();
 };
 
+// scoped frame profiler zone with no timer output; zones nest by scope and form a per-frame hierarchy
+class frame_prof_scope_t {
+	frame_prof_token_t token;
+public:
+	frame_prof_scope_t(frame_prof_zone_t const &zone) : token(frame_prof_begin(zone.id)) {}
+	~frame_prof_scope_t() {frame_prof_end(token);}
+};
+
+// zones opened on a worker thread start a new hierarchy and report as top-level zones unless the worker is given a parent node;
+// capture frame_prof_get_cur_node() on the thread that starts the OpenMP parallel region and open this scope on each worker
+class frame_prof_parent_scope_t {
+	unsigned prev_node;
+public:
+	frame_prof_parent_scope_t(unsigned node) : prev_node(frame_prof_set_cur_node(node)) {}
+	~frame_prof_parent_scope_t() {frame_prof_set_cur_node(prev_node);}
+};
+
+#define FRAME_PROF_CONCAT2(a, b) a##b
+#define FRAME_PROF_CONCAT(a, b) FRAME_PROF_CONCAT2(a, b)
+// zone IDs are registered once per call site through a function-local static, so the per-call cost is two clock reads and two atomic adds
+#define FRAME_PROF_ZONE(name) static frame_prof_zone_t const FRAME_PROF_CONCAT(fp_zone_, __LINE__)(name); \
+	frame_prof_scope_t const FRAME_PROF_CONCAT(fp_scope_, __LINE__)(FRAME_PROF_CONCAT(fp_zone_, __LINE__))
+#define FRAME_PROF_PARENT(node) frame_prof_parent_scope_t const FRAME_PROF_CONCAT(fp_parent_, __LINE__)(node)
+
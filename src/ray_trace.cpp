@@ -25,12 +25,14 @@ unsigned NPTS(50000), NRAYS(40000), LOCAL_RAYS(1000000), GLOBAL_RAYS(1000000), D
 std::atomic<unsigned long long> tot_rays(0), num_hits(0), cells_touched(0);
 unsigned const NUM_RAY_SPLITS [NUM_LIGHTING_TYPES] = {1, 1, 1, 1, 1}; // sky, global, local, cobj_accum, dynamic
 unsigned const INIT_RAY_SPLITS[NUM_LIGHTING_TYPES] = {1, 4, 1, 1, 1}; // sky, global, local, cobj_accum, dynamic
+unsigned const LIGHT_RAY_BATCH_SIZE = 256; // primary rays sorted into ray packets for cobj intersection
 
-extern bool has_snow, combined_gu, global_lighting_update, lighting_update_offline, store_cobj_accum_lighting_as_blocked;
+extern bool has_snow, combined_gu, global_lighting_update, lighting_update_offline, store_cobj_accum_lighting_as_blocked, chunked_lighting_files;
 extern int read_light_files[], write_light_files[], display_mode, DISABLE_WATER;
 extern float water_plane_z, temperature, snow_depth, ray_step_size_mult, first_ray_weight[];
 extern char *lighting_file[];
 extern point sun_pos, moon_pos;
+extern cube_t lighting_load_bounds;
 extern vector<light_source> light_sources_a;
 extern vector<light_source_trig> light_sources_d;
 extern coll_obj_group coll_objects;
@@ -221,46 +223,58 @@ unsigned add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point c
 	if (first_pt && dynamic) return 0; // since dynamic lights already have a direct lighting component, we skip the first ray here to avoid double counting it
 	if (first_pt) {weight *= first_ray_weight[ltype];} // lower weight - handled by direct illumination
 	if (fabs(weight) < TOLERANCE) return 0;
-	weight *= ray_step_size_mult;
-	colorRGBA const cw(color*weight);
-	unsigned const nsteps(1 + unsigned(p2p_dist(p1, p2)/get_step_size())); // round up (dist can be 0)
-	vector3d const step((p2 - p1)/nsteps); // at least two points
-	if (!first_pt) {p1 += step;} // move past the first step so we don't double count
+	// visit each grid cell crossed by the ray once and weight by the length inside the cell; the weight per unit length is the same as the
+	// old fixed step marching, which added weight once per get_step_size() (ray_step_size_mult cancels out); the end point isn't double counted
+	static thread_local vector<lmap_grid_seg_t> segs;
+	get_lmap_grid_segs(p1, p2, segs);
+	unsigned const nsegs(segs.size());
+	float const weight_per_len(weight/(0.3f*(DX_VAL + DY_VAL + DZ_VAL)));
+	static thread_local vector<float> seg_weights;
+	seg_weights.resize(nsegs);
+	for (unsigned s = 0; s < nsegs; ++s) {seg_weights[s] = weight_per_len*segs[s].len;} // vectorizable
 
-	// better time vs. quality tradeoff using a proper line drawing algorithm that chooses step size by distance to closest grid boundary and multiplies weight by segment length?
 	if (dynamic) { // it's a local lighting volume
 		light_volume_local &lvol(get_local_light_volume(ltype));
-
-		for (unsigned s = 0; s < nsteps; ++s) {
-			lvol.add_color(p1, cw);
-			p1 += step;
-		}
+		for (unsigned s = 0; s < nsegs; ++s) {lvol.add_color(segs[s].x, segs[s].y, segs[s].z, color*seg_weights[s]);}
 	}
 	else { // use the lmgr
 		assert(lmgr != nullptr && lmgr->is_allocated());
+		lmap_accum_t *const accum(lmap_accum_t::get_cur_for(lmgr)); // if set, this thread accumulates into private tiles that are reduced at the end of the job
 
-		for (unsigned s = 0; s < nsteps; ++s) {
-			lmcell *lmc(lmgr->get_lmcell_round_down(p1));
+		for (unsigned s = 0; s < nsegs; ++s) {
+			lmcell *lmc(lmgr->get_lmcell_checked(segs[s].x, segs[s].y, segs[s].z));
+			if (lmc == NULL) continue;
+			float const sw(seg_weights[s]);
+			colorRGBA const cw(color*sw);
 		
-			if (lmc != NULL) { // could use a mutex here, but it seems too slow
+			if (accum) {accum->add(*lmc, ltype, cw, sw);}
+			else { // single threaded, write directly
 				float *color(lmc->get_offset(ltype));
 				ADD_LIGHT_CONTRIB(cw, color);
-				if (ltype != LIGHTING_LOCAL) {color[3] += weight;}
+				if (ltype != LIGHTING_LOCAL) {color[3] += sw;}
 			}
-			p1 += step;
 		}
 		if (bcube) {
 			bcube->assign_or_union_with_pt(p1);
 			bcube->union_with_pt(p2);
 		}
-		lmgr->was_updated = 1;
+		if (!accum) {lmgr->was_updated = 1;} // else set when the accumulator is applied
 	}
-	return nsteps;
+	return nsegs;
+}
+
+
+bool clip_light_ray_to_scene(point &p1, point &p2) {
+
+	if (!do_line_clip_scene(p1, p2, min(zbottom, czmin), max(ztop, czmax))) return 0;
+	if ((display_mode & 0x01) && is_under_mesh(p1)) return 0;
+	return 1;
 }
 
 
+// query: optional cobj intersection result for this ray from a packet query, with p1 and p2 already clipped to the scene
 void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, float weight0, colorRGBA color, float line_length,
-	int ignore_cobj, int ltype, unsigned depth, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, cube_t *bcube=nullptr)
+	int ignore_cobj, int ltype, unsigned depth, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, cube_t *bcube=nullptr, coll_line_query_t const *query=nullptr)
 {
 	if (depth > MAX_RAY_BOUNCES) return;
 	if (ltype == LIGHTING_DYNAMIC && depth > 4) return; // use a sensible default since this is running during rendering
@@ -269,15 +283,24 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 
 	// find intersection point with scene cobjs
 	point orig_p1(p1);
-	if (!do_line_clip_scene(p1, p2, min(zbottom, czmin), max(ztop, czmax))) return;
-	if ((display_mode & 0x01) && is_under_mesh(p1)) return;
+	if (query) {p1 = query->p1; p2 = query->p2;}
+	else if (!clip_light_ray_to_scene(p1, p2)) return;
 	int cindex(-1), xpos(0), ypos(0);
 	point cpos(p2);
 	vector3d cnorm;
 	float t(0.0), zval(0.0);
-	bool snow_coll(0), ice_coll(0), water_coll(0), mesh_coll(0);
+	bool coll(0), snow_coll(0), ice_coll(0), water_coll(0), mesh_coll(0);
 	vector3d const dir((p2 - p1).get_norm());
-	bool coll(check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, ignore_cobj, 1, 0, 1, 1, (p1 == orig_p1), no_stat_moving)); // fast=1, exclude voxels, maybe skip init colls
+
+	if (query) { // already intersected as part of a ray packet
+		coll   = query->hit;
+		cindex = query->cindex;
+		cpos   = query->cpos;
+		cnorm  = query->cnorm;
+	}
+	else {
+		coll = check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, ignore_cobj, 1, 0, 1, 1, (p1 == orig_p1), no_stat_moving); // fast=1, exclude voxels, maybe skip init colls
+	}
 	assert(coll ? (cindex >= 0 && cindex < (int)coll_objects.size()) : (cindex == -1));
 
 	// find the intersection point with the model3ds
@@ -495,6 +518,88 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 }
 
 
+// interleave the bits of the quantized ray direction so that sorting by this key groups rays with similar directions
+unsigned get_ray_dir_sort_key(vector3d const &dir) { // dir need not be normalized
+
+	float const dmax(max(fabs(dir.x), max(fabs(dir.y), fabs(dir.z))));
+	if (dmax == 0.0) return 0;
+	unsigned key(0);
+
+	for (unsigned d = 0; d < 3; ++d) {
+		unsigned const v(min(1023U, unsigned(512.0*(dir[d]/dmax + 1.0)))); // 10 bits per dim
+
+		for (unsigned b = 0; b < 10; ++b) {
+			if (v & (1U << b)) {key |= (1U << (3*b + d));}
+		}
+	}
+	return key;
+}
+
+// buffers primary rays that share a light type and ignore_cobj so that their cobj intersections can be computed in ray packets;
+// rays are sorted by direction to form coherent packets, but are still cast in the order they were added, so results match calling
+// cast_light_ray() on each ray as long as the caller doesn't use rgen between add() calls; otherwise, call flush() before using rgen
+class light_ray_batch_t {
+	struct ray_t {
+		point p1, p2;
+		float weight, weight0;
+		colorRGBA color;
+		int query_ix; // -1 if the ray was clipped away
+	};
+	lmap_manager_t *lmgr;
+	float line_length;
+	int ignore_cobj, ltype;
+	rand_gen_t &rgen;
+	cobj_ray_accum_map_t *accum_map;
+	vector<ray_t> rays;
+	vector<coll_line_query_t> queries;
+	vector<pair<unsigned, unsigned>> sorted_queries; // {sort key, query index}
+public:
+	light_ray_batch_t(lmap_manager_t *lmgr_, float line_length_, int ignore_cobj_, int ltype_, rand_gen_t &rgen_, cobj_ray_accum_map_t *accum_map_) :
+		lmgr(lmgr_), line_length(line_length_), ignore_cobj(ignore_cobj_), ltype(ltype_), rgen(rgen_), accum_map(accum_map_)
+	{
+		rays.reserve(LIGHT_RAY_BATCH_SIZE);
+		queries.reserve(LIGHT_RAY_BATCH_SIZE);
+	}
+	~light_ray_batch_t() {flush();} // Note: discards pending rays if kill_raytrace was set
+
+	void add(point const &p1, point const &p2, float weight, float weight0, colorRGBA const &color) {
+		if (rays.size() == LIGHT_RAY_BATCH_SIZE) {flush();}
+		ray_t ray;
+		ray.p1 = p1; ray.p2 = p2; ray.weight = weight; ray.weight0 = weight0; ray.color = color; ray.query_ix = -1;
+		point cp1(p1), cp2(p2);
+
+		if (clip_light_ray_to_scene(cp1, cp2)) { // else cast_light_ray() will early exit
+			ray.query_ix = (int)queries.size();
+			queries.push_back(coll_line_query_t(cp1, cp2, (cp1 == p1))); // skip init colls if not clipped
+		}
+		rays.push_back(ray);
+	}
+	void discard() {
+		rays.clear();
+		queries.clear();
+	}
+	void flush() {
+		if (kill_raytrace) {discard(); return;} // ray tracing was aborted, don't cast the pending rays
+		sorted_queries.clear();
+		for (unsigned i = 0; i < queries.size(); ++i) {sorted_queries.emplace_back(get_ray_dir_sort_key(queries[i].p2 - queries[i].p1), i);}
+		sort(sorted_queries.begin(), sorted_queries.end());
+		coll_line_query_t packet[RAY_PACKET_SIZE];
+
+		for (unsigned i = 0; i < sorted_queries.size(); i += RAY_PACKET_SIZE) {
+			unsigned const num(min(RAY_PACKET_SIZE, unsigned(sorted_queries.size() - i)));
+			for (unsigned n = 0; n < num; ++n) {packet[n] = queries[sorted_queries[i+n].second];}
+			check_coll_line_exact_packet(packet, num, ignore_cobj, 1, no_stat_moving);
+			for (unsigned n = 0; n < num; ++n) {queries[sorted_queries[i+n].second] = packet[n];}
+		}
+		for (auto r = rays.begin(); r != rays.end(); ++r) {
+			coll_line_query_t const *query((r->query_ix >= 0) ? &queries[r->query_ix] : nullptr);
+			cast_light_ray(lmgr, r->p1, r->p2, r->weight, r->weight0, r->color, line_length, ignore_cobj, ltype, 0, rgen, accum_map, nullptr, query);
+		}
+		discard();
+	}
+};
+
+
 struct rt_data {
 	unsigned ix, num, job_id, checksum;
 	int rseed, ltype;
@@ -502,6 +607,7 @@ struct rt_data {
 	cube_t update_bcube;
 	lmap_manager_t *lmgr;
 	cobj_ray_accum_map_t accum_map;
+	lmap_accum_t lmap_accum;
 
 	rt_data(unsigned i=0, unsigned n=0, int s=1, bool t=0, bool v=0, bool r=0, int lt=0, unsigned jid=0)
 		: ix(i), num(n), job_id(jid), checksum(0), rseed(s), ltype(lt), is_thread(t), verbose(v), randomized(r), is_running(0), lmgr(nullptr) {update_bcube.set_to_zeros();}
@@ -512,9 +618,11 @@ struct rt_data {
 		assert(!is_running);
 		is_running = 1;
 		rgen.set_state(rseed, 1);
+		lmap_accum.begin(lmgr);
 	}
 	void post_run() {
 		assert(is_running); // can this fail due to race conditions? too strong? remove?
+		lmap_accum.end();
 		is_running = 0;
 	}
 };
@@ -554,6 +662,13 @@ public:
 thread_manager_t<rt_data> thread_manager;
 lmap_manager_t thread_temp_lmap;
 
+void apply_thread_lmap_accums(vector<rt_data> &data) { // call after all threads have finished
+	if (data.empty()) return;
+	lmap_accum_t &dest(data.front().lmap_accum);
+	for (auto i = data.begin()+1; i != data.end(); ++i) {dest.merge(i->lmap_accum); i->lmap_accum.clear();}
+	dest.apply_and_clear();
+}
+
 bool indir_lighting_updated() {return (global_lighting_update && (lmap_manager.was_updated || thread_temp_lmap.was_updated));} // only for global updates
 
 
@@ -583,7 +698,9 @@ void check_for_lighting_finished() { // to be called about once per frame
 
 	if (!thread_manager.is_active()) return; // inactive
 	if (thread_manager.any_threads_running()) return; // still running
-	thread_manager.join_and_clear(); // clear() or join_and_clear()?
+	thread_manager.join();
+	apply_thread_lmap_accums(thread_manager.data);
+	thread_manager.clear();
 	update_lmap_from_temp_copy();
 }
 
@@ -601,7 +718,6 @@ void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bo
 	if (use_temp_lmap) {thread_temp_lmap.init_from(lmap_manager);}
 
 	for (unsigned t = 0; t < data.size(); ++t) {
-		// create a custom lmap_manager_t for each thread then merge them together?
 		data[t] = rt_data(t, num_threads, 234323*(t+1), !single_thread, (verbose && t == 0), randomized, ltype, job_id);
 		data[t].lmgr = (use_temp_lmap ? &thread_temp_lmap : &lmap_manager);
 	}
@@ -613,6 +729,8 @@ void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bo
 		if (blocking) {thread_manager.join();}
 	}
 	if (blocking) {
+		apply_thread_lmap_accums(data);
+
 		if (enable_platform_lights(ltype)) {
 			merged_accum_map.clear();
 			for (auto i = data.begin(); i != data.end(); ++i) {merged_accum_map.merge(i->accum_map);}
@@ -641,12 +759,10 @@ bool cube_light_src_vect::ray_intersects_any(point const &start_pt, point const
 }
 
 
-void trace_one_global_ray(lmap_manager_t *lmgr, point const &pos, point const &pt, colorRGBA const &color, float ray_wt,
-	int ltype, bool is_scene_cube, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, float line_length)
-{
+void trace_one_global_ray(light_ray_batch_t &batch, point const &pos, point const &pt, colorRGBA const &color, float ray_wt, bool is_scene_cube, float line_length) {
 	point const end_pt(pt + (pt - pos).get_norm()*line_length);
 	if (is_scene_cube && global_cube_lights.ray_intersects_any(pt, end_pt)) return; // don't double count
-	cast_light_ray(lmgr, pos, end_pt, ray_wt, ray_wt, color, line_length, -1, ltype, 0, rgen, accum_map);
+	batch.add(pos, end_pt, ray_wt, ray_wt, color);
 }
 
 
@@ -655,6 +771,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 {
 	float const line_length(2.0*get_scene_radius());
 	vector3d const ldir((bnds.get_cube_center() - pos).get_norm());
+	light_ray_batch_t batch(lmgr, line_length, -1, ltype, rgen, accum_map); // Note: changes the order of rgen calls vs. casting each ray immediately
 	float proj_area[3] = {0}, tot_area(0.0);
 
 	for (unsigned i = 0; i < 3; ++i) { // adjust the number or weight of rays based on sun/moon position, or simply modify color scale?
@@ -681,7 +798,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 				if (verbose && ((s%1000) == 0)) {increment_printed_number(s/1000);}
 				pt[d0] = rgen.rand_uniform(bnds.d[d0][0], bnds.d[d0][1]);
 				pt[d1] = rgen.rand_uniform(bnds.d[d1][0], bnds.d[d1][1]);
-				trace_one_global_ray(lmgr, pos, pt, color, ray_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+				trace_one_global_ray(batch, pos, pt, color, ray_wt, is_scene_cube, line_length);
 			}
 		}
 		else {
@@ -698,7 +815,7 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 					if (kill_raytrace) break;
 					if (verbose && ((num%1000) == 0)) increment_printed_number(num/1000);
 					pt[d1] = bnds.d[d1][0] + (s1 + rgen.rand_uniform(0.0, 1.0))*len1/n1;
-					trace_one_global_ray(lmgr, pos, pt, color, ray_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+					trace_one_global_ray(batch, pos, pt, color, ray_wt, is_scene_cube, line_length);
 				}
 			}
 		}
@@ -771,6 +888,7 @@ void trace_ray_block_sky(rt_data *data) {
 		}
 		sort(pts.begin(), pts.end());
 		if (data->verbose) {cout << "Sky light source progress (of " << block_npts << "): 0";}
+		light_ray_batch_t batch(data->lmgr, line_length, -1, LIGHTING_SKY, rgen, &data->accum_map);
 
 		for (unsigned p = 0; p < block_npts; ++p) {
 			if (kill_raytrace) break;
@@ -789,9 +907,10 @@ void trace_ray_block_sky(rt_data *data) {
 				if (dot_product(dirs[r], pt) >= 0.0) continue; // can get here when (-Z_SCENE_SIZE, Z_SCENE_SIZE) does not contain (czmin, czmax)
 				point const end_pt(pt + dirs[r]*line_length);
 				if (sky_cube_lights.ray_intersects_any(pt, end_pt)) continue; // don't double count
-				cast_light_ray(data->lmgr, pt, end_pt, ray_wt, ray_wt, WHITE, line_length, -1, LIGHTING_SKY, 0, rgen, &data->accum_map);
+				batch.add(pt, end_pt, ray_wt, ray_wt, WHITE);
 				++start_rays;
 			}
+			batch.flush(); // must flush before generating the next set of dirs
 		}
 		if (data->verbose) {cout << endl;}
 	}
@@ -847,6 +966,7 @@ void trace_ray_block_cobj_accum(rt_data *data) {
 	rand_gen_t rgen;
 	data->pre_run(rgen);
 	float const line_length(2.0*get_scene_radius()), ray_wt(get_sky_light_ray_weight()); // Note: weight assumes not using cube sky lights
+	light_ray_batch_t batch(data->lmgr, line_length, -1, LIGHTING_COBJ_ACCUM, rgen, nullptr);
 
 	for (auto i = merged_accum_map.begin(); i != merged_accum_map.end(); ++i) {
 		coll_obj &cobj(find_accum_cobj(i->first, i->second));
@@ -857,8 +977,9 @@ void trace_ray_block_cobj_accum(rt_data *data) {
 			if (kill_raytrace) break; // not needed?
 			assert(r->weight > 0.0);
 			float const weight0(ray_wt ? ray_wt : r->weight);
-			cast_light_ray(data->lmgr, r->pos, r->get_p2(line_length), r->weight, weight0, r->get_color(), line_length, -1, LIGHTING_COBJ_ACCUM, 0, rgen, nullptr, nullptr);
+			batch.add(r->pos, r->get_p2(line_length), r->weight, weight0, r->get_color());
 		}
+		batch.flush(); // flush before the next cobj is modified
 	}
 	data->post_run();
 }
@@ -924,6 +1045,7 @@ void ray_trace_local_light_source(lmap_manager_t *lmgr, light_source const &ls,
 		}
 		assert(tot_area > 0.0);
 		//cout << TXT(tot_area) << TXT(radius) << TXT(ray_wt) << TXT(num_rays) << TXT(N_RAYS) << endl;
+		light_ray_batch_t batch(lmgr, line_length, -1, ltype, rgen, nullptr); // init_cobj not used here
 
 		for (unsigned dim = 0; dim < 3; ++dim) {
 			unsigned const d1((dim+1)%3), d2((dim+2)%3);
@@ -945,7 +1067,7 @@ void ray_trace_local_light_source(lmap_manager_t *lmgr, light_source const &ls,
 					start_pt[d1] = rgen.rand_uniform(cube.d[d1][0], cube.d[d1][1]);
 					start_pt[d2] = rgen.rand_uniform(cube.d[d2][0], cube.d[d2][1]);
 					point const end_pt(start_pt + dir*line_length);
-					cast_light_ray(lmgr, start_pt, end_pt, ray_wt, ray_wt, lcolor, line_length, -1, ltype, 0, rgen, nullptr); // init_cobj not used here
+					batch.add(start_pt, end_pt, ray_wt, ray_wt, lcolor);
 				} // for n
 			} // for dir
 		} // for dim
@@ -955,6 +1077,7 @@ void ray_trace_local_light_source(lmap_manager_t *lmgr, light_source const &ls,
 	int init_cobj(-1);
 	check_coll_line(lpos, lpos2, init_cobj, -1, 1, 2); // find most opaque (max alpha) containing object
 	assert(init_cobj < (int)coll_objects.size());
+	light_ray_batch_t batch(lmgr, line_length, init_cobj, ltype, rgen, nullptr);
 
 	for (unsigned n = 0; n < num_rays; ++n) {
 		if (kill_raytrace) break;
@@ -991,7 +1114,7 @@ void ray_trace_local_light_source(lmap_manager_t *lmgr, light_source const &ls,
 			if (line_light) {start_pt += n*delta;} // fixed spacing along the length of the line
 		}
 		point const end_pt(start_pt + dir*line_length);
-		cast_light_ray(lmgr, start_pt, end_pt, weight, weight, lcolor, line_length, init_cobj, ltype, 0, rgen, nullptr);
+		batch.add(start_pt, end_pt, weight, weight, lcolor);
 	} // for n
 }
 
@@ -1061,7 +1184,7 @@ void compute_ray_trace_lighting(unsigned ltype, bool verbose) {
 				launch_threaded_job(NUM_THREADS, rt_funcs[c_ltype], verbose, 1, 0, 0, ltype); // update fully blocked lighting with currently blocked portion
 			}
 		}
-		else {lmap_manager.read_data_from_file(fn, c_ltype);}
+		else {lmap_manager.read_data_from_file(fn, c_ltype, &lighting_load_bounds);}
 	}
 	else {
 		if (c_ltype != LIGHTING_LOCAL && !dynamic) {cout << X_SCENE_SIZE << " " << Y_SCENE_SIZE << " " << Z_SCENE_SIZE << " " << czmin << " " << czmax << endl;}
@@ -1132,14 +1255,195 @@ void check_all_platform_cobj_lighting_update() {
 // lmap_manager_t
 
 
-bool lmap_manager_t::read_data_from_file(char const *const fn, int ltype) {
+// chunked lighting file format: header, chunk index, then zlib compressed chunks; each chunk stores the allocated columns of a
+// CHUNK_XY x CHUNK_XY tile of the XY grid, so chunks can be read in any order and chunks outside lighting_load_bounds can be skipped;
+// the legacy format starts with data_size rather than the magic number, and is still supported for reading and writing
+unsigned const LMAP_CHUNK_MAGIC = 0x31636d6c; // "lmc1"
+unsigned const LMAP_CHUNK_XY    = 32;
+
+struct lmap_chunk_file_header_t {
+	unsigned magic=LMAP_CHUNK_MAGIC, dsz=0, data_size=0, xsize=0, ysize=0, zsize=0, chunk_xy=LMAP_CHUNK_XY, num_chunks=0;
+};
+struct lmap_chunk_entry_t {
+	uint64_t offset=0; // from the start of the file
+	unsigned comp_size=0, raw_size=0; // in bytes
+};
+
+bool lmap_manager_t::write_chunked_data(char const *const fn, int ltype) const {
+
+	unsigned const dsz(lmcell::get_dsz(ltype)), ncx((lm_xsize + LMAP_CHUNK_XY - 1)/LMAP_CHUNK_XY), ncy((lm_ysize + LMAP_CHUNK_XY - 1)/LMAP_CHUNK_XY);
+	lmap_chunk_file_header_t header;
+	header.dsz = dsz; header.data_size = vldata_alloc.size(); header.xsize = lm_xsize; header.ysize = lm_ysize; header.zsize = lm_zsize; header.num_chunks = ncx*ncy;
+	vector<lmap_chunk_entry_t> index(header.num_chunks);
+	vector<vector<unsigned char>> chunks(header.num_chunks);
+	std::atomic<bool> had_error(0);
+
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < (int)header.num_chunks; ++c) { // compression is the slow part, so do it in parallel
+		unsigned const x1((c % ncx)*LMAP_CHUNK_XY), y1((c / ncx)*LMAP_CHUNK_XY), x2(min(lm_xsize, x1+LMAP_CHUNK_XY)), y2(min(lm_ysize, y1+LMAP_CHUNK_XY));
+		vector<float> raw;
+
+		for (unsigned y = y1; y < y2; ++y) {
+			for (unsigned x = x1; x < x2; ++x) {
+				lmcell const *const col(vlmap[y][x]);
+				if (col == NULL) continue; // not allocated
+				for (unsigned z = 0; z < lm_zsize; ++z) {raw.insert(raw.end(), col[z].get_offset(ltype), col[z].get_offset(ltype)+dsz);}
+			}
+		}
+		if (raw.empty()) continue; // no allocated columns
+		uLongf comp_size(compressBound(raw.size()*sizeof(float)));
+		chunks[c].resize(comp_size);
+		if (compress2(chunks[c].data(), &comp_size, (unsigned char const *)raw.data(), raw.size()*sizeof(float), Z_DEFAULT_COMPRESSION) != Z_OK) {had_error = 1; continue;}
+		chunks[c].resize(comp_size);
+		index[c].comp_size = comp_size;
+		index[c].raw_size  = raw.size()*sizeof(float);
+	} // for c
+	if (had_error) {
+		cerr << "Error compressing data for lighting file " << fn << endl;
+		return 0;
+	}
+	uint64_t offset(sizeof(lmap_chunk_file_header_t) + index.size()*sizeof(lmap_chunk_entry_t)), tot_raw(0);
+
+	for (lmap_chunk_entry_t &e : index) {
+		e.offset = offset;
+		offset  += e.comp_size;
+		tot_raw += e.raw_size;
+	}
+	binary_file_writer writer;
+	if (!writer.open(fn)) return 0;
+	cout << "Writing chunked lighting file to " << fn << endl;
 
+	if (!writer.write(&header, sizeof(header), 1) || !writer.write(index.data(), sizeof(lmap_chunk_entry_t), index.size())) {
+		cerr << "Error writing header to lighting file " << fn << endl;
+		return 0;
+	}
+	for (vector<unsigned char> const &chunk : chunks) {
+		if (!chunk.empty() && !writer.write(chunk.data(), 1, chunk.size())) {
+			cerr << "Error writing data to lighting file " << fn << endl;
+			return 0;
+		}
+	}
+	cout << "Compressed lighting data from " << tot_raw << " to " << (offset - index.front().offset) << " bytes in " << index.size() << " chunks" << endl;
+	return 1;
+}
+
+// reads a chunked file after the magic number; chunks that don't overlap load_bounds (if non-null and nonzero) are skipped and keep their current values;
+// all chunks are read and validated before any lighting values are modified, so on error the lmap is unchanged
+bool lmap_manager_t::read_chunked_data(binary_file_reader &reader, char const *const fn, int ltype, cube_t const *const load_bounds) {
+
+	lmap_chunk_file_header_t header;
+	unsigned const dsz(lmcell::get_dsz(ltype));
+
+	if (!reader.read(&header.dsz, sizeof(header) - sizeof(unsigned), 1)) { // magic was already read
+		cerr << "Error reading header from lighting file " << fn << endl;
+		return 0;
+	}
+	if (header.dsz != dsz || header.data_size != vldata_alloc.size() || header.xsize != lm_xsize || header.ysize != lm_ysize || header.zsize != lm_zsize || header.chunk_xy == 0) {
+		cerr << "Error: Lighting file " << fn << " with data size " << header.data_size << " and grid size " << header.xsize << "x" << header.ysize << "x" << header.zsize
+			 << " does not match the expected size of " << vldata_alloc.size() << " and " << lm_xsize << "x" << lm_ysize << "x" << lm_zsize << ". Ignoring file." << endl;
+		return 0;
+	}
+	unsigned const chunk_xy(header.chunk_xy), ncx((lm_xsize + chunk_xy - 1)/chunk_xy), ncy((lm_ysize + chunk_xy - 1)/chunk_xy);
+
+	if (header.num_chunks != ncx*ncy) {
+		cerr << "Error: Invalid number of chunks in lighting file " << fn << ". Ignoring file." << endl;
+		return 0;
+	}
+	vector<lmap_chunk_entry_t> index(header.num_chunks);
+
+	if (!reader.read(index.data(), sizeof(lmap_chunk_entry_t), index.size())) {
+		cerr << "Error reading chunk index from lighting file " << fn << endl;
+		return 0;
+	}
+	auto get_chunk_range([&](unsigned c, unsigned &x1, unsigned &y1, unsigned &x2, unsigned &y2) {
+		x1 = (c % ncx)*chunk_xy; y1 = (c / ncx)*chunk_xy; x2 = min(lm_xsize, x1+chunk_xy); y2 = min(lm_ysize, y1+chunk_xy);
+	});
+	for (unsigned c = 0; c < index.size(); ++c) { // validate sizes against our column allocation before allocating anything
+		unsigned x1, y1, x2, y2, num_cols(0);
+		get_chunk_range(c, x1, y1, x2, y2);
+
+		for (unsigned y = y1; y < y2; ++y) {
+			for (unsigned x = x1; x < x2; ++x) {num_cols += (vlmap[y][x] != NULL);}
+		}
+		if (index[c].raw_size != num_cols*lm_zsize*dsz*sizeof(float) || (index[c].comp_size == 0) != (num_cols == 0)) {
+			cerr << "Error: Chunk size doesn't match the lighting volume in lighting file " << fn << ". Ignoring file." << endl;
+			return 0;
+		}
+	}
+	int cx1(0), cx2(ncx), cy1(0), cy2(ncy); // range of chunks to load
+	bool const is_partial(load_bounds != nullptr && !load_bounds->is_all_zeros());
+
+	if (is_partial) { // Note: load_bounds is converted with the scene grid, so this is only valid for the scene lmap
+		cx1 = max(0, get_xpos_round_down(load_bounds->x1())/int(chunk_xy)); cx2 = min(int(ncx), get_xpos_round_down(load_bounds->x2())/int(chunk_xy)+1);
+		cy1 = max(0, get_ypos_round_down(load_bounds->y1())/int(chunk_xy)); cy2 = min(int(ncy), get_ypos_round_down(load_bounds->y2())/int(chunk_xy)+1);
+	}
+	vector<unsigned> to_load;
+
+	for (int cy = cy1; cy < cy2; ++cy) {
+		for (int cx = cx1; cx < cx2; ++cx) {
+			unsigned const c(cy*ncx + cx);
+			if (index[c].comp_size > 0) {to_load.push_back(c);}
+		}
+	}
+	sort(to_load.begin(), to_load.end(), [&index](unsigned a, unsigned b) {return (index[a].offset < index[b].offset);}); // read in file order
+	vector<vector<unsigned char>> chunks(to_load.size());
+
+	for (unsigned i = 0; i < to_load.size(); ++i) { // serial file reads; only the selected chunks are read
+		lmap_chunk_entry_t const &e(index[to_load[i]]);
+		chunks[i].resize(e.comp_size);
+
+		if (!reader.seek(e.offset) || !reader.read(chunks[i].data(), 1, e.comp_size)) {
+			cerr << "Error reading data from lighting file " << fn << endl;
+			return 0;
+		}
+	}
+	vector<vector<float>> raw(to_load.size());
+	std::atomic<bool> had_error(0);
+
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)to_load.size(); ++i) { // decompress in parallel into temp buffers
+		unsigned const c(to_load[i]);
+		raw[i].resize(index[c].raw_size/sizeof(float)); // raw_size was validated above
+		uLongf raw_size(index[c].raw_size);
+		if (uncompress((unsigned char *)raw[i].data(), &raw_size, chunks[i].data(), chunks[i].size()) != Z_OK || raw_size != index[c].raw_size) {had_error = 1;}
+		vector<unsigned char>().swap(chunks[i]); // free compressed data
+	}
+	if (had_error) {
+		cerr << "Error: Invalid chunk data in lighting file " << fn << endl;
+		return 0;
+	}
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)to_load.size(); ++i) { // all chunks are valid, commit them; each chunk writes to a disjoint set of columns
+		unsigned x1, y1, x2, y2, pos(0);
+		get_chunk_range(to_load[i], x1, y1, x2, y2);
+
+		for (unsigned y = y1; y < y2; ++y) {
+			for (unsigned x = x1; x < x2; ++x) {
+				lmcell *const col(vlmap[y][x]);
+				if (col == NULL) continue; // not allocated
+
+				for (unsigned z = 0; z < lm_zsize; ++z) {
+					float *ptr(col[z].get_offset(ltype));
+					for (unsigned n = 0; n < dsz; ++n) {ptr[n] = raw[i][pos++];}
+				}
+			}
+		}
+		assert(pos == raw[i].size());
+	} // for i
+	partial_load[ltype] = is_partial;
+	cout << "Read " << to_load.size() << " lighting chunks" << (is_partial ? " (partial load)" : "") << endl;
+	return 1;
+}
+
+bool lmap_manager_t::read_data_from_file(char const *const fn, int ltype, cube_t const *const load_bounds) {
 	assert(fn != nullptr);
+	assert(!is_compact());
 	binary_file_reader reader;
 	if (!reader.open(fn)) return 0;
 	cout << "Reading lighting file from " << fn << endl;
 	unsigned data_size(0);
 	if (!reader.read(&data_size, sizeof(unsigned), 1)) return 0;
+	if (data_size == LMAP_CHUNK_MAGIC) {return read_chunked_data(reader, fn, ltype, load_bounds);}
 
 	if (data_size != vldata_alloc.size()) {
 		cerr << "Error: Lighting file " << fn << " data size of " << data_size
@@ -1159,13 +1463,20 @@ bool lmap_manager_t::read_data_from_file(char const *const fn, int ltype) {
 		for (unsigned n = 0; n < sz; ++n) {ptr[n] = data[pos++];}
 	}
 	assert(pos == data.size());
+	partial_load[ltype] = 0;
 	return 1;
 }
 
 
 bool lmap_manager_t::write_data_to_file(char const *const fn, int ltype) const {
-
+	assert(!is_compact());
 	if (fn == nullptr || strcmp(fn, "''") == 0 || strcmp(fn, "\"\"") == 0) return 0; // don't write
+
+	if (partial_load[ltype]) { // writing would replace the unloaded parts of the file with default values
+		cerr << "Error: Not writing lighting file " << fn << " because it was only partially loaded (lighting_load_bounds)" << endl;
+		return 0;
+	}
+	if (chunked_lighting_files) {return write_chunked_data(fn, ltype);}
 	binary_file_writer writer;
 	if (!writer.open(fn)) return 0;
 	cout << "Writing lighting file to " << fn << endl;
@@ -1184,8 +1495,8 @@ bool lmap_manager_t::write_data_to_file(char const *const fn, int ltype) const {
 
 
 void lmap_manager_t::clear_lighting_values(int ltype) {
-
 	assert(ltype < NUM_LIGHTING_TYPES && !is_ltype_dynamic(ltype));
+	assert(!is_compact());
 	unsigned const num(lmcell::get_dsz(ltype));
 
 	for (vector<lmcell>::iterator i = vldata_alloc.begin(); i != vldata_alloc.end(); ++i) {
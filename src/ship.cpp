@@ -493,6 +493,8 @@ void remove_bad_cobjs_and_particles(vector<cached_obj> &objs) {
 void apply_univ_physics() {
 
 	if (show_framerate) show_stats();
+	static frame_prof_zone_t const prof_zone("Universe Physics");
+	timer_t const prof_timer(prof_zone); // frame profiler only
 	unsigned nsh(0), npr(0), npa(0); // testing
 	RESET_TIME;
 	if (animate2) {trail_rays.clear(); beam_rays.clear();}
@@ -599,8 +601,25 @@ void apply_univ_physics() {
 void sort_uobjects() { // originally part of apply_univ_physics()
 
 	get_cached_objs(uobjs, c_uobjs); // re-validate since new objects may have been added and old ones may have moved
-	sort(c_uobjs.begin(), c_uobjs.end(), comp_co_fast_x()); // re-sort
+	// existing objects are still in last frame's order and have only moved slightly, so repair their order with an insertion sort;
+	// new objects are appended to the end in creation order, so sort them separately and merge the two
+	static vector<cached_obj> new_objs;
+	new_objs.clear();
+	auto o(c_uobjs.begin());
+
+	for (auto i = c_uobjs.begin(); i != c_uobjs.end(); ++i) {
+		if (i->flags & OBJ_FLAGS_NEW_) {new_objs.push_back(*i); continue;}
+		if (o != i) {*o = *i;}
+		++o;
+	}
+	size_t const num_old(o - c_uobjs.begin());
+	c_uobjs.resize(num_old);
+	adaptive_sort(c_uobjs, comp_co_fast_x()); // falls back to a full sort if the order changed too much
+	sort(new_objs.begin(), new_objs.end(), comp_co_fast_x());
+	vector_add_to(new_objs, c_uobjs);
+	std::inplace_merge(c_uobjs.begin(), (c_uobjs.begin() + num_old), c_uobjs.end(), comp_co_fast_x());
 	unsigned const ncuo((unsigned)c_uobjs.size());
+	assert(ncuo == uobjs.size());
 
 	// update uobjs to have the same sort order
 	for (unsigned i = 0; i < ncuo; ++i) {uobjs[i] = c_uobjs[i].obj;} // what about objects with time == 0? exclude them?
@@ -629,13 +648,49 @@ bool proc_coll(free_obj *o1, free_obj *o2) {
 }
 
 
+struct coll_pair_t {
+	unsigned a, b; // a = object being added to the sweep, b = object already in the sweep
+	coll_pair_t(unsigned a_, unsigned b_) : a(a_), b(b_) {}
+};
+
+unsigned const COLL_SWEEP_CHUNK_SZ = 4096; // in intervals
+
+unsigned get_coll_bad_flags(unsigned ix_flags) {
+	unsigned bad_flags(OBJ_FLAGS_BAD_);
+	if ( ix_flags & OBJ_FLAGS_PART) {bad_flags |= OBJ_FLAGS_PART;} // skip particle-particle collisions
+	if ( ix_flags & OBJ_FLAGS_NOC2) {bad_flags |= OBJ_FLAGS_NOC2;} // both objects have their C2 flags set, skip the collision
+	if ((ix_flags & OBJ_FLAGS_PROJ) && (ix_flags & OBJ_FLAGS_NOPC)) {bad_flags |= OBJ_FLAGS_PROJ;} // no projectile-projectile collision
+	return bad_flags;
+}
+bool obj_coll_candidate(cached_obj const &obj_i, cached_obj const &obj, unsigned bad_flags) {
+	if (obj.flags & bad_flags) return 0;
+	float const radius(obj_i.radius + obj.radius);
+	return (fabs(obj_i.pos.y - obj.pos.y) <= radius && dist_less_than(obj_i.pos, obj.pos, radius));
+}
+void update_sweep_work(interval const &iv, vector<unsigned> &locs, vector<unsigned> &work) { // add or remove an object from the active set
+	unsigned const ix(iv.ix & ~LEFT_EDGE_BIT);
+
+	if (iv.ix & LEFT_EDGE_BIT) { // start a new sphere
+		locs[ix] = work.size();
+		work.push_back(ix);
+	}
+	else { // end a current sphere
+		assert(!work.empty());
+		unsigned const lix(locs[ix]);
+		//assert(ix < size && lix < work.size() && work[lix] == ix && locs[work.back()] == work.size()-1);
+		swap(work[lix], work.back());
+		locs[work[lix]] = lix;
+		work.pop_back();
+	}
+}
+
 void collision_detect_objects(vector<cached_obj> &objs, unsigned t) {
 
 	//RESET_TIME;
 	unsigned const size((unsigned)objs.size());
-	static vector<interval> intervals;
-	intervals.clear();
-	intervals.reserve(2*size);
+	static vector<interval> intervals, lefts, rights;
+	lefts .clear();
+	rights.clear();
 
 	for (unsigned i = 0; i < size; ++i) {
 		if (objs[i].flags & OBJ_FLAGS_BAD_) continue;
@@ -650,54 +705,73 @@ void collision_detect_objects(vector<cached_obj> &objs, unsigned t) {
 		assert(radius > 0.0);
 		if (left == right) continue; // floating point precision limitation or bug?
 		assert(left < right);
-		intervals.push_back(interval(left,  i, 1));
-		intervals.push_back(interval(right, i, 0));
+		lefts .push_back(interval(left,  i, 1));
+		rights.push_back(interval(right, i, 0));
 	}
+	// objs is in x order from sort_uobjects() (and positions change little per step), so the left and right edges are each nearly sorted;
+	// repair each with an insertion sort and merge them, rather than doing a full sort of all edges
+	adaptive_sort(lefts,  std::less<interval>());
+	adaptive_sort(rights, std::less<interval>());
+	intervals.resize(lefts.size() + rights.size());
+	std::merge(lefts.begin(), lefts.end(), rights.begin(), rights.end(), intervals.begin()); // left edges first for equal values
 	unsigned const size2((unsigned)intervals.size());
+	// broad phase: sweep the sorted intervals in parallel chunks, where each chunk starts from a snapshot of the active set;
+	// since the snapshots and the swap-remove order are the same as a serial sweep, concatenating the chunks' pairs gives the serial pair order
+	unsigned const num_chunks(max(1U, (size2 + COLL_SWEEP_CHUNK_SZ - 1)/COLL_SWEEP_CHUNK_SZ));
 	static vector<unsigned> locs, work;
+	static vector<vector<unsigned>> chunk_work;
+	static vector<vector<coll_pair_t>> chunk_pairs;
 	locs.resize(size);
 	work.clear();
-	sort(intervals.begin(), intervals.end());
-
-	for (unsigned i = 0; i < size2; ++i) {
-		unsigned const ix(intervals[i].ix & ~LEFT_EDGE_BIT), ix_flags(objs[ix].flags);
-		unsigned bad_flags(OBJ_FLAGS_BAD_);
-		if ( ix_flags & OBJ_FLAGS_PART) {bad_flags |= OBJ_FLAGS_PART;} // skip particle-particle collisions
-		if ( ix_flags & OBJ_FLAGS_NOC2) {bad_flags |= OBJ_FLAGS_NOC2;} // both objects have their C2 flags set, skip the collision
-		if ((ix_flags & OBJ_FLAGS_PROJ) && (ix_flags & OBJ_FLAGS_NOPC)) {bad_flags |= OBJ_FLAGS_PROJ;} // no projectile-projectile collision
-		
-		if (intervals[i].ix & LEFT_EDGE_BIT) { // start a new sphere
-			unsigned const wsize((unsigned)work.size());
-
-			if (wsize > 0) {
-				point const pos_i(objs[ix].pos);
-				float const c_radius_i(objs[ix].radius), pisd(pos_i.y);
-
-				for (unsigned k = 0; k < wsize; ++k) {
-					cached_obj &obj(objs[work[k]]);
-					if (obj.flags & bad_flags) continue;
-					float const radius(c_radius_i + obj.radius);
-					if (fabs(pisd - obj.pos.y) > radius || !dist_less_than(pos_i, obj.pos, radius)) continue; // no intersection
-
-					if (proc_coll(objs[ix].obj, obj.obj)) {
-						objs[ix].refresh(); // ???
-						obj.refresh(); // ???
+	chunk_work .resize(num_chunks);
+	chunk_pairs.resize(num_chunks);
+
+	for (unsigned i = 0; i < size2; ++i) { // serial pass to record the active set at the start of each chunk
+		if ((i % COLL_SWEEP_CHUNK_SZ) == 0) {chunk_work[i/COLL_SWEEP_CHUNK_SZ] = work;}
+		update_sweep_work(intervals[i], locs, work);
+	}
+	assert(work.empty());
+
+#pragma omp parallel if (num_chunks > 1)
+	{
+		vector<unsigned> chunk_locs(size); // per-thread
+
+#pragma omp for schedule(dynamic,1)
+		for (int c = 0; c < (int)num_chunks; ++c) {
+			unsigned const start(c*COLL_SWEEP_CHUNK_SZ), end(min(size2, start+COLL_SWEEP_CHUNK_SZ));
+			vector<unsigned> &cwork(chunk_work[c]);
+			vector<coll_pair_t> &pairs(chunk_pairs[c]);
+			pairs.clear();
+			for (unsigned k = 0; k < cwork.size(); ++k) {chunk_locs[cwork[k]] = k;}
+
+			for (unsigned i = start; i < end; ++i) {
+				unsigned const ix(intervals[i].ix & ~LEFT_EDGE_BIT);
+
+				if (intervals[i].ix & LEFT_EDGE_BIT) { // start a new sphere; test against current objects using their positions at the start of this step
+					cached_obj const &obj_i(objs[ix]);
+					unsigned const bad_flags(get_coll_bad_flags(obj_i.flags));
+
+					for (unsigned k = 0; k < cwork.size(); ++k) {
+						if (obj_coll_candidate(obj_i, objs[cwork[k]], bad_flags)) {pairs.emplace_back(ix, cwork[k]);}
 					}
 				}
+				update_sweep_work(intervals[i], chunk_locs, cwork);
+			} // for i
+		} // for c
+	} // end omp parallel
+
+	// narrow phase: resolve pairs serially in sweep order; collisions can move or destroy objects, so recheck with refreshed cached positions and flags
+	for (unsigned c = 0; c < num_chunks; ++c) {
+		for (coll_pair_t const &p : chunk_pairs[c]) {
+			cached_obj &obj_i(objs[p.a]), &obj(objs[p.b]);
+			if (!obj_coll_candidate(obj_i, obj, get_coll_bad_flags(obj_i.flags))) continue; // no intersection
+
+			if (proc_coll(obj_i.obj, obj.obj)) {
+				obj_i.refresh(); // ???
+				obj.refresh(); // ???
 			}
-			locs[ix] = wsize;
-			work.push_back(ix);
-		}
-		else { // end a current sphere
-			assert(!work.empty());
-			unsigned const lix(locs[ix]);
-			//assert(ix < size && lix < work.size() && work[lix] == ix && locs[work.back()] == work.size()-1);
-			swap(work[lix], work.back());
-			locs[work[lix]] = lix;
-			work.pop_back();
 		}
 	}
-	assert(work.empty());
 	//PRINT_TIME("Collision");
 }
 
@@ -8,6 +8,12 @@
 #include "openal_wrap.h"
 #include "heightmap.h"
 #include "profiler.h"
+#include "fnv_hash.h"
+#include <list>
+#include <zlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 
 bool const DEBUG_TILES        = 0;
@@ -52,7 +58,8 @@ struct clear_area_t : public cube_t {
 
 bool tt_lightning_enabled(0), check_tt_mesh_occlusion(1), shadow_maps_disabled(0);
 unsigned inf_terrain_fire_mode(0); // none, increase height, decrease height
-string read_hmap_modmap_fn, write_hmap_modmap_fn("heightmap.mod");
+string read_hmap_modmap_fn, write_hmap_modmap_fn("heightmap.mod"), tile_cache_dir; // tile_cache_dir: optional disk cache directory, which must exist
+unsigned tile_cache_mem_mb(64); // memory limit for cached compressed tile heights; 0 = disable
 hmap_brush_param_t cur_brush_param;
 tile_offset_t model3d_offset;
 vector<clear_area_t> tile_smaps_to_clear;
@@ -60,11 +67,13 @@ vector<clear_area_t> tile_smaps_to_clear;
 extern bool inf_terrain_scenery, enable_tiled_mesh_ao, underwater, fog_enabled, volume_lighting, combined_gu, enable_depth_clamp, tt_triplanar_tex, use_grass_tess;
 extern bool use_instanced_pine_trees, enable_tt_model_reflect, water_is_lava, tt_fire_button_down, flashlight_on, camera_in_building, rotate_trees;
 extern bool player_in_int_elevator;
-extern unsigned grass_density, max_unique_trees, shadow_map_sz, erosion_iters_tt, num_rnd_grass_blocks, tiled_terrain_gen_heightmap_sz;
+extern unsigned NUM_THREADS, erosion_iters_tt, grass_density, max_unique_trees, shadow_map_sz, num_rnd_grass_blocks, tiled_terrain_gen_heightmap_sz;
 extern unsigned num_birds_per_tile, num_fish_per_tile, num_bflies_per_tile, room_geom_mem;
 extern int DISABLE_WATER, display_mode, tree_mode, leaf_color_changed, ground_effects_level, animate2, iticks, num_trees, window_width, window_height, player_in_basement;
 extern int invert_mh_image, is_cloudy, camera_surf_collide, show_fog, mesh_gen_mode, mesh_gen_shape, cloud_model, precip_mode, auto_time_adv, draw_model;
 extern int player_in_elevator, player_in_attic;
+extern int mesh_seed, mesh_rgen_index, GLACIATE, mesh_freq_filter;
+extern float erode_amount, glaciate_exp, MESH_START_MAG, MESH_START_FREQ, MESH_MAG_MULT, MESH_FREQ_MULT, mesh_height_scale, mesh_file_scale, mesh_file_tz;
 extern float zmax, zmin, water_plane_z, mesh_scale, mesh_scale_z, vegetation, relh_adj_tex, grass_length, grass_width, fticks, cloud_height_offset, clouds_per_tile;
 extern float ocean_wave_height, sm_tree_density, tree_density_thresh, atmosphere, cloud_cover, temperature, flower_density, FAR_CLIP, biome_x_offset;
 extern float smap_thresh_scale, tt_grass_scale_factor, pond_max_depth;
@@ -95,6 +104,7 @@ void get_city_grass_coll_cubes(cube_t const &region, vect_cube_t &out, vect_cube
 int check_city_contains_overlaps(cube_t const &query);
 bool check_inside_city(point const &pos, float radius);
 cube_t get_city_bcube_overlapping(cube_t const &c);
+bool using_hmap_with_detail();
 void show_gpu_mem_info();
 
 
@@ -126,6 +136,13 @@ float get_tile_smap_dist  () {return get_smap_atten_val();}
 float get_max_sea_level   () {return (get_water_z_height() + ocean_wave_height);}
 unsigned get_tile_size    () {return MESH_X_SIZE;}
 
+tile_xy_pair get_tile_xy_for_mesh_xy(int x, int y) {
+	int const tsz(get_tile_size());
+	if (x < 0) {x -= tsz-1;} // handle truncation toward lower integer
+	if (y < 0) {y -= tsz-1;}
+	return tile_xy_pair(x/tsz, y/tsz);
+}
+
 bool use_water_plane_tess () {
 	if (!enable_ocean_waves() || cloud_model != 0 || draw_distant_water()) return 0; // hack to use cloud_model (F10)
 	static bool tess_enabled(1);
@@ -175,8 +192,150 @@ void update_tiled_grass_colors() {grass_tile_manager.clear();} // regenerate gra
 #define BILINEAR_INTERP(arr, var, x, y) (y*(x*arr[1][1].var + (1.0f-x)*arr[1][0].var) + (1.0f-y)*(x*arr[0][1].var + (1.0f-x)*arr[0][0].var))
 
 
+// *** tile height cache ***
+
+size_t get_max_tile_height_payload_size();
+
+// LRU cache of compressed tile heights and AO lighting for tiles that were deleted, so that they don't need to be regenerated when the camera returns;
+// entries evicted from memory are written to tile_cache_dir if set, and all entries are keyed by the terrain generation params;
+// tiles modified by heightmap brushes are only cached in memory, since their heights no longer match the params hash
+class tile_height_cache_t {
+
+	struct disk_header_t {
+		unsigned magic, raw_size, comp_size;
+		int x, y;
+		unsigned pad; // explicit so that no uninitialized padding is written
+		uint64_t params_hash;
+	};
+	struct entry_t {
+		tile_xy_pair tp;
+		unsigned raw_size=0;
+		bool on_disk=0;
+		vector<unsigned char> data; // zlib compressed
+		entry_t(tile_xy_pair const &tp_) : tp(tp_) {}
+	};
+	static unsigned const DISK_MAGIC = 0x74686331; // "thc1"
+	std::list<entry_t> lru; // most recently used first
+	unordered_map<tile_xy_pair, std::list<entry_t>::iterator, hash_tile_xy_pair> entries;
+	unordered_set<tile_xy_pair, hash_tile_xy_pair> modified; // tiles edited this session; never written to disk
+	uint64_t params_hash=0;
+	size_t mem_used=0;
+
+	string get_fn(tile_xy_pair const &tp) const {
+		std::ostringstream oss;
+		oss << tile_cache_dir << "/tile_" << std::hex << params_hash << std::dec << "_" << tp.x << "_" << tp.y << ".thc";
+		return oss.str();
+	}
+	void erase(std::list<entry_t>::iterator it) {
+		mem_used -= it->data.size();
+		entries.erase(it->tp);
+		lru.erase(it);
+	}
+	void write_to_disk(entry_t const &e) const {
+		FILE *fp(fopen(get_fn(e.tp).c_str(), "wb"));
+		if (fp == nullptr) return; // directory doesn't exist or isn't writable; nonfatal
+		disk_header_t const header{DISK_MAGIC, e.raw_size, (unsigned)e.data.size(), e.tp.x, e.tp.y, 0, params_hash};
+		bool const success(fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(e.data.data(), 1, e.data.size(), fp) == e.data.size());
+		checked_fclose(fp);
+		if (!success) {remove(get_fn(e.tp).c_str());} // don't leave partial files
+	}
+	bool read_from_disk(entry_t &e) const {
+		FILE *fp(fopen(get_fn(e.tp).c_str(), "rb"));
+		if (fp == nullptr) return 0; // not cached
+		disk_header_t header;
+		bool success(fread(&header, sizeof(header), 1, fp) == 1 && header.magic == DISK_MAGIC && header.params_hash == params_hash && header.x == e.tp.x && header.y == e.tp.y);
+		size_t const max_raw_size(get_max_tile_height_payload_size());
+		success &= (header.raw_size <= max_raw_size && header.comp_size <= compressBound(max_raw_size)); // don't allocate sizes from corrupt files
+
+		if (success) {
+			e.raw_size = header.raw_size;
+			e.data.resize(header.comp_size);
+			success = (fread(e.data.data(), 1, e.data.size(), fp) == e.data.size());
+		}
+		checked_fclose(fp);
+		return success;
+	}
+	void evict_to_mem_limit() {
+		size_t const max_mem(size_t(tile_cache_mem_mb) << 20);
+
+		while (mem_used > max_mem && !lru.empty()) {
+			if (!tile_cache_dir.empty() && !lru.back().on_disk && modified.find(lru.back().tp) == modified.end()) {write_to_disk(lru.back());}
+			erase(std::prev(lru.end()));
+		}
+	}
+public:
+	bool enabled() const {return (tile_cache_mem_mb > 0);}
+
+	void set_params_hash(uint64_t hash) {
+		if (hash == params_hash) return;
+		clear(); // terrain changed, in-memory entries are invalid; disk entries include the hash in the filename
+		params_hash = hash;
+	}
+	void add(tile_t const &tile) {
+		if (!enabled()) return;
+		vector<unsigned char> raw;
+		tile.write_height_payload(raw);
+		if (raw.empty()) return; // heights weren't generated
+		tile_xy_pair const tp(tile.get_tile_xy_pair());
+		auto it(entries.find(tp));
+		if (it != entries.end()) {erase(it->second);} // replace
+		lru.emplace_front(tp);
+		entry_t &e(lru.front());
+		uLongf comp_size(compressBound(raw.size()));
+		e.data.resize(comp_size);
+		if (compress2(e.data.data(), &comp_size, raw.data(), raw.size(), 1) != Z_OK) {lru.pop_front(); return;} // level 1 = fastest
+		e.data.resize(comp_size);
+		e.data.shrink_to_fit();
+		e.raw_size = (unsigned)raw.size();
+		mem_used  += e.data.size();
+		entries[tp] = lru.begin();
+		evict_to_mem_limit();
+	}
+	bool restore(tile_t &tile) {
+		if (!enabled()) return 0;
+		tile_xy_pair const tp(tile.get_tile_xy_pair());
+		auto it(entries.find(tp));
+
+		if (it != entries.end()) {lru.splice(lru.begin(), lru, it->second);} // move to the front
+		else { // not in memory; try the disk cache
+			if (tile_cache_dir.empty()) return 0;
+			entry_t e(tp);
+			if (!read_from_disk(e)) return 0;
+			e.on_disk = 1;
+			lru.push_front(std::move(e));
+			mem_used += lru.front().data.size();
+			entries[tp] = lru.begin();
+			evict_to_mem_limit();
+			if (lru.empty() || !(lru.front().tp == tp)) return 0; // evicted; can only happen if the memory limit is tiny
+		}
+		entry_t const &e(lru.front());
+		vector<unsigned char> raw(e.raw_size);
+		uLongf raw_size(e.raw_size);
+		if (uncompress(raw.data(), &raw_size, e.data.data(), e.data.size()) == Z_OK && raw_size == e.raw_size && tile.read_height_payload(raw)) return 1;
+		cerr << "Error: invalid cached heights for tile " << tp.x << ", " << tp.y << endl;
+		invalidate(tp, 0); // is_modified=0
+		return 0;
+	}
+	void invalidate(tile_xy_pair const &tp, bool is_modified) { // called when the heightmap is modified or cached data is invalid
+		if (is_modified) {modified.insert(tp);}
+		auto it(entries.find(tp));
+		if (it != entries.end()) {erase(it->second);}
+		if (!tile_cache_dir.empty()) {remove(get_fn(tp).c_str());}
+	}
+	void clear() {
+		lru.clear();
+		entries.clear();
+		mem_used = 0;
+	}
+};
+
+tile_height_cache_t tile_height_cache;
+
+
 // *** heightmap management ***
 
+void drain_tile_gen_queue();
+tile_xy_pair get_tile_pair_at_point(point const &pos);
 
 class tiled_terrain_hmap_manager_t : public terrain_hmap_manager_t {
 
@@ -188,6 +347,7 @@ public:
 	void clear_modified() {for (unsigned i = 0; i < 3; ++i) {UNROLL_3X(modified[i][i_] = 0;)}}
 
 	void apply_brush(tex_mod_map_manager_t::hmap_brush_t brush, tile_t *tile, bool cache) { // Note: brush is copied and may be modified
+		drain_tile_gen_queue(); // background tile generation reads the heightmap
 		cur_tile = tile;
 		assert(brush.radius <= get_tile_size()); // only allow for a single adjacent tile
 		clear_modified();
@@ -198,7 +358,15 @@ public:
 		int const step_sz(max(1, int(1.0/mesh_scale + SMALL_NUMBER))); // Note: only intended to work when mesh_scale is a power of 0.5 (or generally an integer reciprocol)
 		unsigned const num_steps(max(1U, unsigned(mesh_scale + SMALL_NUMBER))); // Note: only intended to work when mesh_scale is a power of 2 (or generally an integer)
 		if (cache) {apply_and_cache_brush(brush, step_sz, num_steps);} else {terrain_hmap_manager_t::apply_brush(brush, step_sz, num_steps);}
-		if (cur_tile == NULL) return; // no tile specified, so can't do any updates
+
+		if (cur_tile == NULL) { // tile isn't loaded, so we don't know which adjacent tiles were modified; invalidate all cached tiles the brush may touch
+			tile_xy_pair const tp(get_tile_xy_for_mesh_xy(brush.x, brush.y));
+
+			for (int dy = -1; dy <= 1; ++dy) {
+				for (int dx = -1; dx <= 1; ++dx) {tile_height_cache.invalidate(tile_xy_pair(tp.x + dx, tp.y + dy), 1);} // is_modified=1
+			}
+			return;
+		}
 		tile_xy_pair const tp(cur_tile->get_tile_xy_pair());
 
 		for (int dy = -1; dy <= 1; ++dy) {
@@ -206,6 +374,7 @@ public:
 				if (!modified[dy+1][dx+1]) continue;
 				tile_t *adj_tile(get_tile_from_xy(tile_xy_pair(tp.x + dx, tp.y + dy)));
 				if (adj_tile) {adj_tile->invalidate_mesh_height();}
+				tile_height_cache.invalidate(tile_xy_pair(tp.x + dx, tp.y + dy), 1); // cached heights are out of date, even if the tile doesn't currently exist
 			}
 		}
 		cur_tile = NULL;
@@ -213,6 +382,7 @@ public:
 	void flatten_region(cube_t const &cube) {
 		// Note: to be applied before tiles are generated so that they don't need to be invalidated
 		// Note: assumes unscaled mesh (mesh_scale == 1)
+		drain_tile_gen_queue(); // background tile generation reads the heightmap
 		int const x1(floor((cube.x1() + X_SCENE_SIZE)*DX_VAL_INV)), y1(floor((cube.y1() + Y_SCENE_SIZE)*DY_VAL_INV));
 		int const x2(ceil ((cube.x2() + X_SCENE_SIZE)*DX_VAL_INV)), y2(ceil ((cube.y2() + Y_SCENE_SIZE)*DY_VAL_INV));
 		int cx1(x1), cy1(y1), cx2(x2+1), cy2(y2+1); // Note: cx2/cy2 are one past the end; this is needed for proper mirror clamping and empty range early termination optimization
@@ -259,9 +429,20 @@ float get_tiled_terrain_height_tex(float xval, float yval, bool nearest_texel) {
 }
 vector3d get_tiled_terrain_height_tex_norm(int x, int y) {return terrain_hmap_manager.get_norm(x, y);}
 
+uint64_t calc_tile_height_params_hash() { // hash of everything that affects cached tile heights, AO, and water bounds; a change invalidates cached tiles
+	bool const using_hmap(using_tiled_terrain_hmap_tex());
+	int const ivals[] = {mesh_gen_mode, mesh_gen_shape, mesh_seed, mesh_rgen_index, GLACIATE, mesh_freq_filter, (int)erosion_iters_tt, (int)get_tile_size(), using_hmap,
+		using_hmap_with_detail(), (int)tiled_terrain_gen_heightmap_sz, enable_terrain_env, enable_tiled_mesh_ao};
+	float const fvals[] = {mesh_scale, mesh_scale_z, glaciate_exp, erode_amount, X_SCENE_SIZE, DX_VAL, MESH_START_MAG, MESH_START_FREQ, MESH_MAG_MULT, MESH_FREQ_MULT,
+		mesh_height_scale, mesh_file_scale, mesh_file_tz, biome_x_offset, get_max_sea_level()};
+	uint64_t const hmap_hash(using_hmap ? terrain_hmap_manager.get_data_hash() : 0); // heightmap contents rather than filename; cached
+	return calc_fnv_hash(fvals, sizeof(fvals), calc_fnv_hash(ivals, sizeof(ivals), hmap_hash));
+}
+
 bool read_default_hmap_modmap() {
 
 	if (read_hmap_modmap_fn.empty()) return 0;
+	drain_tile_gen_queue(); // background tile generation reads the heightmap
 	if (!terrain_hmap_manager.read_and_apply_mod(read_hmap_modmap_fn)) return 0;
 	cout << "Read heightmap modmap " << read_hmap_modmap_fn << endl;
 	return 1;
@@ -443,6 +624,7 @@ bool setup_height_gen(mesh_xy_grid_cache_t &height_gen, float x0, float y0, floa
 bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 
 	//timer_t timer("Create Zvals");
+	FRAME_PROF_ZONE("Create Tile Zvals");
 	inside_city = check_city_contains_overlaps(get_mesh_bcube_global());
 	if (enable_terrain_env) {update_terrain_params();}
 	zvals.resize(zvsize*zvsize);
@@ -458,9 +640,7 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 		ao_zvals.resize(context_sz*context_sz);
 
 #pragma omp parallel for schedule(static,1)
-		for (int y = 0; y < (int)context_sz; ++y) {
-			for (unsigned x = 0; x < context_sz; ++x) {ao_zvals[y*context_sz + x] = height_gen.eval_index(x, y);}
-		}
+		for (int y = 0; y < (int)context_sz; ++y) {height_gen.eval_row(y, &ao_zvals[y*context_sz]);}
 	}
 	else {
 		bool results_ready(setup_height_gen(height_gen, get_xval(x1), get_yval(y1), deltax, deltay, zvsize, zvsize, 0, no_wait)); // cache_values=0
@@ -470,16 +650,23 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 
 #pragma omp parallel for schedule(static,1)
 	for (int y = 0; y < (int)zvsize; ++y) {
+		float *const row(&zvals[y*zvsize]);
+		vector<float> detail;
+
+		if (using_hmap) {
+			if (add_detail) {detail.resize(zvsize); height_gen.eval_row(y, detail.data());}
+		}
+		else if (ao_zvals.empty()) {height_gen.eval_row(y, row);} // use height gen, evaluated for the entire row at once
+
 		for (unsigned x = 0; x < zvsize; ++x) {
-			float &zval(zvals[y*zvsize + x]);
+			float &zval(row[x]);
 
 			if (using_hmap) {
 				zval = terrain_hmap_manager.get_clamped_height((x1 + x), (y1 + y));
-				if (add_detail) {zval += HMAP_DETAIL_MAG*height_gen.eval_index(x, y);} // less hard-coded - scale by delta between adjacent zvals?
+				if (add_detail) {zval += HMAP_DETAIL_MAG*detail[x];} // less hard-coded - scale by delta between adjacent zvals?
 			}
 			else {
 				if (!ao_zvals.empty()) {zval = ao_zvals[(y + AO_RAY_LEN)*context_sz + (x + AO_RAY_LEN)];} // use AO zvals
-				else                   {zval = height_gen.eval_index(x, y);} // use height gen
 
 				if (USE_PARAMS_HSCALE) {
 					float const xv(float(x)*xy_mult), yv(float(y)*xy_mult);
@@ -521,6 +708,60 @@ bool tile_t::create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait) {
 	return 1; // results are ready
 }
 
+struct tile_height_payload_header_t { // the values calculated by create_zvals() and calc_mesh_ao_lighting(), followed by zvals and ao_lighting
+	unsigned zvsize, ao_size;
+	int wx1, wy1, wx2, wy2;
+	float mzmin, mzmax, mesh_dz, radius;
+	float sub_zmin[4][4], sub_zmax[4][4];
+};
+
+size_t get_max_tile_height_payload_size() {
+	unsigned const stride(get_tile_size()+1), zvsize(stride+1); // must agree with tile_t
+	return (sizeof(tile_height_payload_header_t) + zvsize*zvsize*sizeof(float) + stride*stride);
+}
+
+void tile_t::write_height_payload(vector<unsigned char> &data) const {
+
+	data.clear();
+	if (zvals.empty() || mesh_height_invalid) return; // heights not valid
+	tile_height_payload_header_t header{zvsize, (unsigned)ao_lighting.size(), wx1, wy1, wx2, wy2, mzmin, mzmax, mesh_dz, radius, {}, {}};
+	memcpy(header.sub_zmin, sub_zmin, sizeof(sub_zmin));
+	memcpy(header.sub_zmax, sub_zmax, sizeof(sub_zmax));
+	size_t const zvals_sz(zvals.size()*sizeof(float));
+	data.resize(sizeof(header) + zvals_sz + ao_lighting.size());
+	memcpy(data.data(), &header, sizeof(header));
+	memcpy(data.data() + sizeof(header), zvals.data(), zvals_sz);
+	if (!ao_lighting.empty()) {memcpy(data.data() + sizeof(header) + zvals_sz, ao_lighting.data(), ao_lighting.size());}
+}
+
+bool tile_t::read_height_payload(vector<unsigned char> const &data) { // alternative to create_zvals() for cached tiles; returns 0 if the data is invalid
+
+	tile_height_payload_header_t header;
+	if (data.size() < sizeof(header)) return 0;
+	memcpy(&header, data.data(), sizeof(header));
+	size_t const zvals_sz(zvsize*zvsize*sizeof(float));
+	if (header.zvsize != zvsize || (header.ao_size != 0 && header.ao_size != stride*stride) || data.size() != sizeof(header) + zvals_sz + header.ao_size) return 0;
+	inside_city = check_city_contains_overlaps(get_mesh_bcube_global());
+	if (enable_terrain_env) {update_terrain_params();}
+	zvals.resize(zvsize*zvsize);
+	memcpy(zvals.data(), data.data() + sizeof(header), zvals_sz);
+	
+	if (header.ao_size > 0 && enable_tiled_mesh_ao) {
+		ao_lighting.resize(header.ao_size);
+		memcpy(ao_lighting.data(), data.data() + sizeof(header) + zvals_sz, header.ao_size);
+	}
+	wx1 = header.wx1; wy1 = header.wy1; wx2 = header.wx2; wy2 = header.wy2;
+	mzmin   = header.mzmin;
+	mzmax   = header.mzmax;
+	mesh_dz = header.mesh_dz;
+	radius  = header.radius;
+	memcpy(sub_zmin, header.sub_zmin, sizeof(sub_zmin));
+	memcpy(sub_zmax, header.sub_zmax, sizeof(sub_zmax));
+	ptzmax = dtzmax = mzmin; // no trees yet
+	if (!can_have_trees()) {no_trees = 1;}
+	return 1;
+}
+
 void tile_t::get_z_minmax_for_area(point const &pos, float radius, float &zmin, float &zmax) const {
 
 	float const rx1(pos.x - radius), ry1(pos.y - radius), rx2(pos.x + radius), ry2(pos.y + radius);
@@ -562,6 +803,7 @@ float tile_t::get_zval_at(float x, float y, bool in_global_space) const {
 void tile_t::calc_mesh_ao_lighting() {
 
 	//timer_t timer("Calc Tile AO Lighting");
+	FRAME_PROF_ZONE("Calc Tile AO Lighting");
 	// caclulate ray step directions
 	tile_xy_pair ao_dirs[NUM_AO_DIRS]; // 0  1  2  3  4  5  6  7
 	unsigned ix(0);
@@ -656,11 +898,7 @@ void tile_t::calc_shadows_for_light(unsigned l) {
 		tile_t *adj_tile(get_tile_from_xy(adj_tp[d]));
 		if (adj_tile == NULL || adj_tile->is_distant) continue; // no adjacent tile
 		vector<float> const &adj_sh_out(adj_tile->sh_out[l][!d]);
-				
-		if (adj_sh_out.empty()) { // adjacent tile not initialized
-			adj_tile->calc_shadows((l == LIGHT_SUN), (l == LIGHT_MOON), 1); // recursive call on adjacent tile
-		}
-		assert(adj_sh_out.size() == zvsize);
+		assert(adj_sh_out.size() == zvsize); // adjacent tile must have been calculated in an earlier wavefront
 		sh_in[!d] = &adj_sh_out.front(); // chain our input to our neighbor's output
 	}
 	// calculate shadows of current tile
@@ -670,50 +908,99 @@ void tile_t::calc_shadows_for_light(unsigned l) {
 }
 
 
-void tile_t::proc_tile_queue(tile_t *init_tile, unsigned l) {
+// Tiles take their shadow inputs from their two neighbors toward the light, which always have a wavefront index one higher than their own,
+// so tiles are processed in anti-diagonal wavefronts from the light side and the tiles within a wavefront are calculated in parallel.
+// Uncalculated tiles that roots pull from are added; unless no_push=1, changed output edges are pushed to already calculated tiles away from the light.
+void tile_t::calc_shadows_wavefront(vector<tile_t *> const &roots, unsigned l, bool no_push) {
 
+	FRAME_PROF_ZONE("Tile Mesh Shadows");
 	point const lpos(get_light_pos(l));
-	deque<tile_t *> tile_queue;
-	tile_queue.push_front(init_tile);
-	init_tile->in_queue = 1;
-
-	while (!tile_queue.empty()) {
-		tile_t *t(tile_queue.back());
-		tile_queue.pop_back();
-		assert(t->in_queue);
-		t->in_queue = 0;
-		vector<float> const prev_sh_out[2] = {t->sh_out[l][0], t->sh_out[l][1]};
-		t->calc_shadows_for_light(l);
-		tile_xy_pair const tp(t->x1/int(t->size), t->y1/int(t->size));
-		tile_xy_pair const adj_tp2[2] = {tile_xy_pair((tp.x + ((lpos.x < 0.0) ? 1 : -1)), tp.y),
-										 tile_xy_pair(tp.x, (tp.y + ((lpos.y < 0.0) ? 1 : -1)))}; // away from the light source
-
-		for (unsigned d = 0; d < 2; ++d) { // d = tile adjacency dimension, shared edge is in !d
-			if (t->sh_out[l][!d] == prev_sh_out[!d]) continue; // unchanged, no update needed
-			tile_t *adj_tile(get_tile_from_xy(adj_tp2[d]));
-			if (adj_tile == NULL || adj_tile->is_distant || adj_tile->smask[l].empty() || adj_tile->in_queue) continue; // no adjacent tile, not initialized, or already in queue
-			tile_queue.push_front(adj_tile); // changed, push to adjacent tiles
-			adj_tile->in_queue = 1;
+	int const sx((lpos.x < 0.0) ? -1 : 1), sy((lpos.y < 0.0) ? -1 : 1); // tile step toward the light source
+	typedef vector<pair<tile_t *, bool>> wave_t; // {tile, push_changes}
+	map<int, wave_t> waves; // keyed by wavefront index = tile distance toward the light source
+	vector<pair<tile_t *, bool>> pending;
+	for (tile_t *t : roots) {pending.emplace_back(t, !no_push);}
+
+	while (!pending.empty()) { // add roots and the uncalculated tiles they pull from
+		tile_t *const t(pending.back().first);
+		bool const push(pending.back().second);
+		pending.pop_back();
+		if (t->in_queue) continue; // already added
+		t->in_queue = 1;
+		if (t->smask[l].empty()) {t->smask[l].resize(t->zvals.size(), 0);}
+		tile_xy_pair const tp(t->get_tile_xy_pair());
+		waves[sx*tp.x + sy*tp.y].emplace_back(t, push);
+		if (t->is_distant) continue;
+		tile_xy_pair const adj_tp[2] = {tile_xy_pair(tp.x+sx, tp.y), tile_xy_pair(tp.x, tp.y+sy)}; // toward the light source
+
+		for (unsigned d = 0; d < 2; ++d) {
+			tile_t *const adj_tile(get_tile_from_xy(adj_tp[d]));
+			if (adj_tile != NULL && !adj_tile->is_distant && adj_tile->smask[l].empty()) {pending.emplace_back(adj_tile, 0);} // not yet calculated
 		}
 	} // end while()
+	vector<unsigned char> changed;
+
+	while (!waves.empty()) { // process from the light source outward
+		auto const last(--waves.end());
+		int const wave_ix(last->first);
+		wave_t wave;
+		wave.swap(last->second);
+		waves.erase(last);
+		changed.clear();
+		changed.resize(2*wave.size(), 0);
+
+#pragma omp parallel for schedule(dynamic,1) if (wave.size() > 1)
+		for (int i = 0; i < (int)wave.size(); ++i) {
+			tile_t *const t(wave[i].first);
+			if (!wave[i].second) {t->calc_shadows_for_light(l); continue;} // no push, don't need to check for changes
+			vector<float> const prev_sh_out[2] = {t->sh_out[l][0], t->sh_out[l][1]};
+			t->calc_shadows_for_light(l);
+			for (unsigned d = 0; d < 2; ++d) {changed[2*i + d] = (t->sh_out[l][!d] != prev_sh_out[!d]);}
+		}
+		for (unsigned i = 0; i < wave.size(); ++i) {
+			tile_t *const t(wave[i].first);
+			assert(t->in_queue);
+			t->in_queue = 0;
+			if (!wave[i].second) continue;
+			tile_xy_pair const tp(t->get_tile_xy_pair());
+			tile_xy_pair const adj_tp2[2] = {tile_xy_pair(tp.x-sx, tp.y), tile_xy_pair(tp.x, tp.y-sy)}; // away from the light source
+
+			for (unsigned d = 0; d < 2; ++d) { // d = tile adjacency dimension, shared edge is in !d
+				if (!changed[2*i + d]) continue; // unchanged, no update needed
+				tile_t *adj_tile(get_tile_from_xy(adj_tp2[d]));
+				if (adj_tile == NULL || adj_tile->is_distant || adj_tile->smask[l].empty() || adj_tile->in_queue) continue; // no adjacent tile, not initialized, or already in queue
+				waves[wave_ix-1].emplace_back(adj_tile, 1); // changed, push to adjacent tiles in the next wavefront
+				adj_tile->in_queue = 1;
+			}
+		} // for i
+	} // end while()
 }
 
 
-void tile_t::calc_shadows(bool calc_sun, bool calc_moon, bool no_push) {
+void tile_t::calc_shadows_for_tiles(vector<tile_t *> const &tiles, bool calc_sun, bool calc_moon, bool no_push) { // static
 
 	bool calc_light[NUM_LIGHT_SRC] = {0};
 	calc_light[LIGHT_SUN ] = calc_sun;
 	calc_light[LIGHT_MOON] = calc_moon;
+	vector<tile_t *> roots;
 
 	for (unsigned l = 0; l < NUM_LIGHT_SRC; ++l) { // calculate mesh shadows for each light source
-		if (!calc_light[l])    continue; // light not enabled
-		if (!smask[l].empty()) continue; // already calculated (cached)
-		smask[l].resize(zvals.size(), 0);
+		if (!calc_light[l]) continue; // light not enabled
+		roots.clear();
+
+		for (tile_t *t : tiles) {
+			if (t->smask[l].empty()) {roots.push_back(t);} // skip if already calculated (cached)
+		}
 		//if (normal_zmin < 1.0 && get_light_pos(l).get_norm().xy_mag() < normal_zmin) { // terrain slope lower than sun slope
-		if (no_push) {calc_shadows_for_light(l);} else {proc_tile_queue(this, l);}
+		if (!roots.empty()) {calc_shadows_wavefront(roots, l, no_push);}
 	}
 }
 
+void tile_t::calc_shadows(bool calc_sun, bool calc_moon, bool no_push) {
+	vector<tile_t *> const tiles(1, this);
+	calc_shadows_for_tiles(tiles, calc_sun, calc_moon, no_push);
+}
+
 
 void tile_t::push_tree_ao_shadow(int dx, int dy, point const &pos, float tradius) const {
 
@@ -1050,6 +1337,7 @@ bool check_region_int(cube_t const &region, vect_cube_t const &cubes) { // has_b
 void tile_t::create_texture(mesh_xy_grid_cache_t &height_gen) {
 
 	//highres_timer_t timer("Create Tile Weights Texture"); // 1.38ms base, 1.5ms with buildings/roads/driveways/porches/doorsteps
+	FRAME_PROF_ZONE("Create Tile Weights Texture");
 	assert(zvals.size() == zvsize*zvsize);
 	unsigned const tsize(stride), num_texels(tsize*tsize);
 	int sand_tex_ix(-1), dirt_tex_ix(-1), grass_tex_ix(-1), rock_tex_ix(-1), snow_tex_ix(-1);
@@ -2173,6 +2461,119 @@ void lightning_strike_t::end_draw() const {
 }
 
 
+// *** tile_gen_queue_t ***
+
+
+void tile_gen_queue_t::worker_loop() {
+#ifdef _OPENMP
+	omp_set_num_threads(1); // tiles are generated in parallel across workers, so don't create a nested OpenMP team in each worker
+#endif
+	mesh_xy_grid_cache_t height_gen; // one per worker
+
+	while (1) {
+		tile_t *tile(nullptr);
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_cv.wait(lock, [this] {return (kill_threads || !pending.empty());});
+			if (kill_threads) break;
+			pop_heap(pending.begin(), pending.end());
+			tile = pending.back().tile;
+			pending.pop_back();
+			++num_running;
+		}
+		tile->create_zvals(height_gen, 0); // Note: CPU height generation only; GPU modes don't use this queue
+		if (enable_tiled_mesh_ao) {tile->calc_mesh_ao_lighting();} // doesn't depend on other tiles, so do it here rather than in pre_draw()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.push_back(tile);
+			--num_running;
+		}
+		idle_cv.notify_all();
+	} // while
+}
+
+void tile_gen_queue_t::add(tile_t *tile) {
+	if (workers.empty()) { // start workers on first use, leaving a thread for the main thread
+		unsigned const num_workers(min(4U, max(1U, NUM_THREADS-1)));
+		for (unsigned i = 0; i < num_workers; ++i) {workers.emplace_back(&tile_gen_queue_t::worker_loop, this);}
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.emplace_back(tile->get_draw_priority(), tile);
+		push_heap(pending.begin(), pending.end());
+	}
+	work_cv.notify_one();
+}
+
+void tile_gen_queue_t::update_pending(vector<tile_t *> &dropped) { // reprioritize for the current camera, and drop tiles that are no longer in range
+	std::lock_guard<std::mutex> lock(mutex);
+	unsigned num_keep(0);
+
+	for (job_t &job : pending) {
+		if (!job.tile->rel_dist_to_camera_xy_lt(CREATE_DIST_TILES)) {dropped.push_back(job.tile); continue;}
+		job.priority = job.tile->get_draw_priority();
+		pending[num_keep++] = job;
+	}
+	pending.erase(pending.begin()+num_keep, pending.end());
+	make_heap(pending.begin(), pending.end());
+}
+
+void tile_gen_queue_t::get_finished(vector<tile_t *> &tiles, unsigned max_num) {
+	std::lock_guard<std::mutex> lock(mutex);
+	unsigned const num(min(max_num, (unsigned)finished.size())); // finished in approximately priority order
+	tiles.insert(tiles.end(), finished.begin(), finished.begin()+num);
+	finished.erase(finished.begin(), finished.begin()+num);
+}
+
+// removes the tile at tp so that the main thread can insert it now, waiting for it if it's being generated;
+// returns null if the tile isn't in the queue; was_generated is set if the tile's heights have already been generated
+tile_t *tile_gen_queue_t::take(tile_xy_pair const &tp, bool &was_generated) {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (auto i = pending.begin(); i != pending.end(); ++i) {
+		if (!(i->tile->get_tile_xy_pair() == tp)) continue;
+		tile_t *const tile(i->tile);
+		pending.erase(i);
+		make_heap(pending.begin(), pending.end());
+		was_generated = 0;
+		return tile;
+	}
+	while (1) { // not pending, so it must be running or finished
+		for (auto i = finished.begin(); i != finished.end(); ++i) {
+			if (!((*i)->get_tile_xy_pair() == tp)) continue;
+			tile_t *const tile(*i);
+			finished.erase(i);
+			was_generated = 1;
+			return tile;
+		}
+		if (num_running == 0) return nullptr; // not found
+		idle_cv.wait(lock); // wait for a running job to finish
+	}
+	return nullptr; // never gets here
+}
+
+void tile_gen_queue_t::clear() {
+	std::unique_lock<std::mutex> lock(mutex);
+	for (job_t const &job : pending) {delete job.tile;}
+	pending.clear();
+	idle_cv.wait(lock, [this] {return (num_running == 0);});
+	for (tile_t *tile : finished) {delete tile;}
+	finished.clear();
+}
+
+void tile_gen_queue_t::stop() {
+	clear();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		kill_threads = 1;
+	}
+	work_cv.notify_all();
+	for (std::thread &t : workers) {t.join();}
+	workers.clear();
+	kill_threads = 0;
+}
+
+
 // *** tile_draw_t ***
 
 
@@ -2186,10 +2587,22 @@ void tile_draw_t::clear(bool no_regen_buildings) {
 	for (tile_map::iterator i = tiles.begin(); i != tiles.end(); ++i) {i->second->clear();} // may not be necessary
 	to_draw.clear();
 	tiles.clear();
+	tile_gen_queue.clear();
+	tile_height_cache.clear();
+	async_gen_tiles.clear();
 	shadow_recomp_queue.clear();
 	if (!no_regen_buildings && !have_cities()) {buildings_valid = 0;} // can't regenerate buildings after cities and cars have been placed
 }
 
+void tile_draw_t::take_async_gen_tile(tile_xy_pair const &tp) { // take a tile from the background queue and insert it this frame
+	bool was_generated(0);
+	tile_t *const tile(tile_gen_queue.take(tp, was_generated));
+	async_gen_tiles.erase(tp);
+	if (tile == nullptr) return; // shouldn't get here
+	if (was_generated) {insert_tile(tile);}
+	else {to_gen_zvals.push_back(make_pair(tile->get_draw_priority(), tile));} // generate on the main thread this frame
+}
+
 void tile_draw_t::insert_tile(tile_t *tile) {
 	bool const did_ins(tiles.insert(make_pair(tile->get_tile_xy_pair(), tile)).second);
 	assert(did_ins);
@@ -2202,11 +2615,15 @@ void tile_draw_t::free_compute_shader() {
 float tile_draw_t::update(float &min_camera_dist) { // view-independent updates; returns terrain zmin
 
 	//highres_timer_t timer("TT Update");
+	FRAME_PROF_ZONE("TT Update");
 	unsigned const max_tile_gen_per_frame = 16; // higher = less overall gen time (more parallel), but longer wait for first render
 	unsigned const max_cpu_tiles          = 3; // 0 = GPU only
 	unsigned const max_defer_tiles        = 8; // 0 = disable
+	unsigned const max_async_ins_per_frame= 8; // max background generated tiles inserted per frame; limits the GPU work done in pre_draw() each frame
 	if (height_gens.empty()) {height_gens.resize(max(max_defer_tiles, 1U));}
 
+	if (!terrain_hmap_manager.enabled() && (mh_filename_tt != nullptr || tiled_terrain_gen_heightmap_sz > 0)) {drain_tile_gen_queue();} // heightmap is about to be created
+
 	if (terrain_hmap_manager.maybe_load(mh_filename_tt, (invert_mh_image != 0))) {
 		read_default_hmap_modmap();
 		force_onto_surface_mesh(surface_pos); // move camera onto newly loaded terrain so that the first drawn frame is correct
@@ -2217,6 +2634,7 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 		// since the heightmap values should be the same as single point queries, we don't need to re-calculate the player's zval
 	}
 	if (!buildings_valid) {
+		drain_tile_gen_queue(); // may flatten the heightmap and changes the city data that tile generation reads
 		gen_buildings();
 		gen_city_details(); // after building generation
 		buildings_valid = 1;
@@ -2233,8 +2651,13 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 	int const x2( tile_radius + toffx), y2( tile_radius + toffy);
 	unsigned const init_tiles((unsigned)tiles.size());
 	bool const create_buildings_first(FLATTEN_BUILDING_TILE && using_tiled_terrain_hmap_tex());
+	bool const gpu_mode(mesh_gen_mode >= MGEN_SIMPLEX_GPU);
+	// generate tiles in the background unless this is the first set of tiles, the GPU is needed, or the heightmap may be modified by this thread
+	bool const use_async_gen(!tiles.empty() && !gpu_mode && !create_buildings_first && inf_terrain_fire_mode == FM_NONE);
 	unsigned num_erased(0);
+	tile_xy_pair const camera_txy(get_tile_pair_at_point(cpos));
 	min_camera_dist = FAR_DISTANCE;
+	tile_height_cache.set_params_hash(calc_tile_height_params_hash());
 	// Note: we may want to calculate distant low-res or larger tiles when the camera is high above the mesh
 
 	if (!to_gen_zvals.empty()) {
@@ -2247,9 +2670,33 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 		}
 		to_gen_zvals.clear();
 	}
+	if (!async_gen_tiles.empty()) { // insert tiles that were generated in the background, and drop pending tiles that are now too far away
+		vector<tile_t *> gen_tiles;
+		tile_gen_queue.update_pending(gen_tiles);
+
+		for (tile_t *tile : gen_tiles) {
+			async_gen_tiles.erase(tile->get_tile_xy_pair());
+			delete tile;
+		}
+		gen_tiles.clear();
+		// if no longer generating in the background, insert all finished tiles, then wait for running jobs and drop the rest
+		tile_gen_queue.get_finished(gen_tiles, (use_async_gen ? max_async_ins_per_frame : (unsigned)async_gen_tiles.size()));
+
+		for (tile_t *tile : gen_tiles) {
+			async_gen_tiles.erase(tile->get_tile_xy_pair());
+			insert_tile(tile); // will be removed below if too far away
+		}
+		if (!use_async_gen && !async_gen_tiles.empty()) {
+			tile_gen_queue.clear();
+			async_gen_tiles.clear();
+		}
+		// the camera's tile is required this frame, for example after a teleport, so don't wait for the background threads to get to it
+		else if (tiles.find(camera_txy) == tiles.end() && async_gen_tiles.find(camera_txy) != async_gen_tiles.end()) {take_async_gen_tile(camera_txy);}
+	}
 	for (tile_map::iterator i = tiles.begin(); i != tiles.end(); ) { // update tiles and free old tiles (Note: no ++i)
 		if (!i->second->update_range(smap_manager)) { // delete this tile
 			remove_buildings_tile(i->first.x, i->first.y); // required to avoid memory leak when player teleports to a new location
+			tile_height_cache.add(*i->second);
 			i->second->clear();
 			tiles.erase(i++);
 			++num_erased;
@@ -2258,19 +2705,25 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 	for (int y = y1; y <= y2; ++y ) { // create new tiles
 		for (int x = x1; x <= x2; ++x ) {
 			tile_xy_pair const txy(x, y);
-			if (tiles.find(txy) != tiles.end()) continue; // already exists
+			if (tiles.find(txy) != tiles.end() || async_gen_tiles.find(txy) != async_gen_tiles.end()) continue; // already exists or is being generated
 			tile_t tile(get_tile_size(), x, y);
 			if (!tile.rel_dist_to_camera_xy_lt(CREATE_DIST_TILES)) continue; // too far away to create
 			tile_t *new_tile(new tile_t(tile));
-			to_gen_zvals.push_back(make_pair(new_tile->get_draw_priority(), new_tile));
 			// in this mode, we need to place buildings and flatten the heightmap before calculating tile heights
 			if (create_buildings_first) {create_buildings_tile(x, y, 1);}
+			if (tile_height_cache.restore(*new_tile)) {insert_tile(new_tile); continue;} // heights were cached, no need to generate
+
+			if (use_async_gen && !(txy == camera_txy)) { // the camera's tile is generated on this thread so that there's always terrain under the camera
+				tile_gen_queue.add(new_tile);
+				async_gen_tiles.insert(txy);
+				continue;
+			}
+			to_gen_zvals.push_back(make_pair(new_tile->get_draw_priority(), new_tile));
 		} // for x
 	} // for y
 	//if (to_gen_zvals.size() < max_cpu_tiles) {to_gen_zvals.clear();} // block until at least max_cpu_tiles tiles to generate (lower average gen time, but causes more slow frames/lag)
 	unsigned const num_to_gen(to_gen_zvals.size());
 	unsigned gen_this_frame(min(num_to_gen, max_tile_gen_per_frame));
-	bool const gpu_mode(mesh_gen_mode >= MGEN_SIMPLEX_GPU);
 	
 	// to balance tile gen time across frames, generate a number of tiles equal to the average of this frame and the previous frame
 	if (gen_this_frame > 1 && gen_this_frame < max_tile_gen_per_frame && inf_terrain_fire_mode == FM_NONE) { // disable this mode when editing mesh height to prevent visual artifacts
@@ -2340,17 +2793,21 @@ float tile_draw_t::update(float &min_camera_dist) { // view-independent updates;
 		last_sun  = sun_pos;
 		last_moon = moon_pos;
 	}
-	unsigned num_shadow_updates = 12; // hard max per frame
+	unsigned const max_shadow_updates = 12; // hard max per frame
+	vector<tile_t *> to_recomp_shadows;
 
-	while (!shadow_recomp_queue.empty() && num_shadow_updates > 0) { // perform some queued shadow map updates, starting at light source
+	while (!shadow_recomp_queue.empty() && to_recomp_shadows.size() < max_shadow_updates) { // perform some queued shadow map updates, starting at light source
 		tile_xy_pair const tp(shadow_recomp_queue.back().second);
 		shadow_recomp_queue.pop_back();
 		tile_map::const_iterator it(tiles.find(tp));
 		if (it == tiles.end()) continue; // tile no longer exists/was deleted
-		// recompute shadows; tiles feeding in (closer to the light) should have already been calculated
 		it->second->clear_shadows(1, 0); // update sun shadows only
-		it->second->check_shadow_map_and_normal_texture(1); // no_push=1
-		--num_shadow_updates;
+		to_recomp_shadows.push_back(it->second.get());
+	}
+	if (!to_recomp_shadows.empty()) {
+		// recompute shadows in parallel; tiles feeding in (closer to the light) should have already been calculated or are part of this group
+		if (light_factor >= 0.4) {tile_t::calc_shadows_for_tiles(to_recomp_shadows, 1, 0, 1);} // sun only, no_push=1
+		for (tile_t *t : to_recomp_shadows) {t->check_shadow_map_and_normal_texture(1);} // no_push=1
 	}
 	// Note: we could regen trees and scenery if water was just turned on to remove underwater vegetation
 	//if ((GET_TIME_MS() - timer1) > 100) {PRINT_TIME("Tiled Terrain Update");}
@@ -2680,10 +3137,17 @@ void tile_draw_t::pre_draw() { // view-dependent updates/GPU uploads
 	if (enable_instanced_pine_trees() && !to_gen_trees.empty()) {create_pine_tree_instances();}
 	//RESET_TIME;
 	// don't use parallel tree gen for a single tile
+	unsigned const prof_parent(frame_prof_get_cur_node());
 #pragma omp parallel for schedule(dynamic,1) if (to_gen_trees.size() > 1)
-	for (int i = 0; i < (int)to_gen_trees.size(); ++i) {to_gen_trees[i]->init_pine_tree_draw();}
+	for (int i = 0; i < (int)to_gen_trees.size(); ++i) {
+		FRAME_PROF_PARENT(prof_parent);
+		FRAME_PROF_ZONE("Init Tile Pine Trees");
+		to_gen_trees[i]->init_pine_tree_draw();
+	}
 	//if (!to_gen_trees.empty()) {PRINT_TIME("Gen Trees2");}
 	assert(!height_gens.empty());
+	// calculate any missing mesh shadows for all tiles together so that independent tiles can be processed in parallel; pre_draw() will only upload them
+	if (mesh_shadows_enabled()) {tile_t::calc_shadows_for_tiles(to_update, (light_factor >= 0.4), (light_factor <= 0.6), 0);} // no_push=0
 	
 	for (vector<tile_t *>::iterator i = to_update.begin(); i != to_update.end(); ++i) {
 		(*i)->pre_draw(height_gens[0]);
@@ -3490,6 +3954,8 @@ bool tile_draw_t::line_intersect_mesh(point const &v1, point const &v2, float &t
 
 tile_draw_t terrain_tile_draw;
 
+void drain_tile_gen_queue() {terrain_tile_draw.drain_tile_gen_queue();} // must be called before the heightmap or city data is modified
+
 
 void update_tiled_grass_length_width(float lscale, float wscale) {
 	grass_tile_manager.scale_grass(lscale, wscale);
@@ -3866,13 +4332,7 @@ void change_inf_terrain_fire_mode(int val, bool mouse_wheel) {
 	play_switch_weapon_sound();
 }
 
-tile_t *get_tile_for_xy(int x, int y) {
-
-	int const tsz(get_tile_size());
-	if (x < 0) {x -= tsz-1;} // handle truncation toward lower integer
-	if (y < 0) {y -= tsz-1;}
-	return get_tile_from_xy(tile_xy_pair(x/tsz, y/tsz));
-}
+tile_t *get_tile_for_xy(int x, int y) {return get_tile_from_xy(get_tile_xy_for_mesh_xy(x, y));}
 
 void inf_terrain_fire_weapon() {
 
@@ -15,6 +15,9 @@
 #include "animals.h"
 #include <unordered_map>
 #include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 
 bool const ENABLE_TREE_LOD    = 1; // faster but has popping artifacts
@@ -285,6 +288,8 @@ public:
 	void clear_vbo_tid(tile_shadow_map_manager *smap_manager);
 	void clear_pine_tree_vbos() {pine_trees.clear_vbos();}
 	bool create_zvals(mesh_xy_grid_cache_t &height_gen, bool no_wait);
+	void write_height_payload(vector<unsigned char> &data) const;
+	bool read_height_payload(vector<unsigned char> const &data);
 	void get_z_minmax_for_area(point const &pos, float radius, float &zmin, float &zmax) const;
 	float get_zval_at(float x, float y, bool in_global_space) const;
 
@@ -297,7 +302,8 @@ public:
 	// *** shadows ***
 	void calc_mesh_ao_lighting();
 	void calc_shadows_for_light(unsigned l);
-	static void proc_tile_queue(tile_t *init_tile, unsigned l);
+	static void calc_shadows_wavefront(vector<tile_t *> const &roots, unsigned l, bool no_push);
+	static void calc_shadows_for_tiles(vector<tile_t *> const &tiles, bool calc_sun, bool calc_moon, bool no_push);
 	void calc_shadows(bool calc_sun, bool calc_moon, bool no_push=0);
 
 	tile_xy_pair get_tile_xy_pair(int dx=0, int dy=0) const {
@@ -419,6 +425,36 @@ public:
 }; // tile_t
 
 
+// generates the heights and AO lighting of new tiles on a persistent pool of background threads, leaving only GPU work for the main thread;
+// pending tiles are started in order of get_draw_priority(), and finished tiles are returned to the main thread for insertion
+class tile_gen_queue_t {
+
+	struct job_t {
+		float priority;
+		tile_t *tile;
+		job_t(float priority_, tile_t *tile_) : priority(priority_), tile(tile_) {}
+		bool operator<(job_t const &j) const {return (priority > j.priority);} // heap top is the lowest priority value
+	};
+	std::mutex mutex;
+	std::condition_variable work_cv, idle_cv;
+	vector<job_t> pending; // binary heap
+	vector<tile_t *> finished;
+	vector<std::thread> workers;
+	unsigned num_running=0;
+	bool kill_threads=0;
+
+	void worker_loop();
+public:
+	~tile_gen_queue_t() {stop();}
+	void add(tile_t *tile);
+	void update_pending(vector<tile_t *> &dropped);
+	void get_finished(vector<tile_t *> &tiles, unsigned max_num);
+	tile_t *take(tile_xy_pair const &tp, bool &was_generated);
+	void clear(); // deletes all tiles not yet returned; waits for any running jobs to finish
+	void stop();
+}; // tile_gen_queue_t
+
+
 class tile_draw_t : public indexed_vbo_manager_t {
 
 	typedef unordered_map<tile_xy_pair, unique_ptr<tile_t>, hash_tile_xy_pair> tile_map;
@@ -438,6 +474,12 @@ class tile_draw_t : public indexed_vbo_manager_t {
 	crack_ibuf_t crack_ibuf;
 	tile_shadow_map_manager smap_manager;
 	vector<pair<float, tile_xy_pair>> shadow_recomp_queue;
+	tile_gen_queue_t tile_gen_queue;
+	unordered_set<tile_xy_pair, hash_tile_xy_pair> async_gen_tiles; // tiles owned by tile_gen_queue that haven't been inserted yet
+	void take_async_gen_tile(tile_xy_pair const &tp);
+public:
+	void drain_tile_gen_queue() {tile_gen_queue.clear(); async_gen_tiles.clear();} // discards all background work; tiles will be recreated
+private:
 	vect_cube_t occluder_cubes;
 	vector<vector<vector2d> > grass_insts[NUM_GRASS_LODS];
 
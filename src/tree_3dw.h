@@ -112,9 +112,10 @@ struct tree_xform_t {
 
 class tree_builder_t : public tree_xform_t {
 
-	static vector<tree_cylin >   cylin_cache;
-	static vector<tree_branch>   branch_cache;
-	static vector<tree_branch *> branch_ptr_cache;
+	// thread_local so that multiple trees can be built in parallel
+	static thread_local vector<tree_cylin >   cylin_cache;
+	static thread_local vector<tree_branch>   branch_cache;
+	static thread_local vector<tree_branch *> branch_ptr_cache;
 
 	tree_branch base, roots, *branches_34[2]={}, **branches=nullptr;
 	int base_num_cylins=0, root_num_cylins=0, ncib=0, num_1_branches=0, num_big_branches_min=0, num_big_branches_max=0;
@@ -156,6 +157,7 @@ class tree_data_t {
 
 	typedef vert_norm_comp_color leaf_vert_type_t;
 	typedef vert_norm_comp_tc branch_vert_type_t;
+	enum {LW_DX=0, LW_DY, LW_DZ, LW_LEN, LW_NX, LW_NY, LW_NZ, LW_SX, LW_SY, LW_SZ, LW_NUM}; // base to tip dir, its length, leaf normal, base to side dir
 
 	indexed_vbo_manager_t branch_manager;
 	unsigned leaf_vbo=0, num_branch_quads=0, num_unique_pts=0, branch_index_bytes=0;
@@ -164,12 +166,15 @@ class tree_data_t {
 	vector<leaf_vert_type_t> leaf_data;
 	vector<draw_cylin> all_cylins;
 	vector<tree_leaf> leaves;
+	vector<float> wind_geom[LW_NUM]; // per-leaf bend geometry in SoA form for bend_leaves(); built by ensure_wind_geom()
 	texture_pair_t render_leaf_texture, render_branch_texture;
 	int last_update_frame=0;
 	unsigned leaf_change_start=0, leaf_change_end=0;
 	bool reset_leaves=0, has_4th_branches=0;
 
 	void clear_vbo_ixs();
+	void calc_bounds();
+	void clear_wind_geom() {for (unsigned n = 0; n < LW_NUM; ++n) {wind_geom[n].clear();}}
 	template<typename branch_index_t> void create_branch_vbo();
 
 public:
@@ -184,6 +189,8 @@ public:
 	void make_private_copy(tree_data_t &dest) const;
 	void gen_tree_data(int tree_type_, int size, float tree_depth, float height_scale, float br_scale_mult, float nl_scale,
 		float bbo_scale, bool has_4th_branches_, cube_t const *clip_cube, bool create_bush, rand_gen_t &rgen);
+	bool write_gen_data(FILE *fp) const;
+	bool read_gen_data (FILE *fp);
 	void mark_leaf_changed(unsigned ix);
 	void gen_leaf_color();
 	void update_all_leaf_colors();
@@ -198,6 +205,8 @@ public:
 	void remove_leaf_ix(unsigned i, bool update_data);
 	bool spraypaint_leaves(point const &pos, float radius, colorRGBA const &color, bool check_only);
 	void bend_leaf(unsigned i, float angle);
+	void ensure_wind_geom(); // not thread safe
+	void bend_leaves(vector<float> const &angles, vector<uint8_t> const &bend);
 	void draw_leaf_quads_from_vbo(unsigned max_leaves) const;
 	void draw_leaves_shadow_only(float size_scale);
 	void ensure_branch_vbo();
@@ -306,7 +315,10 @@ public:
 	bool check_sphere_coll(point &center, float radius) const;
 	bool check_cube_int(cube_t const &c) const;
 	float calc_size_scale(point const &draw_pos) const;
+	float get_last_size_scale() const {return last_size_scale;}
+	unsigned get_leaf_wind_update_period() const;
 	void update_leaf_orients_wind();
+	static void update_leaf_orients_wind_batch(vector<tree *> &trees);
 	void draw_branches_top(shader_t &s, tree_lod_render_t &lod_renderer, bool shadow_only, bool reflection_pass, vector3d const &xlate, int wsoff_loc);
 	void draw_leaves_top(shader_t &s, tree_lod_render_t &lod_renderer, bool shadow_only, bool reflection_pass, vector3d const &xlate,
 		int wsoff_loc, int tex0_loc, vector<tree *> &to_update_leaves);
@@ -338,9 +350,15 @@ public:
 };
 
 
+// shared (instanced) tree data; all entries are generated up front in parallel, deterministically from their index, and can be cached on disk
 class tree_data_manager_t : public vector<tree_data_t> {
 	float last_tree_scale=1.0;
 	int last_rgi=0;
+
+	void gen_shared_tree(unsigned ix);
+	void gen_all();
+	unsigned read_cache (vector<uint64_t> const &keys);
+	void     write_cache(vector<uint64_t> const &keys) const;
 public:
 	void ensure_init();
 	void clear_context();
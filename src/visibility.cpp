@@ -559,8 +559,7 @@ void calc_mesh_shadows(unsigned l, point const &lpos, float const *const mh, uns
 					   float const *sh_in_x, float const *sh_in_y, float *sh_out_x, float *sh_out_y)
 {
 	bool const no_shadow(l == LIGHT_MOON && combined_gu), all_shadowed(!no_shadow && lpos.z < zmin);
-	unsigned char const val(all_shadowed ? MESH_SHADOW : 0);
-	for (int i = 0; i < xsize*ysize; ++i) {smask[i] = val;}
+	memset(smask, (all_shadowed ? MESH_SHADOW : 0), xsize*ysize*sizeof(unsigned char));
 	if (no_shadow || FAST_VISIBILITY_CALC == 3) return;
 	if (lpos.x == 0.0 && lpos.y == 0.0) return; // straight down = no mesh shadows
 	mesh_shadow_gen(mh, smask, xsize, ysize, sh_in_x, sh_in_y, sh_out_x, sh_out_y).run(lpos);
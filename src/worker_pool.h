@@ -0,0 +1,75 @@
+// 3D World - Persistent Worker Thread Pool
+// by Frank Gennari
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+// runs a job on N threads (the calling thread plus N-1 persistent workers) and waits for all of them to finish;
+// for use in code that's already inside an OpenMP parallel region, where a nested omp parallel region would be inactive;
+// the job is responsible for splitting its own work, for example with an atomic index
+class worker_pool_t {
+	std::mutex mutex;
+	std::condition_variable work_cv, done_cv;
+	std::vector<std::thread> workers;
+	std::function<void()> job;
+	unsigned job_id=0, job_num_workers=0, num_pending=0;
+	bool kill_threads=0;
+
+	void worker_loop(unsigned worker_ix) {
+		unsigned last_job_id(0);
+
+		while (1) {
+			std::function<void()> cur_job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				work_cv.wait(lock, [&] {return (kill_threads || job_id != last_job_id);});
+				if (kill_threads) break;
+				last_job_id = job_id;
+				if (worker_ix >= job_num_workers) continue; // not used for this job
+				cur_job = job;
+			}
+			cur_job();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				--num_pending;
+			}
+			done_cv.notify_one();
+		} // while
+	}
+public:
+	worker_pool_t() {}
+	worker_pool_t(worker_pool_t const &) = delete; // forbidden
+	void operator=(worker_pool_t const &) = delete; // forbidden
+	~worker_pool_t() {stop();}
+
+	void run(unsigned num_threads, std::function<void()> const &f) { // not reentrant; must be called from a single thread
+		if (num_threads <= 1) {f(); return;} // serial
+		unsigned const num_workers(num_threads - 1);
+		while (workers.size() < num_workers) {workers.emplace_back(&worker_pool_t::worker_loop, this, (unsigned)workers.size());} // created on first use
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = f;
+			job_num_workers = num_pending = num_workers;
+			++job_id;
+		}
+		work_cv.notify_all();
+		f(); // this thread does work as well
+		std::unique_lock<std::mutex> lock(mutex);
+		done_cv.wait(lock, [this] {return (num_pending == 0);}); // f may reference the caller's stack, so wait for every worker to finish with it
+		job = nullptr;
+	}
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			kill_threads = 1;
+		}
+		work_cv.notify_all();
+		for (std::thread &t : workers) {t.join();}
+		workers.clear();
+		kill_threads = 0;
+	}
+};